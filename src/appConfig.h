@@ -0,0 +1,154 @@
+// appConfig.h
+#ifndef APPCONFIG_H
+#define APPCONFIG_H
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+
+// User settings (distance per treat and MQTT). A published AppConfig is never changed again - a settings change builds
+//   a whole new one, checks it, and swaps it in with one atomic pointer swap (ConfigStore below). Anyone that grabbed
+//   the old one with current() keeps a complete, stable copy for as long as they hold on to it, so ie the mqtt task can
+//   hand mqttServer to PubSubClient without it changing (or going away) halfway through a connect.
+struct AppConfig
+{
+  uint32_t version;           // goes up by one with every published change
+  uint32_t distanceThreshold; // cm run per treat
+  bool mqttEnabled;
+  bool mqttPerFieldTopics; // also publish each stat on its own topic, like before the JSON state topic existed
+  uint16_t mqttPort;
+  char mqttServer[64];
+  char mqttUser[64];
+  char mqttPass[64];
+  char mqttPrefix[96];
+};
+
+inline void setAppConfigDefaults(AppConfig &config)
+{
+  memset(&config, 0, sizeof(config));
+  config.distanceThreshold = 100 * 100; // 100 meters
+  config.mqttEnabled = false;
+  config.mqttPerFieldTopics = false;
+  config.mqttPort = 1883;
+  strncpy(config.mqttServer, "10.4.0.4", sizeof(config.mqttServer) - 1);
+  strncpy(config.mqttUser, "cat_wheel", sizeof(config.mqttUser) - 1);
+  strncpy(config.mqttPass, "xxxxx", sizeof(config.mqttPass) - 1);
+  strncpy(config.mqttPrefix, "/iot/device/catwheel/", sizeof(config.mqttPrefix) - 1);
+}
+
+// NULL if the config is usable, otherwise what's wrong with it (for showing to the user)
+inline const char *validateAppConfig(const AppConfig &config)
+{
+  if (config.distanceThreshold < 100)
+  {
+    return "The distance per treat has to be at least 1 meter"; // 0 would empty the hopper as fast as the motor can go
+  }
+  if (config.mqttPort == 0)
+  {
+    return "The MQTT port has to be between 1 and 65535";
+  }
+  if (config.mqttEnabled && config.mqttServer[0] == '\0')
+  {
+    return "An MQTT server is needed to turn on MQTT";
+  }
+  if (config.mqttEnabled && config.mqttPrefix[0] == '\0')
+  {
+    return "A topic prefix is needed to turn on MQTT";
+  }
+  return NULL;
+}
+
+// Puts each setting validateAppConfig() would turn down back to its default and leaves the rest alone, so ie a legacy
+//   distance of 0 saved by an old firmware doesn't also throw away the MQTT server and password. MQTT switched on
+//   without a server is switched off rather than pointed at the default one. Returns how many settings it changed.
+inline int repairAppConfig(AppConfig &config)
+{
+  AppConfig defaults;
+  setAppConfigDefaults(defaults);
+  int repaired = 0;
+  if (config.distanceThreshold < 100)
+  {
+    config.distanceThreshold = defaults.distanceThreshold;
+    repaired++;
+  }
+  if (config.mqttPort == 0)
+  {
+    config.mqttPort = defaults.mqttPort;
+    repaired++;
+  }
+  if (config.mqttEnabled && config.mqttServer[0] == '\0')
+  {
+    config.mqttEnabled = false;
+    repaired++;
+  }
+  if (config.mqttEnabled && config.mqttPrefix[0] == '\0')
+  {
+    memcpy(config.mqttPrefix, defaults.mqttPrefix, sizeof(config.mqttPrefix));
+    repaired++;
+  }
+  return repaired;
+}
+
+class ConfigStore
+{
+public:
+  typedef std::shared_ptr<const AppConfig> Ref;
+
+  ConfigStore()
+  {
+    std::shared_ptr<AppConfig> defaults = std::make_shared<AppConfig>();
+    setAppConfigDefaults(*defaults);
+    defaults->version = 1;
+    current_ = defaults;
+  }
+
+  // The config as of right now. Hold on to the returned reference for as long as you use it.
+  Ref current() const { return std::atomic_load(&current_); }
+
+  // Changes every time a new config is published. Cheap (no reference counting), so a task can check it every loop
+  //   and only call current() when it has actually moved.
+  uint32_t changeCount() const { return changes_.load(std::memory_order_acquire); }
+
+  // Copies the current config, lets `edit` change the copy, checks it and swaps it in. If someone else published in
+  //   the meantime we start over from theirs, so `edit` may run more than once and should just set fields.
+  //   Returns NULL once published, or the reason it was rejected (nothing changes in that case). `before` / `after`
+  //   (optional) get the config we replaced and the one we published, ie for saving only what changed.
+  template <typename Edit>
+  const char *update(Edit edit, AppConfig *before = NULL, AppConfig *after = NULL)
+  {
+    Ref old = current();
+    while (true)
+    {
+      std::shared_ptr<AppConfig> next = std::make_shared<AppConfig>(*old);
+      edit(*next);
+      const char *error = validateAppConfig(*next);
+      if (error != NULL)
+      {
+        return error;
+      }
+      next->version = old->version + 1;
+
+      Ref published = next;
+      if (std::atomic_compare_exchange_strong(&current_, &old, published))
+      {
+        changes_.fetch_add(1, std::memory_order_release);
+        if (before != NULL)
+        {
+          *before = *old;
+        }
+        if (after != NULL)
+        {
+          *after = *next;
+        }
+        return NULL;
+      }
+      // lost the race, `old` now holds the winner's config - go again from that
+    }
+  }
+
+private:
+  Ref current_;
+  std::atomic<uint32_t> changes_{0};
+};
+
+#endif // APPCONFIG_H
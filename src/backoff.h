@@ -0,0 +1,51 @@
+// backoff.h
+#ifndef BACKOFF_H
+#define BACKOFF_H
+#include <stdint.h>
+
+// Exponential backoff with jitter for reconnect loops. The first retry comes after baseMs. Each failure after that
+//   doubles the delay, up to maxMs. The actual delay is picked at random from the upper half of that range, so a room
+//   full of devices that lost the same access point don't all come knocking at the same moment. Call reset() once
+//   the connection is back up.
+//
+//   Backoff backoff;
+//   backoff.configure(500, 60000);
+//   uint32_t waitMs = backoff.nextDelayMs(esp_random());
+class Backoff
+{
+public:
+  void configure(uint32_t baseMs, uint32_t maxMs)
+  {
+    baseMs_ = baseMs > 0 ? baseMs : 1;
+    maxMs_ = maxMs > baseMs_ ? maxMs : baseMs_;
+    reset();
+  }
+
+  void reset() { attempts_ = 0; }
+  uint32_t attempts() const { return attempts_; }
+
+  // randomValue is any 32 bit random number, ie esp_random(). Passed in so this stays testable off the ESP32.
+  uint32_t nextDelayMs(uint32_t randomValue)
+  {
+    uint32_t ceiling = baseMs_;
+    for (uint32_t i = 0; i < attempts_ && ceiling < maxMs_; i++)
+    {
+      ceiling *= 2;
+    }
+    if (ceiling > maxMs_)
+    {
+      ceiling = maxMs_;
+    }
+    attempts_++;
+
+    uint32_t half = ceiling / 2;
+    return half + (half > 0 ? randomValue % (ceiling - half + 1) : 0);
+  }
+
+private:
+  uint32_t baseMs_ = 500;
+  uint32_t maxMs_ = 60000;
+  uint32_t attempts_ = 0;
+};
+
+#endif // BACKOFF_H
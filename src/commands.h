@@ -0,0 +1,237 @@
+// commands.h
+#ifndef COMMANDS_H
+#define COMMANDS_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Everything you can ask the wheel to do from the outside (dispense, change settings, reset errors / stats, dump its
+//   state) goes through runCommand() in main.cpp, whether it came in as an HTTP form post or on an MQTT command topic,
+//   so both behave exactly the same. The arguments reach it through CommandArgs, which hides where they came from.
+
+enum class CommandStatus
+{
+  OK,
+  BAD_REQUEST, // missing / bad arguments, or settings that don't check out
+  BUSY,        // try again later, ie the dispense queue is full
+  UNKNOWN      // no such command
+};
+
+struct CommandResult
+{
+  CommandStatus status;
+  const char *message; // what went wrong, for showing to the user. NULL when it worked.
+  uint32_t id;         // dispense: the request id, setConfig: the new config version
+};
+
+class CommandArgs
+{
+public:
+  virtual ~CommandArgs() {}
+
+  // Copies the value of `key` into `out` (always null terminated) and returns its full length - if that's >= size it
+  //   got cut short. -1 if there is no such argument.
+  virtual int get(const char *key, char *out, size_t size) const = 0;
+
+  // "true" / "on" / "1" and "false" / "off" / "0". False if the value is something else.
+  static bool parseBool(const char *value, bool &out)
+  {
+    if (strcmp(value, "true") == 0 || strcmp(value, "on") == 0 || strcmp(value, "1") == 0)
+    {
+      out = true;
+      return true;
+    }
+    if (strcmp(value, "false") == 0 || strcmp(value, "off") == 0 || strcmp(value, "0") == 0)
+    {
+      out = false;
+      return true;
+    }
+    return false;
+  }
+};
+
+// Arguments out of a flat JSON object, ie {"id":"a1","distanceThreshold":50,"mqttEnabled":true}. Strings come back
+//   without their quotes and escapes, numbers and true / false / null just as they were written. Nested objects and
+//   arrays aren't supported - valid() is false for those, same as for anything else that isn't a JSON object.
+//
+// Doesn't allocate or copy anything, every get() just walks the text again. Command payloads are tiny.
+class JsonArgs : public CommandArgs
+{
+public:
+  JsonArgs(const char *json, size_t length) : json_(json), length_(length)
+  {
+    valid_ = scan(NULL, NULL, 0, NULL);
+  }
+
+  bool valid() const { return valid_; }
+
+  int get(const char *key, char *out, size_t size) const override
+  {
+    int found = -1;
+    if (valid_)
+    {
+      scan(key, out, size, &found);
+    }
+    return found;
+  }
+
+private:
+  // Walks the whole object, checking the syntax as it goes. If `key` is given, its value is decoded into `out`.
+  bool scan(const char *key, char *out, size_t size, int *found) const
+  {
+    size_t i = 0;
+    skipSpace(i);
+    if (!consume(i, '{'))
+    {
+      return false;
+    }
+    skipSpace(i);
+    if (consume(i, '}'))
+    {
+      return atEnd(i);
+    }
+
+    while (true)
+    {
+      skipSpace(i);
+      size_t keyStart, keyEnd;
+      if (!readString(i, keyStart, keyEnd))
+      {
+        return false;
+      }
+      skipSpace(i);
+      if (!consume(i, ':'))
+      {
+        return false;
+      }
+      skipSpace(i);
+
+      bool isString = i < length_ && json_[i] == '"';
+      size_t valueStart = i, valueEnd;
+      if (isString)
+      {
+        if (!readString(i, valueStart, valueEnd))
+        {
+          return false;
+        }
+      }
+      else
+      {
+        while (i < length_ && json_[i] != ',' && json_[i] != '}' && !isSpace(json_[i]))
+        {
+          if (json_[i] == '{' || json_[i] == '[' || json_[i] == '"')
+          {
+            return false;
+          }
+          i++;
+        }
+        valueEnd = i;
+        if (valueEnd == valueStart)
+        {
+          return false;
+        }
+      }
+
+      if (key != NULL && *found < 0 && keyEnd - keyStart == strlen(key) && strncmp(json_ + keyStart, key, keyEnd - keyStart) == 0)
+      {
+        *found = decode(valueStart, valueEnd, isString, out, size);
+      }
+
+      skipSpace(i);
+      if (consume(i, ','))
+      {
+        continue;
+      }
+      if (consume(i, '}'))
+      {
+        return atEnd(i);
+      }
+      return false;
+    }
+  }
+
+  // i is on the opening quote. Leaves it just past the closing one, with start / end around what's in between.
+  bool readString(size_t &i, size_t &start, size_t &end) const
+  {
+    if (!consume(i, '"'))
+    {
+      return false;
+    }
+    start = i;
+    while (i < length_ && json_[i] != '"')
+    {
+      i += json_[i] == '\\' ? 2 : 1;
+    }
+    if (i >= length_)
+    {
+      return false;
+    }
+    end = i;
+    i++;
+    return true;
+  }
+
+  int decode(size_t start, size_t end, bool isString, char *out, size_t size) const
+  {
+    size_t length = 0;
+    for (size_t i = start; i < end; i++)
+    {
+      char c = json_[i];
+      if (isString && c == '\\' && i + 1 < end)
+      {
+        c = json_[++i];
+        switch (c)
+        {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'u':
+          c = '?'; // not worth a utf-8 encoder for settings that are plain ascii anyway
+          i = i + 4 < end ? i + 4 : end - 1;
+          break;
+        }
+      }
+      if (length + 1 < size)
+      {
+        out[length] = c;
+      }
+      length++;
+    }
+    if (size > 0)
+    {
+      out[length < size ? length : size - 1] = '\0';
+    }
+    return (int)length;
+  }
+
+  static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+  void skipSpace(size_t &i) const
+  {
+    while (i < length_ && isSpace(json_[i]))
+    {
+      i++;
+    }
+  }
+  bool consume(size_t &i, char c) const
+  {
+    if (i < length_ && json_[i] == c)
+    {
+      i++;
+      return true;
+    }
+    return false;
+  }
+  bool atEnd(size_t i) const
+  {
+    skipSpace(i);
+    return i == length_;
+  }
+
+  const char *json_;
+  size_t length_;
+  bool valid_;
+};
+
+#endif // COMMANDS_H
@@ -0,0 +1,186 @@
+// dispenseProfile.h
+#ifndef DISPENSEPROFILE_H
+#define DISPENSEPROFILE_H
+#include <stdint.h>
+
+// How fast the dispenser (dispenser.h) runs the motor, learned from how far it has had to turn for the last treats to
+//   come out. Full speed while a treat is nowhere near, slowing down over the stretch where one usually shows up so
+//   it stops closer to the beam and is less likely to push a second one out behind it, and back to full speed if the
+//   treat is late. If nothing comes out for a good while longer than usual the motor gives short reverse pulses to
+//   shake a jam loose, well before the 30 second give up.
+//
+// Distance is measured as "travel": milliseconds of motor time at full speed, so a slow stretch counts for less and a
+//   reverse pulse winds it back. Learning is the same smoothing TCP does for round trip times - an average and an
+//   average deviation, each moving a fraction of the way to every new sample - and only from dispenses that went
+//   through without a reverse pulse.
+//
+// Slowing down on its own makes a dispense ~4% longer (3.89s vs 3.74s at full speed the whole way, 16 sim runs of 48h)
+//   for ~40% fewer doubles. The motor's head start on the LED warm up and the shorter settle after stopping from slow
+//   (dispenser.h) more than win that back: 3.40s a dispense, with the same ~40% fewer doubles.
+//
+//   travel:  0 ...... expected - dev ..ramp.. [half speed] ...... expected + dev ...... full again
+//   time:    0 ...... jam at (expected + 4 dev, at least 6s) -> reverse pulse every 4s until the treat or the give up
+//
+// It also remembers the shortest travel any treat has needed, so the motor can start before the sensor LEDs have
+//   finished warming up without a treat getting to the beam before it's ready (motorStartMs()).
+//
+// The learned part is the DispenseProfileState, which main.cpp saves to NVS every few dispenses and hands back on boot.
+
+struct DispenseProfileState
+{
+  uint16_t version;
+  uint16_t earliestMs;  // shortest travel from motor start to a treat so far, 0 until the first one
+  uint32_t learned;     // dispenses learned from, it stays at full speed until there are MIN_LEARNED of them
+  uint32_t expectedMs;  // smoothed travel from motor start to the treat
+  uint32_t deviationMs; // smoothed deviation from that
+};
+
+// Since boot, for the API
+struct DispenseProfileStats
+{
+  uint32_t cycles;         // dispenses finished, however they went
+  uint32_t treats;         // of those, the ones that saw a treat
+  uint32_t averageCycleMs; // start to back to idle, LED warm up and settling included
+  uint32_t jamPulses;      // reverse pulses given
+  uint32_t jamsCleared;    // treats that came out after a reverse pulse
+  uint32_t lateTreats;     // settles where the beam broke again after the first treat's bounce, most likely a second treat
+};
+
+class DispenseProfile
+{
+public:
+  static const uint16_t VERSION = 2; // 1 had no earliestMs
+  static const int STOP_US = 1500;
+  static const int FULL_US = 1500 + 500;
+  static const int SLOW_US = 1500 + 250;
+  static const int REVERSE_US = 1500 - 400;
+  static const uint32_t MIN_LEARNED = 5;
+  static const uint32_t RAMP_MS = 250;        // travel it takes to go from full to slow
+  static const int RAMP_STEP_US = 25;         // in steps this big, rather than a new speed every loop
+  static const uint32_t MAX_SLOW_MS = 600;    // longest stretch of travel it'll spend slowed down
+  static const uint32_t JAM_MIN_MS = 6000;    // never reverse sooner than this into a dispense
+  static const uint32_t JAM_RETRY_MS = 4000;
+  static const uint32_t REVERSE_MS = 250;
+
+  DispenseProfile()
+  {
+    state_.version = VERSION;
+  }
+
+  // A saved profile, from NVS. Anything from a different version is ignored and it starts learning again.
+  bool restore(const DispenseProfileState &state)
+  {
+    if (state.version != VERSION || state.expectedMs == 0)
+    {
+      return false;
+    }
+    state_ = state;
+    return true;
+  }
+
+  const DispenseProfileState &state() const { return state_; }
+  const DispenseProfileStats &stats() const { return stats_; }
+
+  // Motor command for this point in a dispense, travelMs along after runMs of running
+  int motorUs(uint32_t travelMs, uint32_t runMs) const
+  {
+    uint32_t jamAtMs = jamAfterMs();
+    if (runMs >= jamAtMs)
+    {
+      return (runMs - jamAtMs) % JAM_RETRY_MS < REVERSE_MS ? REVERSE_US : FULL_US;
+    }
+    if (state_.learned < MIN_LEARNED)
+    {
+      return FULL_US;
+    }
+
+    uint32_t slowFromMs = state_.expectedMs > state_.deviationMs ? state_.expectedMs - state_.deviationMs : 0;
+    uint32_t slowUntilMs = state_.expectedMs + state_.deviationMs;
+    if (slowUntilMs - slowFromMs > MAX_SLOW_MS)
+    {
+      slowUntilMs = slowFromMs + MAX_SLOW_MS;
+    }
+    uint32_t rampFromMs = slowFromMs > RAMP_MS ? slowFromMs - RAMP_MS : 0;
+
+    if (travelMs < rampFromMs || travelMs >= slowUntilMs)
+    {
+      return FULL_US;
+    }
+    if (travelMs >= slowFromMs)
+    {
+      return SLOW_US;
+    }
+    int slowerBy = (int)((FULL_US - SLOW_US) * (travelMs - rampFromMs) / (slowFromMs - rampFromMs));
+    return FULL_US - slowerBy / RAMP_STEP_US * RAMP_STEP_US;
+  }
+
+  // How long after the LEDs go on the motor can start. The beam can't be trusted until the LEDs have warmed up, but no
+  //   treat gets to it before the wheel has turned at least earliestMs of travel, which takes at least that long at
+  //   any speed - so the motor gets a head start of half that.
+  uint32_t motorStartMs(uint32_t warmupMs) const
+  {
+    if (state_.learned < MIN_LEARNED)
+    {
+      return warmupMs;
+    }
+    uint32_t headStartMs = state_.earliestMs / 2;
+    return headStartMs < warmupMs ? warmupMs - headStartMs : 0;
+  }
+
+  // How long into a dispense a missing treat counts as a jam
+  uint32_t jamAfterMs() const
+  {
+    if (state_.learned < MIN_LEARNED)
+    {
+      return JAM_MIN_MS;
+    }
+    uint32_t jamAtMs = state_.expectedMs + 4 * state_.deviationMs;
+    return jamAtMs > JAM_MIN_MS ? jamAtMs : JAM_MIN_MS;
+  }
+
+  // A treat came out after travelMs. reversed: a reverse pulse went out first, so the travel doesn't say much.
+  void learn(uint32_t travelMs, bool reversed)
+  {
+    if (reversed)
+    {
+      stats_.jamsCleared++;
+      return;
+    }
+    if (state_.learned == 0 || state_.expectedMs == 0)
+    {
+      state_.expectedMs = travelMs > 0 ? travelMs : 1;
+      state_.deviationMs = travelMs / 2;
+    }
+    else
+    {
+      int32_t error = (int32_t)travelMs - (int32_t)state_.expectedMs;
+      uint32_t deviation = error < 0 ? -error : error;
+      state_.deviationMs = (int32_t)state_.deviationMs + ((int32_t)deviation - (int32_t)state_.deviationMs) / 4;
+      int32_t expected = (int32_t)state_.expectedMs + error / 8;
+      state_.expectedMs = expected > 0 ? expected : 1;
+    }
+    if (state_.earliestMs == 0 || travelMs < state_.earliestMs)
+    {
+      state_.earliestMs = travelMs == 0 ? 1 : travelMs > UINT16_MAX ? UINT16_MAX : travelMs;
+    }
+    state_.learned++;
+  }
+
+  void jamPulse() { stats_.jamPulses++; }
+  void lateTreat() { stats_.lateTreats++; }
+
+  void finished(bool dispensed, uint32_t cycleMs)
+  {
+    stats_.cycles++;
+    stats_.treats += dispensed;
+    cycleMsTotal_ += cycleMs;
+    stats_.averageCycleMs = (uint32_t)(cycleMsTotal_ / stats_.cycles);
+  }
+
+private:
+  DispenseProfileState state_ = {};
+  DispenseProfileStats stats_ = {};
+  uint64_t cycleMsTotal_ = 0;
+};
+
+#endif // DISPENSEPROFILE_H
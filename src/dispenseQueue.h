@@ -0,0 +1,193 @@
+// dispenseQueue.h
+#ifndef DISPENSEQUEUE_H
+#define DISPENSEQUEUE_H
+#include <stdint.h>
+
+// Dispense requests from the web UI, MQTT and the distance threshold all end up here. Requests are handed to mainTask
+//   through a FreeRTOS queue (so the web / mqtt tasks never wait on the motor), and mainTask works through them one
+//   treat at a time with the DispenseScheduler below. Every request gets exactly one DispenseCompletion back, even if
+//   it was merged into another one or thrown away, so whoever asked can always find out what happened.
+
+enum class DispenseSource : uint8_t
+{
+  WEB,
+  MQTT,
+  DISTANCE
+};
+
+enum class DispenseStatus : uint8_t
+{
+  DONE,      // all requested treats came out
+  FAILED,    // gave up part way, we ran out of treats
+  COALESCED, // duplicate of a request that was already waiting, see mergedInto
+  REJECTED   // too many requests waiting, or more treats than one request may ask for. Nothing was done.
+};
+
+struct DispenseRequest
+{
+  uint32_t id;
+  DispenseSource source;
+  uint8_t count;
+  uint32_t receivedMs;
+};
+
+struct DispenseCompletion
+{
+  uint32_t id;
+  DispenseSource source;
+  DispenseStatus status;
+  uint8_t requested;
+  uint8_t dispensed;
+  uint32_t mergedInto; // id of the request this one was folded into when COALESCED, otherwise 0
+};
+
+inline const char *dispenseSourceName(DispenseSource source)
+{
+  switch (source)
+  {
+  case DispenseSource::WEB:
+    return "web";
+  case DispenseSource::MQTT:
+    return "mqtt";
+  case DispenseSource::DISTANCE:
+    return "distance";
+  }
+  return "unknown";
+}
+
+inline const char *dispenseStatusName(DispenseStatus status)
+{
+  switch (status)
+  {
+  case DispenseStatus::DONE:
+    return "done";
+  case DispenseStatus::FAILED:
+    return "failed";
+  case DispenseStatus::COALESCED:
+    return "coalesced";
+  case DispenseStatus::REJECTED:
+    return "rejected";
+  }
+  return "unknown";
+}
+
+enum class DispenseSubmit
+{
+  QUEUED,
+  COALESCED,
+  REJECTED
+};
+
+// Pending requests, oldest first. The oldest one is the one being dispensed.
+//   coalesceWindowMs: a request from the same source within this long of one that is still waiting is treated as a
+//                     duplicate (home automation double-firing) and merged into it. 0 turns coalescing off.
+//   minIntervalMs:    minimum time between starting two dispenses, so a burst can't empty the hopper in one go.
+//   maxCountPerRequest: bigger counts are REJECTED, rather than quietly giving fewer treats than were asked for.
+class DispenseScheduler
+{
+public:
+  static const int MAX_PENDING = 16;
+
+  void configure(uint32_t coalesceWindowMs, uint32_t minIntervalMs, uint8_t maxCountPerRequest)
+  {
+    coalesceWindowMs_ = coalesceWindowMs;
+    minIntervalMs_ = minIntervalMs;
+    maxCountPerRequest_ = maxCountPerRequest > 0 ? maxCountPerRequest : 1;
+  }
+
+  // If this returns COALESCED or REJECTED the request is already finished and `completion` says how.
+  DispenseSubmit submit(const DispenseRequest &request, DispenseCompletion &completion)
+  {
+    completion = {request.id, request.source, DispenseStatus::REJECTED, request.count, 0, 0};
+
+    if (coalesceWindowMs_ > 0)
+    {
+      for (int i = pendingCount_ - 1; i >= 0; i--)
+      {
+        const Entry &entry = pending_[(head_ + i) % MAX_PENDING];
+        if (entry.request.source == request.source && request.receivedMs - entry.request.receivedMs <= coalesceWindowMs_)
+        {
+          completion.status = DispenseStatus::COALESCED;
+          completion.mergedInto = entry.request.id;
+          return DispenseSubmit::COALESCED;
+        }
+      }
+    }
+
+    if (pendingCount_ >= MAX_PENDING || request.count > maxCountPerRequest_)
+    {
+      return DispenseSubmit::REJECTED;
+    }
+
+    Entry &entry = pending_[(head_ + pendingCount_) % MAX_PENDING];
+    entry.request = request;
+    if (entry.request.count == 0)
+    {
+      entry.request.count = 1;
+    }
+    entry.dispensed = 0;
+    pendingCount_++;
+    return DispenseSubmit::QUEUED;
+  }
+
+  int pendingRequests() const { return pendingCount_; }
+
+  // Is there a treat owed, and has it been long enough since the last one started?
+  bool readyToStart(uint32_t nowMs) const
+  {
+    if (pendingCount_ == 0)
+    {
+      return false;
+    }
+    return !anyStarted_ || nowMs - lastStartMs_ >= minIntervalMs_;
+  }
+
+  void markStarted(uint32_t nowMs)
+  {
+    anyStarted_ = true;
+    lastStartMs_ = nowMs;
+  }
+
+  // Call once per finished treat. Returns true (and fills in completion) when the oldest request is done with.
+  bool finishTreat(bool dispensed, DispenseCompletion &completion)
+  {
+    if (pendingCount_ == 0)
+    {
+      return false;
+    }
+
+    Entry &entry = pending_[head_];
+    if (dispensed)
+    {
+      entry.dispensed++;
+      if (entry.dispensed < entry.request.count)
+      {
+        return false;
+      }
+    }
+
+    completion = {entry.request.id, entry.request.source, dispensed ? DispenseStatus::DONE : DispenseStatus::FAILED, entry.request.count, entry.dispensed, 0};
+    head_ = (head_ + 1) % MAX_PENDING;
+    pendingCount_--;
+    return true;
+  }
+
+private:
+  struct Entry
+  {
+    DispenseRequest request;
+    uint8_t dispensed;
+  };
+
+  Entry pending_[MAX_PENDING] = {};
+  int head_ = 0;
+  int pendingCount_ = 0;
+
+  uint32_t coalesceWindowMs_ = 0;
+  uint32_t minIntervalMs_ = 0;
+  uint8_t maxCountPerRequest_ = 1;
+  bool anyStarted_ = false;
+  uint32_t lastStartMs_ = 0;
+};
+
+#endif // DISPENSEQUEUE_H
@@ -0,0 +1,251 @@
+// dispenser.h
+#ifndef DISPENSER_H
+#define DISPENSER_H
+#include <stdint.h>
+#include "dispenseProfile.h"
+
+// Non-blocking treat dispenser. mainTask calls update() every loop alongside the odometry, so the wheel keeps being
+//   counted while a treat is on its way out. The photodiode ISRs only notify mainTask, which then passes them on here.
+//   There are no Arduino dependencies in here, all hardware access goes through the DispenserIO callbacks.
+//
+//   IDLE -> LED_WARMUP -> MOTOR_RUN -> SETTLING -> IDLE
+//                              |  treat detected (DISPENSED) or nothing for 30s (TIMED_OUT)
+//
+// Once the profile knows how soon a treat can turn up, the motor starts part way through the LED warm up
+//   (DispenseProfile::motorStartMs()). The beams are still ignored until the full LED_WARMUP_MS is up. How long it
+//   settles goes down with the speed the motor was stopped from, since it coasts on for less.
+//
+// How fast the motor turns during MOTOR_RUN, and the reverse pulses when a treat is stuck, come from the learned
+//   DispenseProfile (dispenseProfile.h).
+//
+// The hopper photodiode is watched while the motor runs. If no treat passes it for 5s of accumulated motor time the
+//   hopper is flagged as empty. That time carries over between dispenses (ie, nothing detected for 4 of 5 seconds,
+//   treat leaves main body, next dispense should detect hopper empty after 1 more second).
+
+enum class DispenseState
+{
+  IDLE,
+  LED_WARMUP, // light break LEDs on, waiting for the sensors to read high (or for the motor's head start)
+  MOTOR_RUN,  // motor turning, waiting for a treat to break the dispense beam
+  SETTLING    // motor stopped, ignoring the sensors for a moment before the LEDs go off
+};
+
+enum class DispenseResult
+{
+  NONE,      // nothing finished this update
+  DISPENSED, // a treat broke the dispense beam
+  TIMED_OUT  // gave up after 30s without seeing a treat, we're fully out of treats
+};
+
+struct DispenserIO
+{
+  void (*setSensorLeds)(bool on);
+  void (*setMotor)(int microseconds);
+};
+
+class TreatDispenser
+{
+public:
+  static const uint32_t LED_WARMUP_MS = 700;
+  static const uint32_t SETTLE_MS = 200;      // after stopping from full speed
+  static const uint32_t SETTLE_MIN_MS = 100;  // however slow it was going
+  static const uint32_t LATE_TREAT_MIN_MS = 20; // a treat tumbling through the beam can break it again this soon after
+  static const uint32_t HOPPER_EMPTY_MS = 5000;
+  static const uint32_t GIVE_UP_MS = 30000;
+  static const int MOTOR_STOP_US = DispenseProfile::STOP_US;
+
+  void begin(const DispenserIO &io)
+  {
+    io_ = io;
+  }
+
+  bool busy() const { return state_ != DispenseState::IDLE; }
+  DispenseState state() const { return state_; }
+  bool hopperEmpty() const { return hopperEmpty_; }
+  // A dispense beam break now would be taken as the treat - the motor is running and the LEDs have warmed up
+  bool watchingBeam(uint32_t nowMs) const { return state_ == DispenseState::MOTOR_RUN && sensorsReady(nowMs); }
+  DispenseProfile &profile() { return profile_; }
+  const DispenseProfile &profile() const { return profile_; }
+
+  // Kick off a dispense. Returns false if one is already in progress.
+  bool start(uint32_t nowMs)
+  {
+    if (busy())
+    {
+      return false;
+    }
+    io_.setSensorLeds(true);
+    cycleStartMs_ = nowMs;
+    enter(DispenseState::LED_WARMUP, nowMs);
+    return true;
+  }
+
+  // The dispense beam was broken. Only counts while the motor is running and the LEDs have warmed up - the LEDs turning
+  //   on and off make noise too.
+  void onTreatDetected(uint32_t nowMs)
+  {
+    // Another break while settling is most likely a second treat, but only once it's clear of the first one's bounce,
+    //   and a second treat that bounces is still just the one
+    if (state_ == DispenseState::SETTLING && pendingResult_ == DispenseResult::DISPENSED && !lateTreatSeen_ &&
+        nowMs - stateStartMs_ >= LATE_TREAT_MIN_MS)
+    {
+      lateTreatSeen_ = true;
+      profile_.lateTreat();
+    }
+    if (state_ != DispenseState::MOTOR_RUN || !sensorsReady(nowMs))
+    {
+      return;
+    }
+    accumulateHopperTime(nowMs);
+    accumulateTravel(nowMs);
+    settleMs_ = SETTLE_MS * (motorUs_ - MOTOR_STOP_US) / (DispenseProfile::FULL_US - MOTOR_STOP_US);
+    settleMs_ = settleMs_ > SETTLE_MIN_MS ? settleMs_ : SETTLE_MIN_MS;
+    drive(MOTOR_STOP_US);
+    profile_.learn(travelMs(), reversed_);
+    pendingResult_ = DispenseResult::DISPENSED;
+    lateTreatSeen_ = false;
+    enter(DispenseState::SETTLING, nowMs);
+  }
+
+  // The hopper beam was broken, so there are still treats up there
+  void onHopperTreat(uint32_t nowMs)
+  {
+    if (state_ != DispenseState::MOTOR_RUN || !sensorsReady(nowMs))
+    {
+      return;
+    }
+    hopperTimeWithoutTreatMs_ = 0;
+    hopperEmpty_ = false;
+    lastHopperCheckMs_ = nowMs;
+  }
+
+  // Forget about the hopper being empty, ie the user refilled it and reset the error states
+  void clearHopperEmpty()
+  {
+    hopperTimeWithoutTreatMs_ = 0;
+    hopperEmpty_ = false;
+  }
+
+  // Advance the state machine. Returns the outcome once, on the update where a dispense cycle finishes.
+  DispenseResult update(uint32_t nowMs)
+  {
+    switch (state_)
+    {
+    case DispenseState::IDLE:
+      break;
+
+    case DispenseState::LED_WARMUP:
+      if (nowMs - stateStartMs_ >= profile_.motorStartMs(LED_WARMUP_MS))
+      {
+        travelUnits_ = 0;
+        reversed_ = false;
+        lastTravelMs_ = nowMs;
+        drive(profile_.motorUs(0, 0));
+        lastHopperCheckMs_ = nowMs;
+        enter(DispenseState::MOTOR_RUN, nowMs);
+      }
+      break;
+
+    case DispenseState::MOTOR_RUN:
+      accumulateHopperTime(nowMs);
+      accumulateTravel(nowMs);
+      if (nowMs - stateStartMs_ > GIVE_UP_MS)
+      {
+        drive(MOTOR_STOP_US);
+        settleMs_ = SETTLE_MS;
+        pendingResult_ = DispenseResult::TIMED_OUT;
+        enter(DispenseState::SETTLING, nowMs);
+      }
+      else
+      {
+        int motorUs = profile_.motorUs(travelMs(), nowMs - stateStartMs_);
+        if (motorUs < MOTOR_STOP_US && motorUs_ >= MOTOR_STOP_US)
+        {
+          reversed_ = true;
+          profile_.jamPulse();
+        }
+        drive(motorUs);
+      }
+      break;
+
+    case DispenseState::SETTLING:
+      if (nowMs - stateStartMs_ >= settleMs_)
+      {
+        io_.setSensorLeds(false);
+        enter(DispenseState::IDLE, nowMs);
+        DispenseResult result = pendingResult_;
+        pendingResult_ = DispenseResult::NONE;
+        profile_.finished(result == DispenseResult::DISPENSED, nowMs - cycleStartMs_);
+        return result;
+      }
+      break;
+    }
+    return DispenseResult::NONE;
+  }
+
+private:
+  void enter(DispenseState state, uint32_t nowMs)
+  {
+    state_ = state;
+    stateStartMs_ = nowMs;
+  }
+
+  // Only tells the motor when the speed actually changes
+  void drive(int motorUs)
+  {
+    if (motorUs != motorUs_)
+    {
+      motorUs_ = motorUs;
+      io_.setMotor(motorUs);
+    }
+  }
+
+  // Travel is motor time weighted by speed, full speed forwards = 1 (see dispenseProfile.h)
+  void accumulateTravel(uint32_t nowMs)
+  {
+    travelUnits_ += (int32_t)(motorUs_ - MOTOR_STOP_US) * (int32_t)(nowMs - lastTravelMs_);
+    if (travelUnits_ < 0)
+    {
+      travelUnits_ = 0;
+    }
+    lastTravelMs_ = nowMs;
+  }
+
+  bool sensorsReady(uint32_t nowMs) const { return nowMs - cycleStartMs_ >= LED_WARMUP_MS; }
+
+  uint32_t travelMs() const { return travelUnits_ / (DispenseProfile::FULL_US - MOTOR_STOP_US); }
+
+  // Only once the hopper beam can be trusted, the motor's head start doesn't count towards the hopper being empty
+  void accumulateHopperTime(uint32_t nowMs)
+  {
+    if (!sensorsReady(nowMs))
+    {
+      lastHopperCheckMs_ = nowMs;
+      return;
+    }
+    hopperTimeWithoutTreatMs_ += nowMs - lastHopperCheckMs_;
+    lastHopperCheckMs_ = nowMs;
+    if (hopperTimeWithoutTreatMs_ > HOPPER_EMPTY_MS)
+    {
+      hopperEmpty_ = true;
+    }
+  }
+
+  DispenserIO io_ = {};
+  DispenseProfile profile_;
+  DispenseState state_ = DispenseState::IDLE;
+  DispenseResult pendingResult_ = DispenseResult::NONE;
+  uint32_t stateStartMs_ = 0;
+  bool lateTreatSeen_ = false; // this settle already counted one
+  uint32_t settleMs_ = SETTLE_MS;
+  uint32_t lastHopperCheckMs_ = 0;
+  uint32_t hopperTimeWithoutTreatMs_ = 0;
+  bool hopperEmpty_ = false;
+  uint32_t cycleStartMs_ = 0;
+  int motorUs_ = MOTOR_STOP_US; // what the motor was last told
+  int32_t travelUnits_ = 0;     // (us above stop) x ms, this dispense
+  uint32_t lastTravelMs_ = 0;
+  bool reversed_ = false;       // a reverse pulse went out this dispense
+};
+
+#endif // DISPENSER_H
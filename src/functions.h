@@ -1,6 +1,20 @@
 // functions.h
 #ifndef FUNCTIONS_H
 #define FUNCTIONS_H
+#include "dispenseQueue.h"
+#include "appConfig.h"
+#include "mqttOutbox.h"
+#include "commands.h"
+#include "webAssets.h"
+
+struct TelemetryState;
+struct TelemetrySnapshot;
+struct TraceRecord;
+class JsonWriter;
+class LatencyHistogram;
+struct StaticIpConfig;
+enum class NetworkState;
+enum class WifiEventType : uint8_t;
 
 void wifiManagerTask(void *pvParameters);
 void mqttServerTask(void *pvParameters);
@@ -8,21 +22,81 @@ void mainTask(void *pvParameters);
 void webServerTask(void *pvParameters);
 String URLDecode(String input);
 void startAPMode();
-void connectToWiFi();
-void saveConfig();
+void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+void postWifiEvent(WifiEventType type);
+void setNetworkState(NetworkState state);
+void startWifiScan();
+void finishWifiScan();
+void buildWifiScanJson(int numNetworks, char *buffer, size_t size);
+void connectToWiFi(bool directed);
+void saveNetworkCache();
+void clearNetworkCache();
+bool parseStaticIp(AsyncWebServerRequest *request, StaticIpConfig &out);
+void saveConfig(const AppConfig &before, const AppConfig &after, bool everything);
+void loadConfig();
 void clearConfig();
 void handleWebClientMainMode(WiFiClient &client, const String &request);
 void handleWebClientAPConfig(WiFiClient &client, const String &request);
 String getFormValue(String request, String key);
 void setupWebServerRoutes(AsyncWebServer &server);
+size_t buildStatusJson(char *buffer, size_t size);
+void writeStatusFields(JsonWriter &json);
+void writePerfFields(JsonWriter &json);
+void writeLatencyFields(JsonWriter &json, const char *key, const LatencyHistogram &histogram);
+CommandResult runCommand(const char *name, const CommandArgs &args, DispenseSource from, JsonWriter &result);
+const char *applyConfigArgs(const CommandArgs &args, AppConfig &config);
+void mqttHandleCommand(const char *name, const byte *payload, unsigned int length);
+void readTelemetryState(TelemetryState &state);
+size_t buildTelemetryDeltaJson(const TelemetryState &previous, const TelemetryState &current, char *buffer, size_t size);
+size_t buildDispenseCompletionJson(const DispenseCompletion &completion, char *buffer, size_t size);
+size_t buildMqttStateJson(const TelemetrySnapshot &snapshot, char *buffer, size_t size);
+const WebAsset *findWebAsset(const char *path);
+void sendWebAsset(AsyncWebServerRequest *request, const WebAsset &asset);
 void streamFromProgmem(WiFiClient &client, const char* pgmContent, ...);
-void mqttPublishUsageStats();
-void mqttReconnect();
+void mqttPublishUsageStats(const AppConfig &conf);
+void mqttPublishPerFieldStats(const TelemetrySnapshot &snapshot);
+bool mqttReconnect(const AppConfig &conf);
+void mqttWaitForSocket(uint32_t timeoutMs);
+void mqttWaitForNotify(uint32_t timeoutMs);
+void publishMqttStatus();
+void notifyMqttTask();
 void saveStatisticsTask(void* pvParameters);
+void loadStatistics();
+void restoreRtcCounters();
+void loadDispenseProfile();
+void publishTelemetrySnapshot();
+void startTrace(int64_t nowUs);
+bool pushTraceRecord(const TraceRecord &record);
+void traceTask(void *pvParameters);
+bool statsJournalRead(uint32_t offset, void *buffer, size_t length);
+bool statsJournalWrite(uint32_t offset, const void *buffer, size_t length);
+bool statsJournalErase(uint32_t offset);
 void mqttCallback(char *topic, byte *payload, unsigned int length);
 void setInitialConfig();
 void saveWifi();
-void dispenseTreat();
+void setDispenserSensorLeds(bool on);
+void setDispenserMotor(int microseconds);
+void motorStopTask(void *pvParameters);
+int64_t beamTimeUs(const std::atomic<uint32_t> &stamp, int64_t nowUs);
+void setErrorLed(bool on);
+bool takeDispenseRequest(DispenseRequest &request);
+void logLine(const char *message);
+uint32_t requestDispense(DispenseSource source, uint8_t count);
+void reportDispenseCompletion(const DispenseCompletion &completion);
+bool findDispenseCompletion(uint32_t id, DispenseCompletion &completion);
+void mqttPublishDispenseCompletion(const AppConfig &conf, const DispenseCompletion &completion);
+void recordOutboxEvent(OutboxEventType type, uint32_t value0, uint32_t value1, uint32_t value2);
+void mqttPublishOutbox();
+void mqttPublishDiscovery();
+void mqttDisconnect();
+uint32_t unixTimeNow();
+size_t buildOutboxEventJson(const OutboxEvent &event, char *buffer, size_t size);
+bool outboxSpillBegin();
+bool outboxSpillAppend(const OutboxEvent *events, uint32_t count);
+bool outboxSpillRead(uint32_t index, OutboxEvent &event);
+void outboxSpillDrop(uint32_t count);
+uint32_t outboxSpillCount();
+void outboxSpillCompact();
 void clearWifi();
 
 #endif // FUNCTIONS_H
@@ -0,0 +1,43 @@
+// hal.h
+#ifndef HAL_H
+#define HAL_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin hardware layer under the wheel logic, so the same code runs on the ESP32 (halEsp32.cpp) and on a Linux host in
+//   simulated time (halPosix.cpp, used by the native build in sim/). Only what the shared logic actually needs is in
+//   here - the wifi manager, web server and mqtt client are ESP32 only and keep talking to their libraries directly.
+
+// Clock. On the host this only moves when the simulation moves it (see halPosix.h).
+uint32_t halMillis();
+int64_t halMicros();
+
+// GPIO. Inputs are always pulled up, the sensors on the wheel all pull low when they trigger.
+void halPinOutput(int pin);
+void halPinInput(int pin);
+void halDigitalWrite(int pin, bool high);
+bool halDigitalRead(int pin);
+
+// The dispenser's continuous rotation servo. 1500us is stop, further away from it is faster.
+void halServoAttach(int pin, int minUs, int maxUs);
+void halServoWrite(int microseconds);
+
+// Pulse counter (the ESP32's PCNT). Counts falling edges on `pin` in a 16 bit counter that goes back to zero when it
+//   reaches highLimit and calls onHighLimit when it does - from an interrupt on the ESP32. Pulses shorter than
+//   glitchFilterCycles of the 80MHz APB clock are ignored, 0 turns the filter off.
+void halPulseCounterBegin(int pin, int16_t highLimit, uint16_t glitchFilterCycles, void (*onHighLimit)());
+int16_t halPulseCounterRead();
+
+// Non-volatile storage (Preferences on the ESP32, so the existing keys keep working). Read returns false if the key
+//   isn't there, or for blobs if the stored size doesn't match `length`.
+bool halNvsReadInt(const char *space, const char *key, int32_t &value);
+bool halNvsWriteInt(const char *space, const char *key, int32_t value);
+bool halNvsReadBlob(const char *space, const char *key, void *data, size_t length);
+bool halNvsWriteBlob(const char *space, const char *key, const void *data, size_t length);
+void halNvsErase(const char *space, const char *key);
+
+// Network. Connected means we have an ip and could reach the broker, the simulation uses it to fake outages.
+bool halNetworkConnected();
+uint32_t halRandom();
+
+#endif // HAL_H
@@ -0,0 +1,175 @@
+// ESP32 side of hal.h. The native build leaves this file out and uses halPosix.cpp instead.
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESP32Servo.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <driver/pcnt.h>
+#include "hal.h"
+
+static const pcnt_unit_t PULSE_COUNTER_UNIT = PCNT_UNIT_0;
+
+static Servo servo;
+static Preferences nvs; // our own handle, so this never gets in the way of the one main.cpp has open
+static void (*pulseCounterOnHighLimit)() = NULL;
+
+uint32_t halMillis()
+{
+  return millis();
+}
+
+int64_t halMicros()
+{
+  return esp_timer_get_time();
+}
+
+void halPinOutput(int pin)
+{
+  pinMode(pin, OUTPUT);
+}
+
+void halPinInput(int pin)
+{
+  pinMode(pin, INPUT_PULLUP);
+}
+
+void halDigitalWrite(int pin, bool high)
+{
+  digitalWrite(pin, high ? HIGH : LOW);
+}
+
+bool halDigitalRead(int pin)
+{
+  return digitalRead(pin) == HIGH;
+}
+
+void halServoAttach(int pin, int minUs, int maxUs)
+{
+  servo.setPeriodHertz(50); // Standard 50Hz servo
+  servo.attach(pin, minUs, maxUs);
+}
+
+void halServoWrite(int microseconds)
+{
+  servo.writeMicroseconds(microseconds);
+}
+
+static void IRAM_ATTR handlePulseCounterISR(void *arg)
+{
+  pulseCounterOnHighLimit();
+}
+
+void halPulseCounterBegin(int pin, int16_t highLimit, uint16_t glitchFilterCycles, void (*onHighLimit)())
+{
+  pulseCounterOnHighLimit = onHighLimit;
+
+  pcnt_config_t pcntConfig = {};
+  pcntConfig.pulse_gpio_num = pin;
+  pcntConfig.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  pcntConfig.lctrl_mode = PCNT_MODE_KEEP;
+  pcntConfig.hctrl_mode = PCNT_MODE_KEEP;
+  pcntConfig.pos_mode = PCNT_COUNT_DIS;
+  pcntConfig.neg_mode = PCNT_COUNT_INC;
+  pcntConfig.counter_h_lim = highLimit;
+  pcntConfig.counter_l_lim = 0;
+  pcntConfig.unit = PULSE_COUNTER_UNIT;
+  pcntConfig.channel = PCNT_CHANNEL_0;
+  pcnt_unit_config(&pcntConfig);
+
+  if (glitchFilterCycles > 0)
+  {
+    pcnt_set_filter_value(PULSE_COUNTER_UNIT, glitchFilterCycles);
+    pcnt_filter_enable(PULSE_COUNTER_UNIT);
+  }
+  else
+  {
+    pcnt_filter_disable(PULSE_COUNTER_UNIT);
+  }
+
+  pcnt_event_enable(PULSE_COUNTER_UNIT, PCNT_EVT_H_LIM);
+  pcnt_counter_pause(PULSE_COUNTER_UNIT);
+  pcnt_counter_clear(PULSE_COUNTER_UNIT);
+
+  pcnt_isr_service_install(0);
+  pcnt_isr_handler_add(PULSE_COUNTER_UNIT, handlePulseCounterISR, NULL);
+
+  pcnt_counter_resume(PULSE_COUNTER_UNIT);
+  Serial.println("[odometry] - pulse counter started");
+}
+
+int16_t halPulseCounterRead()
+{
+  int16_t count = 0;
+  pcnt_get_counter_value(PULSE_COUNTER_UNIT, &count);
+  return count;
+}
+
+bool halNvsReadInt(const char *space, const char *key, int32_t &value)
+{
+  if (!nvs.begin(space, true))
+  {
+    return false;
+  }
+  bool found = nvs.isKey(key);
+  if (found)
+  {
+    value = nvs.getInt(key);
+  }
+  nvs.end();
+  return found;
+}
+
+bool halNvsWriteInt(const char *space, const char *key, int32_t value)
+{
+  if (!nvs.begin(space, false))
+  {
+    return false;
+  }
+  bool written = nvs.putInt(key, value) == sizeof(value);
+  nvs.end();
+  return written;
+}
+
+bool halNvsReadBlob(const char *space, const char *key, void *data, size_t length)
+{
+  if (!nvs.begin(space, true))
+  {
+    return false;
+  }
+  bool found = nvs.getBytesLength(key) == length && nvs.getBytes(key, data, length) == length;
+  nvs.end();
+  return found;
+}
+
+bool halNvsWriteBlob(const char *space, const char *key, const void *data, size_t length)
+{
+  if (!nvs.begin(space, false))
+  {
+    return false;
+  }
+  bool written = nvs.putBytes(key, data, length) == length;
+  nvs.end();
+  return written;
+}
+
+void halNvsErase(const char *space, const char *key)
+{
+  if (nvs.begin(space, false))
+  {
+    nvs.remove(key);
+    nvs.end();
+  }
+}
+
+bool halNetworkConnected()
+{
+  return WiFi.isConnected();
+}
+
+uint32_t halRandom()
+{
+  return esp_random();
+}
+
+#endif // ARDUINO
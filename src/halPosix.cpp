@@ -0,0 +1,208 @@
+// Host side of hal.h, for the native build. Everything is kept in memory and driven by the simulation through halPosix.h.
+#ifndef ARDUINO
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+#include "halPosix.h"
+
+static const int PIN_COUNT = 40; // GPIO0 - GPIO39, same as the ESP32
+
+static int64_t clockUs = 0;
+static bool pinLevels[PIN_COUNT];
+static bool pinIsOutput[PIN_COUNT];
+static int servoUs = 0;
+static bool networkConnected = true;
+static uint32_t randomState = 1;
+static std::map<std::string, int32_t> nvsInts;
+static std::map<std::string, std::vector<uint8_t>> nvsBlobs;
+static int16_t pulseCount = 0;
+static int16_t pulseHighLimit = 0;
+static uint32_t pulseFilterNs = 0;
+static void (*pulseOnHighLimit)() = NULL;
+static uint32_t pulseInterruptsPending = 0;
+
+static bool validPin(int pin)
+{
+  return pin >= 0 && pin < PIN_COUNT;
+}
+
+static std::string nvsName(const char *space, const char *key)
+{
+  return std::string(space) + "/" + key;
+}
+
+uint32_t halMillis()
+{
+  return (uint32_t)(clockUs / 1000);
+}
+
+int64_t halMicros()
+{
+  return clockUs;
+}
+
+void halPinOutput(int pin)
+{
+  if (validPin(pin))
+  {
+    pinIsOutput[pin] = true;
+    pinLevels[pin] = false;
+  }
+}
+
+void halPinInput(int pin)
+{
+  if (validPin(pin))
+  {
+    pinIsOutput[pin] = false;
+    pinLevels[pin] = true; // pulled up
+  }
+}
+
+void halDigitalWrite(int pin, bool high)
+{
+  if (validPin(pin) && pinIsOutput[pin])
+  {
+    pinLevels[pin] = high;
+  }
+}
+
+bool halDigitalRead(int pin)
+{
+  return validPin(pin) && pinLevels[pin];
+}
+
+void halServoAttach(int pin, int minUs, int maxUs)
+{
+}
+
+void halServoWrite(int microseconds)
+{
+  servoUs = microseconds;
+}
+
+void halPulseCounterBegin(int pin, int16_t highLimit, uint16_t glitchFilterCycles, void (*onHighLimit)())
+{
+  pulseCount = 0;
+  pulseHighLimit = highLimit;
+  pulseFilterNs = glitchFilterCycles * 25 / 2; // 12.5ns APB clock cycles
+  pulseOnHighLimit = onHighLimit;
+  pulseInterruptsPending = 0;
+}
+
+int16_t halPulseCounterRead()
+{
+  return pulseCount;
+}
+
+bool halNvsReadInt(const char *space, const char *key, int32_t &value)
+{
+  std::map<std::string, int32_t>::const_iterator found = nvsInts.find(nvsName(space, key));
+  if (found == nvsInts.end())
+  {
+    return false;
+  }
+  value = found->second;
+  return true;
+}
+
+bool halNvsWriteInt(const char *space, const char *key, int32_t value)
+{
+  nvsInts[nvsName(space, key)] = value;
+  return true;
+}
+
+bool halNvsReadBlob(const char *space, const char *key, void *data, size_t length)
+{
+  std::map<std::string, std::vector<uint8_t>>::const_iterator found = nvsBlobs.find(nvsName(space, key));
+  if (found == nvsBlobs.end() || found->second.size() != length)
+  {
+    return false;
+  }
+  memcpy(data, found->second.data(), length);
+  return true;
+}
+
+bool halNvsWriteBlob(const char *space, const char *key, const void *data, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  nvsBlobs[nvsName(space, key)] = std::vector<uint8_t>(bytes, bytes + length);
+  return true;
+}
+
+void halNvsErase(const char *space, const char *key)
+{
+  nvsInts.erase(nvsName(space, key));
+  nvsBlobs.erase(nvsName(space, key));
+}
+
+bool halNetworkConnected()
+{
+  return networkConnected;
+}
+
+// xorshift32, so a simulation run with the same seed always plays out the same
+uint32_t halRandom()
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+void halSimSetMicros(int64_t nowUs)
+{
+  clockUs = nowUs;
+  for (; pulseInterruptsPending > 0; pulseInterruptsPending--)
+  {
+    if (pulseOnHighLimit != NULL)
+    {
+      pulseOnHighLimit();
+    }
+  }
+}
+
+void halSimSetInput(int pin, bool high)
+{
+  if (validPin(pin) && !pinIsOutput[pin])
+  {
+    pinLevels[pin] = high;
+  }
+}
+
+bool halSimOutput(int pin)
+{
+  return validPin(pin) && pinIsOutput[pin] && pinLevels[pin];
+}
+
+int halSimServo()
+{
+  return servoUs;
+}
+
+void halSimSetNetwork(bool connected)
+{
+  networkConnected = connected;
+}
+
+void halSimSeedRandom(uint32_t seed)
+{
+  randomState = seed != 0 ? seed : 1; // xorshift sticks at 0
+}
+
+bool halSimPulse(uint32_t widthNs)
+{
+  if (widthNs < pulseFilterNs)
+  {
+    return false;
+  }
+  if (++pulseCount >= pulseHighLimit)
+  {
+    pulseCount = 0;
+    pulseInterruptsPending++;
+  }
+  return true;
+}
+
+#endif // ARDUINO
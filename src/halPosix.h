@@ -0,0 +1,22 @@
+// halPosix.h
+#ifndef HALPOSIX_H
+#define HALPOSIX_H
+#include <stdint.h>
+#include "hal.h"
+
+// The simulation's side of the host hal (halPosix.cpp). Nothing moves on its own in here: time only passes when the
+//   simulation sets the clock, inputs only change when it sets them, and outputs just remember what was last written.
+
+void halSimSetMicros(int64_t nowUs);
+void halSimSetInput(int pin, bool high);
+bool halSimOutput(int pin);
+int halSimServo(); // last servo command in microseconds, 0 before anything was written
+void halSimSetNetwork(bool connected);
+void halSimSeedRandom(uint32_t seed);
+
+// The sensor on the pulse counter's pin pulled it low for widthNs. Counted unless the glitch filter drops it, in which
+//   case this returns false. Reaching the high limit wraps the counter straight away, but its "interrupt" only runs the
+//   next time the clock moves, so the code reading the counter sees the same window as on the wheel.
+bool halSimPulse(uint32_t widthNs);
+
+#endif // HALPOSIX_H
@@ -0,0 +1,185 @@
+// jsonWriter.h
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Writes JSON straight into a fixed size char buffer - no String, no heap. Commas are handled for you, so it's just
+//   beginObject(), a list of field() calls and endObject(). If the buffer runs out everything after that is dropped and
+//   overflowed() turns true, the output is always null terminated either way.
+//
+//   char buf[128];
+//   JsonWriter json(buf, sizeof(buf));
+//   json.beginObject().field("treats", 12).field("outOfTreats", false).endObject();
+class JsonWriter
+{
+public:
+  static const int MAX_DEPTH = 8;
+
+  JsonWriter(char *buffer, size_t size) : buffer_(buffer), size_(size)
+  {
+    if (size_ > 0)
+    {
+      buffer_[0] = '\0';
+    }
+  }
+
+  JsonWriter &beginObject(const char *key = NULL) { return open(key, '{'); }
+  JsonWriter &endObject() { return close('}'); }
+  JsonWriter &beginArray(const char *key = NULL) { return open(key, '['); }
+  JsonWriter &endArray() { return close(']'); }
+
+  JsonWriter &field(const char *key, const char *value)
+  {
+    separator(key);
+    if (value == NULL)
+    {
+      append("null");
+      return *this;
+    }
+    appendString(value);
+    return *this;
+  }
+
+  JsonWriter &field(const char *key, bool value)
+  {
+    separator(key);
+    append(value ? "true" : "false");
+    return *this;
+  }
+
+  // one overload per built in type rather than per intN_t, since which of these the intN_t types map to differs between the ESP32 and a PC
+  JsonWriter &field(const char *key, int value) { return number(key, "%d", value); }
+  JsonWriter &field(const char *key, unsigned int value) { return number(key, "%u", value); }
+  JsonWriter &field(const char *key, long value) { return number(key, "%ld", value); }
+  JsonWriter &field(const char *key, unsigned long value) { return number(key, "%lu", value); }
+  JsonWriter &field(const char *key, long long value) { return number(key, "%lld", value); }
+  JsonWriter &field(const char *key, unsigned long long value) { return number(key, "%llu", value); }
+
+  JsonWriter &field(const char *key, float value, int decimals)
+  {
+    separator(key);
+    char text[24];
+    snprintf(text, sizeof(text), "%.*f", decimals, (double)value);
+    append(text);
+    return *this;
+  }
+
+  // Array elements
+  JsonWriter &value(const char *value) { return field(NULL, value); }
+  JsonWriter &value(unsigned long value) { return field(NULL, value); }
+
+  // Something that is already valid JSON
+  JsonWriter &raw(const char *key, const char *json)
+  {
+    separator(key);
+    append(json);
+    return *this;
+  }
+
+  const char *c_str() const { return buffer_; }
+  size_t length() const { return length_; }
+  bool overflowed() const { return overflowed_; }
+
+private:
+  JsonWriter &open(const char *key, char bracket)
+  {
+    separator(key);
+    appendChar(bracket);
+    if (depth_ < MAX_DEPTH - 1)
+    {
+      depth_++;
+      first_[depth_] = true;
+    }
+    return *this;
+  }
+
+  JsonWriter &close(char bracket)
+  {
+    appendChar(bracket);
+    if (depth_ > 0)
+    {
+      depth_--;
+    }
+    return *this;
+  }
+
+  template <typename T>
+  JsonWriter &number(const char *key, const char *format, T value)
+  {
+    separator(key);
+    char text[24];
+    snprintf(text, sizeof(text), format, value);
+    append(text);
+    return *this;
+  }
+
+  void separator(const char *key)
+  {
+    if (!first_[depth_])
+    {
+      appendChar(',');
+    }
+    first_[depth_] = false;
+    if (key != NULL)
+    {
+      appendString(key);
+      appendChar(':');
+    }
+  }
+
+  void appendString(const char *text)
+  {
+    appendChar('"');
+    for (; *text; text++)
+    {
+      char c = *text;
+      if (c == '"' || c == '\\')
+      {
+        appendChar('\\');
+        appendChar(c);
+      }
+      else if ((unsigned char)c < 0x20)
+      {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+        append(escaped);
+      }
+      else
+      {
+        appendChar(c);
+      }
+    }
+    appendChar('"');
+  }
+
+  void append(const char *text)
+  {
+    for (; *text; text++)
+    {
+      appendChar(*text);
+    }
+  }
+
+  void appendChar(char c)
+  {
+    if (length_ + 1 >= size_)
+    {
+      overflowed_ = true;
+      return;
+    }
+    buffer_[length_++] = c;
+    buffer_[length_] = '\0';
+  }
+
+  char *buffer_;
+  size_t size_;
+  size_t length_ = 0;
+  bool overflowed_ = false;
+  int depth_ = 0;
+  bool first_[MAX_DEPTH] = {true, true, true, true, true, true, true, true};
+};
+
+#endif // JSONWRITER_H
@@ -0,0 +1,125 @@
+// latencyHistogram.h
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// Fixed size histogram of latencies in microseconds, for the hot paths in mainTask (see /api/perf). Buckets are on a
+//   log scale with 4 per power of two, so anything from 1us to ~16s fits in 92 counters and a percentile read back
+//   from it is never more than 25% high. Recording is a handful of instructions and never allocates or locks.
+//
+//   0 1 2 3 | 4 5 6 7 | 8 10 12 14 | 16 20 24 28 | 32 40 48 56 | ...
+//
+// Only one task may record(), any task can snapshot() - the counters are atomics, so a snapshot taken while a value
+//   is being recorded can be one value behind in places but never reads a half written counter.
+class LatencyHistogram
+{
+public:
+  static const int SUB_BUCKETS = 4; // per power of two
+  static const int MAX_EXPONENT = 23;
+  static const int BUCKETS = SUB_BUCKETS + (MAX_EXPONENT - 1) * SUB_BUCKETS; // the last one also takes everything bigger
+
+  struct Snapshot
+  {
+    uint32_t buckets[BUCKETS];
+    uint32_t count;
+    uint32_t maxUs;
+
+    // The upper edge of the bucket the percentile falls in, capped at the biggest value seen. 0 if nothing's recorded.
+    uint32_t percentile(uint32_t perMille) const
+    {
+      if (count == 0)
+      {
+        return 0;
+      }
+      uint64_t rank = ((uint64_t)count * perMille + 999) / 1000;
+      if (rank == 0)
+      {
+        rank = 1;
+      }
+      uint64_t seen = 0;
+      for (int i = 0; i < BUCKETS; i++)
+      {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+          uint32_t upper = bucketUpper(i);
+          return upper < maxUs ? upper : maxUs;
+        }
+      }
+      return maxUs;
+    }
+  };
+
+  void record(int64_t latencyUs)
+  {
+    uint32_t value = latencyUs <= 0 ? 0 : latencyUs >= UINT32_MAX ? UINT32_MAX : (uint32_t)latencyUs;
+    std::atomic<uint32_t> &bucket = buckets_[bucketOf(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (value > maxUs_.load(std::memory_order_relaxed))
+    {
+      maxUs_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  void snapshot(Snapshot &out) const
+  {
+    out.count = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+      out.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+      out.count += out.buckets[i];
+    }
+    out.maxUs = maxUs_.load(std::memory_order_relaxed);
+  }
+
+  // Also only from the task that records
+  void reset()
+  {
+    for (int i = 0; i < BUCKETS; i++)
+    {
+      buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    maxUs_.store(0, std::memory_order_relaxed);
+  }
+
+  static int bucketOf(uint32_t value)
+  {
+    if (value < SUB_BUCKETS)
+    {
+      return value;
+    }
+    int exponent = 31 - __builtin_clz(value); // >= 2 from here on
+    if (exponent > MAX_EXPONENT)
+    {
+      return BUCKETS - 1;
+    }
+    int sub = (value >> (exponent - 2)) & (SUB_BUCKETS - 1);
+    int index = SUB_BUCKETS + (exponent - 2) * SUB_BUCKETS + sub;
+    return index < BUCKETS ? index : BUCKETS - 1;
+  }
+
+  // Biggest value that lands in bucket i
+  static uint32_t bucketUpper(int i)
+  {
+    if (i < SUB_BUCKETS)
+    {
+      return i;
+    }
+    if (i >= BUCKETS - 1)
+    {
+      return UINT32_MAX;
+    }
+    int exponent = (i - SUB_BUCKETS) / SUB_BUCKETS + 2;
+    int sub = (i - SUB_BUCKETS) % SUB_BUCKETS;
+    uint32_t lower = ((uint32_t)(SUB_BUCKETS + sub)) << (exponent - 2);
+    return lower + (1u << (exponent - 2)) - 1;
+  }
+
+private:
+  std::atomic<uint32_t> buckets_[BUCKETS] = {};
+  std::atomic<uint32_t> maxUs_{0};
+};
+
+#endif // LATENCYHISTOGRAM_H
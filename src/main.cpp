@@ -10,22 +10,60 @@
 
 // Other things I expect to possibly be user configurable if oneFastCat comes out with different wheels
 int hallEffectRunDistanceMultiplier = 22; // find the circumferance of your wheel in cm, then divide by the number of magnets you have installed.
-int DEBOUNCE_TIME_HALL = 0;               // if you notice bouncing on wheel pos reads, increase this slowly. too high of a value will ignore rotations if your cat is sanic speed.
+int hallEffectMagnetCount = 1;            // number of magnets on the wheel, only used to turn edges into revolutions for cadence.
+int HALL_GLITCH_FILTER_CYCLES = 1023;     // pulses on the hall sensor shorter than this many 80MHz clock cycles are ignored (max 1023 ~= 12.8us). lower this if your cat is sanic speed.
 bool DEBUG_DIST = false;
 
+// On boot we go straight to the access point we were last connected to (saved BSSID + channel) instead of scanning for
+//   it. Setting this to true also reuses the last DHCP lease for that first attempt, which skips the DHCP round trip
+//   too, but only do that if your router keeps handing the wheel the same address (ie a DHCP reservation).
+bool WIFI_REUSE_DHCP_LEASE = false;
+
+// Dispense request handling (see dispenseQueue.h)
+int DISPENSE_COALESCE_MS = 0;        // requests from the same place (web / mqtt) this close together count as one. 0 = every request dispenses.
+int DISPENSE_MIN_INTERVAL_MS = 1000; // minimum time between starting two dispenses
+int DISPENSE_MAX_PER_REQUEST = 5;    // a single request can ask for at most this many treats
+
+// Latency histograms for the hot paths in mainTask (hall edge -> counted, dispense beam -> motor stopped), served at
+//   /api/perf and published to <prefix>/perf. Change to false to leave all of it out of the build.
+#define PERF_ENABLED true
+
 #include <Arduino.h>
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <PubSubClient.h>
 #include <Wire.h>
-#include <ESP32Servo.h>
-#include <ezButton.h>
 #include "functions.h"
+#include "hal.h"
+#include "odometry.h"
+#include "spscRing.h"
+#include "wheelSpeed.h"
+#include "dispenser.h"
+#include "dispenseQueue.h"
+#include "wheelController.h"
+#include "sensorTrace.h"
+#if PERF_ENABLED
+#include "latencyHistogram.h"
+#endif
 #include "webServerStyle.h"
+#include "templateStreamer.h"
+#include "jsonWriter.h"
+#include "backoff.h"
+#include "statsJournal.h"
+#include "rtcCounters.h"
+#include "seqLock.h"
+#include "telemetrySnapshot.h"
+#include "taskLoad.h"
+#include "mqttTopics.h"
+#include "mqttOutbox.h"
+#include "commands.h"
 #include <SPIFFS.h>
 #include <Preferences.h> // Replaces EEPROM for ESP32
-#include "mqttConfig.h"
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <lwip/sockets.h>
+#include "appConfig.h"
 
 // Global state machine
 enum class NetworkState
@@ -36,7 +74,32 @@ enum class NetworkState
   AP_MODE,
   TRIAL_MODE
 };
-volatile NetworkState networkState = NetworkState::DISCONNECTED;
+volatile NetworkState networkState = NetworkState::DISCONNECTED; // only wifiManagerTask changes this, see setNetworkState()
+
+// Everything that moves the wifi state machine along goes through wifiEventQueue: driver events (posted from the
+//   Arduino WiFi event task by onWifiEvent), plus new credentials, scan requests and trial mode from the web server.
+//   wifiManagerTask sleeps on the queue, so it only wakes up when something actually happened.
+enum class WifiEventType : uint8_t
+{
+  GOT_IP,
+  LOST_IP,
+  STA_DISCONNECTED,
+  SCAN_DONE,
+  SCAN_REQUESTED,
+  NEW_CREDENTIALS, // the credentials themselves are waiting in wifiQueue
+  TRIAL_MODE
+};
+
+struct WifiEvent
+{
+  WifiEventType type;
+  uint8_t reason; // disconnect reason from the driver, for STA_DISCONNECTED
+};
+
+const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000; // give up on an attempt the driver has gone quiet on after this long
+const uint32_t WIFI_DIRECTED_TIMEOUT_MS = 5000; // same, for a connect straight to the cached access point - if that's slow it's probably gone
+const uint32_t WIFI_RETRY_BASE_MS = 500;        // reconnect backoff, see backoff.h
+const uint32_t WIFI_RETRY_MAX_MS = 60000;
 
 // Configuration structure stored in Preferences (replaces EEPROM)
 struct WiFiConfig
@@ -45,37 +108,239 @@ struct WiFiConfig
   char password[64];
 };
 
+// Where we were connected last time, stored next to WiFiConfig as "netCache" and refreshed every time we get an ip.
+//   Lets a reboot connect straight to that access point on that channel, instead of scanning every channel for it.
+struct WifiNetworkCache
+{
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip; // the last DHCP lease, only used when WIFI_REUSE_DHCP_LEASE is set
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// Optional static ip from the setup page, stored as "staticIp". ip == 0 means use DHCP.
+struct StaticIpConfig
+{
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// What /connect hands to wifiManagerTask through wifiQueue
+struct WifiSetupMessage
+{
+  WiFiConfig wifi;
+  StaticIpConfig staticIp;
+};
+
+// Milliseconds since boot at each step of getting onto the network, printed once the web server is up and reported in
+//   /api/status. 0 = hasn't happened (yet).
+struct BootTimeline
+{
+  uint32_t wifiStartMs;
+  uint32_t connectedMs;
+  uint32_t httpReadyMs;
+  bool fastConnect; // connected on the directed attempt to the cached access point
+};
+
 WiFiConfig config;
-MQTTConfig mqttConf;
+WifiNetworkCache networkCache;
+bool networkCacheValid = false;
+StaticIpConfig staticIp;
+BootTimeline bootTimeline;
+ConfigStore configStore; // user settings, see appConfig.h
 
 WiFiClient espClient;
 PubSubClient mqttClient(espClient);
-;
+
+// mqttServerTask sleeps on the broker socket (select) between ticks rather than polling loop() flat out, and wakes up
+//   early on a notification when the network or the settings change
+const uint32_t MQTT_TICK_MS = 1000;       // longest we sleep while connected - dispense results wait at most this long
+const uint32_t MQTT_IDLE_WAIT_MS = 5000;  // same, while mqtt is off or there's no network
+const uint16_t MQTT_KEEPALIVE_S = 15;     // broker drops us if it hears nothing for 1.5x this
+const uint16_t MQTT_SOCKET_TIMEOUT_S = 5; // how long connect() waits on a slow broker
+const uint32_t MQTT_RETRY_BASE_MS = 1000; // reconnect backoff, see backoff.h
+const uint32_t MQTT_RETRY_MAX_MS = 120000;
+TaskLoad mqttTaskLoad; // how busy mqttServerTask is, see taskLoad.h. Shows up in the log and /api/status.
+// Biggest packet PubSubClient will send or take. The getState reply is the biggest we send: ~800 bytes of status plus
+//   the MQTT settings and the caller's id, ~1.3KB with long settings. A reply that still doesn't fit is answered with
+//   an error instead (see mqttHandleCommand).
+const uint16_t MQTT_BUFFER_SIZE = 1536;
+MqttTopics mqttTopics;                    // built from the prefix by mqttServerTask, which is the only one that uses them
+
+// Home Assistant MQTT discovery (https://www.home-assistant.io/integrations/mqtt/#mqtt-discovery). The configs are
+//   retained, and sent again on every connect and whenever Home Assistant announces it has restarted.
+const char *HA_DISCOVERY_PREFIX = "homeassistant";
+const char *HA_STATUS_TOPIC = "homeassistant/status";
+char mqttNodeId[24];               // catwheel_<end of the MAC>, so two wheels don't show up as the same device
+bool mqttDiscoveryPending = false; // set from the callback, sent from the task loop
+
+// Events waiting to go out over MQTT, see mqttOutbox.h. Other tasks hand them over through outboxQueue, only
+//   mqttServerTask touches the outbox itself (and the spill-over file in SPIFFS).
+const uint32_t OUTBOX_ACK_TIMEOUT_MS = 10000; // resend anything the broker hasn't echoed back by then
+const uint32_t OUTBOX_SPILL_EVENTS = 2048;    // most events kept in SPIFFS (64KB) before the oldest get dropped
+const char *OUTBOX_FILE = "/outbox.bin";
+const char *OUTBOX_POS_FILE = "/outbox.pos"; // how many events at the front of OUTBOX_FILE are already gone
+const char *OUTBOX_TMP_FILE = "/outbox.tmp";
+MqttOutbox mqttOutbox;
+bool outboxSpillReady = false;
+uint32_t outboxSpillFirst = 0; // first event in OUTBOX_FILE that's still wanted
+uint32_t outboxSpillEnd = 0;   // number of events in OUTBOX_FILE
+uint32_t bootId = 0;           // random, picked in setup()
+uint32_t nextOutboxSequence = 1;
+portMUX_TYPE outboxMux = portMUX_INITIALIZER_UNLOCKED;
+
+// PubSubClient and the outbox belong to mqttServerTask, so the web side doesn't ask them how things are. The task
+//   publishes this every time before it goes to sleep and the status page, getState and the SSE feed read it from here.
+struct MqttStatusSnapshot
+{
+  bool connected;
+  uint32_t queued;
+  uint32_t inFlight;
+  uint32_t delivered;
+  uint32_t dropped;
+  uint32_t resends;
+};
+SeqLock<MqttStatusSnapshot> mqttStatus;
 
 // FreeRTOS handles
 TaskHandle_t wifiTaskHandle;
 TaskHandle_t webTaskHandle;
-TaskHandle_t mqttTaskHandle;
+TaskHandle_t mqttTaskHandle = NULL;
+TaskHandle_t mainTaskHandle = NULL;
+TaskHandle_t statsTaskHandle = NULL;
+TaskHandle_t traceTaskHandle = NULL;
 QueueHandle_t wifiQueue;
-QueueHandle_t mqttQueue;
+QueueHandle_t wifiEventQueue;
+QueueHandle_t dispenseQueue;       // DispenseRequest, from any task to mainTask
+QueueHandle_t dispenseResultQueue; // DispenseCompletion, from mainTask to mqttServerTask
+QueueHandle_t outboxQueue;         // OutboxEvent, from any task to mqttServerTask
 
 Preferences preferences; // ESP32's non-volatile storage
 
-// Statistics (these are populated from non-volatile storage below)
-uint32_t totalDistance = 0;
-uint32_t totalTreatsDispensed = 0;
-volatile uint32_t hallEffectCount = 0;
-uint32_t distanceThreshold = 100 * 100; // 100 meters - we also populate this below, but just in case that doesn't work, we want to make sure its not zero cause it would potentially empty the hopper out.
-
-// io flags
-bool forceDispense = false;
-bool outOfTreats = false;
-bool outOfTreats_hopper = false;
-volatile bool dispensingTreat = false;
+// The wheel itself: counters, dispenser and speed tracking (see wheelController.h). setup() fills in the saved
+//   totals, after that it belongs to mainTask - everyone else reads it from the telemetry snapshot.
+WheelController wheel;
+
+// Lifetime stats live in the "journal" flash partition (see statsJournal.h and partitions.csv). If that partition
+//   isn't there we fall back to the old way of writing them to Preferences every 30 minutes.
+const uint32_t STATS_CHECKPOINT_MS = 5000;              // how often the totals are checkpointed while they're changing
+const uint32_t STATS_PREFERENCES_CHECKPOINT_MS = 1800000; // fallback, 30 minutes
+const uint32_t DISPENSE_PROFILE_SAVE_EVERY = 10;          // dispenses learned from between saving the profile (see dispenseProfile.h)
+const esp_partition_t *statsPartition = NULL;
+StatsJournal statsJournal;
+bool statsJournalReady = false;
+
+// Copy of the live counters that survives resets (see rtcCounters.h). RTC_NOINIT so the startup code leaves it alone.
+RTC_NOINIT_ATTR RtcCounters rtcCounterSlots[2];
+RtcCounterMirror rtcCounters(rtcCounterSlots);
+
+// Hall edge timestamps for the speed analytics, from the ISR to mainTask
+SpscRing<int64_t, 64> hallEdgeTimes;
+const uint32_t WHEEL_SESSION_GAP_MS = 10000;    // runs longer than this apart count as separate sessions
+const uint32_t WHEEL_MIN_EDGE_INTERVAL_US = 2000; // edges closer than this are bounces (that would be ~400km/h on a 22cm wheel)
+
+// Sensor trace, for taking a misbehaving wheel home to the simulator (see sensorTrace.h). mainTask records into
+//   traceRing and traceTask writes it out to TRACE_FILE, which /api/trace hands out once the trace is stopped.
+const char *TRACE_FILE = "/trace.bin";
+const uint32_t TRACE_MAX_BYTES = 512 * 1024; // stops by itself at this size, ~65k records
+TraceRecorder traceRecorder;
+TraceHeader traceHeader; // filled in by mainTask when a trace starts, written first by traceTask
+SpscRing<TraceRecord, 512> traceRing;
+volatile bool traceWriting = false; // traceTask still has the file open
+volatile uint32_t traceBytes = 0;
+// When the photodiode ISRs last fired, the low 32 bits of esp_timer. A 64 bit store from the ISR's core could be read
+//   half done by mainTask on the other one, see beamTimeUs() for getting the whole time back.
+std::atomic<uint32_t> dispenseBeamUs{0};
+std::atomic<uint32_t> hopperBeamUs{0};
+
+// Whether the dispenser takes a dispense beam break as the treat right now, kept up to date by mainTask. The motor can
+//   start before the LEDs have warmed up (see dispenser.h), and the ISR mustn't stop it on their noise.
+std::atomic<bool> dispenseBeamWatched{false};
+
+#if PERF_ENABLED
+// How quick mainTask is on the paths that matter (see latencyHistogram.h). Timed with esp_timer like the ISR stamps
+//   above, rather than the cycle counter, since that one is per core and the ISRs don't run on mainTask's core.
+LatencyHistogram edgeToCountLatency; // hall ISR -> edge added to the distance
+LatencyHistogram beamToStopLatency;  // dispense photodiode ISR -> motor told to stop, by whichever got there first
+LatencyHistogram beamToLoopStopLatency; // same, but when mainTask's own stop went out - how long the motor used to overrun
+int64_t motorStopUs = 0;             // when setDispenserMotor last stopped the motor, only touched by mainTask
+std::atomic<uint32_t> fastStopLatencyUs{0}; // beam -> motorStopTask's stop, +1 so 0 means it hasn't happened
+#endif
+
+// The motor stops the moment a treat breaks the dispense beam. The ISR wakes motorStopTask, which sits at the top
+//   priority on the ISR's core so it runs as soon as the ISR returns, instead of the motor overrunning until mainTask
+//   gets round to it on the other core (a whole loop, if it was busy). The servo's ledc driver can't be called from an
+//   ISR, otherwise it would be done right in there. mainTask still gets the beam and runs the dispenser as before, its
+//   own stop just comes second.
+//
+// Who may touch the servo is handed back and forth through motorHandoff, so the two never write it at the same time
+//   and neither ever waits in a critical section for the other's ledc call:
+//   STOPPED -> CHANGING (mainTask) -> ARMED -> STOPPING (motorStopTask) -> STOPPED
+//   a beam while mainTask is CHANGING the speed leaves STOP_WANTED, and mainTask does the stop when it's done.
+enum class MotorHandoff : uint8_t
+{
+  STOPPED,
+  ARMED,      // the motor is running and waiting for a treat, motorStopTask may stop it
+  CHANGING,   // mainTask is writing the servo
+  STOP_WANTED,
+  STOPPING    // motorStopTask is writing the servo
+};
+TaskHandle_t motorStopTaskHandle = NULL;
+std::atomic<MotorHandoff> motorHandoff{MotorHandoff::STOPPED};
+
+SeqLock<TelemetrySnapshot> telemetry; // see telemetrySnapshot.h
+
+// Live telemetry pushed to browsers over server sent events. mainTask pokes webServerTask when something changes, and
+//   webServerTask sends at most one update per TELEMETRY_PUSH_INTERVAL_MS holding only the fields that changed, so a
+//   sprinting cat can't flood the link no matter how many browsers are watching.
+const uint32_t TELEMETRY_PUSH_INTERVAL_MS = 250;
+AsyncEventSource telemetryEvents("/events");
+
+// Wi-Fi scan results. The scan itself runs asynchronously and is owned by wifiManagerTask, the /scan handler just asks
+//   for one and hands back whatever is cached, so the async TCP task never waits on the radio. Callers that show up
+//   while a scan is running all share that scan.
+const uint32_t WIFI_SCAN_CACHE_MS = 10000; // results younger than this are good enough, don't rescan
+volatile bool wifiScanRequested = false;
+volatile bool wifiScanInProgress = false;
+uint32_t wifiScanCompletedAt = 0;
+bool wifiScanHaveResults = false;
+char wifiScanJson[2048] = "[]";
+SemaphoreHandle_t wifiScanMutex;
+SemaphoreHandle_t commandConfigMutex; // setConfig, from the web server or the mqtt task
+
+struct TelemetryState
+{
+  uint32_t progressMeters;
+  uint32_t totalDistanceMeters;
+  uint32_t treats;
+  uint32_t speed;
+  uint32_t peakSpeed;
+  bool outOfTreats;
+  bool hopperEmpty;
+  bool dispensing;
+  bool mqttConnected;
+};
 
-// timer for empty hopper detection:
-volatile bool ISR_GUARD = true; // only run ISR logic when our main code dictates. (because we turn the LED on and off only when needed, and the LED drives the ISR)
-volatile unsigned long accumulatedDispensingTimeWithoutHopperTreat_ms = 0;
+// mainTask sleeps on its task notification, so these bits wake it up the moment something happens instead of waiting for the next tick
+const uint32_t MAIN_TASK_STACK = 4096; // Serial.printf, snapshot copies and the trace all happen on it, getState shows what's left
+const uint32_t MAIN_NOTIFY_DISPENSE_BEAM = 1 << 0;
+const uint32_t MAIN_NOTIFY_HOPPER_BEAM = 1 << 1;
+const uint32_t MAIN_NOTIFY_RESET_ERRORS = 1 << 2;
+const uint32_t MAIN_NOTIFY_RESET_STATS = 1 << 3;
+const uint32_t MAIN_NOTIFY_TRACE_START = 1 << 4;
+const uint32_t MAIN_NOTIFY_TRACE_STOP = 1 << 5;
+const uint32_t MAIN_NOTIFY_PERF_RESET = 1 << 6;
+
+// Request ids are handed out from whichever task asks, and the last few completions are kept around so the web UI can look them up
+uint32_t nextDispenseRequestId = 1;
+const int RECENT_DISPENSE_COMPLETIONS = 8;
+DispenseCompletion recentDispenseCompletions[RECENT_DISPENSE_COMPLETIONS];
+int recentDispenseCompletionsNext = 0;
+portMUX_TYPE dispenseMux = portMUX_INITIALIZER_UNLOCKED;
 
 // pin deffinitions
 //    inputs:
@@ -90,22 +355,71 @@ const int dispenseLightBreakSensorLEDPin = 19;
 const int motorPin = 21;
 const int errorLEDPin = 13;
 
-ezButton hallEffect(hallEffectSensorPin);
-Servo continuousServo;
+// Timestamp every hall edge so mainTask can work out speed. Counting is done by the pulse counter, this is only for timing.
+void IRAM_ATTR handleHallEdgeISR()
+{
+  hallEdgeTimes.push(esp_timer_get_time());
+}
 
 // ISR handlers for light break sensors. We want to detect treats as fast as we can, so we use interrupts instead of checking in main runtime logic!
+// The dispenser state machine decides whether an edge matters (the LEDs turning on and off make edges too), so all we do here is wake mainTask.
 void IRAM_ATTR handleHopperPhotoDiodeISR()
 {
-  if (!ISR_GUARD)
+  hopperBeamUs.store((uint32_t)esp_timer_get_time(), std::memory_order_relaxed);
+  if (mainTaskHandle != NULL)
   {
-    accumulatedDispensingTimeWithoutHopperTreat_ms = 0; // Reset when we see a treat
-    outOfTreats_hopper = false;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xTaskNotifyFromISR(mainTaskHandle, MAIN_NOTIFY_HOPPER_BEAM, eSetBits, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
   }
 }
 
 void IRAM_ATTR handleDispensePhotoDiodeISR()
 {
-  dispensingTreat = false;
+  dispenseBeamUs.store((uint32_t)esp_timer_get_time(), std::memory_order_relaxed);
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  if (dispenseBeamWatched.load(std::memory_order_relaxed) && motorHandoff.load(std::memory_order_relaxed) != MotorHandoff::STOPPED &&
+      motorStopTaskHandle != NULL)
+  {
+    vTaskNotifyGiveFromISR(motorStopTaskHandle, &higherPriorityTaskWoken);
+  }
+  if (mainTaskHandle != NULL)
+  {
+    xTaskNotifyFromISR(mainTaskHandle, MAIN_NOTIFY_DISPENSE_BEAM, eSetBits, &higherPriorityTaskWoken);
+  }
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+// Stops the motor for the dispense ISR, see motorHandoff
+void motorStopTask(void *pvParameters)
+{
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    MotorHandoff state = motorHandoff.load();
+    while (state == MotorHandoff::ARMED || state == MotorHandoff::CHANGING)
+    {
+      if (state == MotorHandoff::CHANGING && motorHandoff.compare_exchange_weak(state, MotorHandoff::STOP_WANTED))
+      {
+        break; // mainTask stops it as soon as its own write is out
+      }
+      if (state == MotorHandoff::ARMED && motorHandoff.compare_exchange_weak(state, MotorHandoff::STOPPING))
+      {
+        halServoWrite(TreatDispenser::MOTOR_STOP_US);
+        motorHandoff.store(MotorHandoff::STOPPED);
+#if PERF_ENABLED
+        fastStopLatencyUs.store((uint32_t)halMicros() - dispenseBeamUs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#endif
+        break;
+      }
+    }
+  }
+}
+
+// Full esp_timer time of a beam stamp, which is always a little in the past
+int64_t beamTimeUs(const std::atomic<uint32_t> &stamp, int64_t nowUs)
+{
+  return nowUs - (uint32_t)((uint32_t)nowUs - stamp.load(std::memory_order_relaxed));
 }
 
 // Memory check function for ESP32
@@ -132,20 +446,28 @@ void setup()
   Serial.println("starting setup");
 
   // init physical stuff
-  hallEffect.setDebounceTime(DEBOUNCE_TIME_HALL);
-  continuousServo.setPeriodHertz(50); // Standard 50Hz servo
-  continuousServo.attach(motorPin, 544, 2400);
-
-  pinMode(dispenseLightBreakSensorLEDPin, OUTPUT);
-  pinMode(hopperLightBreakSensorLEDPin, OUTPUT);
-  pinMode(errorLEDPin, OUTPUT);
-  // pinMode(resetWifiButtonPin, INPUT_PULLUP);
-  // pinMode(resetErrorButtonPin, INPUT_PULLUP);
-  pinMode(dispenseLightBreakSensorPin, INPUT_PULLUP);
-  pinMode(hopperLightBreakSensorPin, INPUT_PULLUP);
+  odometryBegin(hallEffectSensorPin, HALL_GLITCH_FILTER_CYCLES);
+  halServoAttach(motorPin, 544, 2400);
+
+  // Same core as the photodiode ISRs, which is the one setup() runs on (attachInterrupt hooks them up to the caller's core)
+  if (pdPASS != xTaskCreatePinnedToCore(motorStopTask, "motorStop", 2048, NULL, configMAX_PRIORITIES - 1, &motorStopTaskHandle, xPortGetCoreID()))
+  {
+    Serial.println("Failed to create motor stop task!");
+  }
+
+  halPinOutput(dispenseLightBreakSensorLEDPin);
+  halPinOutput(hopperLightBreakSensorLEDPin);
+  halPinOutput(errorLEDPin);
+  // halPinInput(resetWifiButtonPin);
+  // halPinInput(resetErrorButtonPin);
+  halPinInput(dispenseLightBreakSensorPin);
+  halPinInput(hopperLightBreakSensorPin);
 
   attachInterrupt(digitalPinToInterrupt(dispenseLightBreakSensorPin), handleDispensePhotoDiodeISR, FALLING);
   attachInterrupt(digitalPinToInterrupt(hopperLightBreakSensorPin), handleHopperPhotoDiodeISR, FALLING);
+  attachInterrupt(digitalPinToInterrupt(hallEffectSensorPin), handleHallEdgeISR, FALLING);
+
+  wheel.wheelSpeed().begin(hallEffectRunDistanceMultiplier, hallEffectMagnetCount, WHEEL_SESSION_GAP_MS, WHEEL_MIN_EDGE_INTERVAL_US);
 
   // First, see if we have done the initial settings write after a reset
   preferences.begin("conf", false); // open prefs to set our config.
@@ -162,23 +484,42 @@ void setup()
     {
       preferences.getBytes("config", &config, configSize);
     }
+    if (preferences.getBytesLength("netCache") == sizeof(WifiNetworkCache))
+    {
+      preferences.getBytes("netCache", &networkCache, sizeof(WifiNetworkCache));
+      networkCacheValid = networkCache.channel != 0;
+    }
+    if (preferences.getBytesLength("staticIp") == sizeof(StaticIpConfig))
+    {
+      preferences.getBytes("staticIp", &staticIp, sizeof(StaticIpConfig));
+    }
 
-    distanceThreshold = preferences.getInt("dist");
-    mqttConf.server = preferences.getString("mqttServer");
-    mqttConf.username = preferences.getString("mqttUser");
-    mqttConf.password = preferences.getString("mqttPass");
-    mqttConf.topicPrefix = preferences.getString("mqttTopic");
-    mqttConf.port = preferences.getInt("mqttPort");
-    mqttConf.mqttEnabled = preferences.getBool("mqttEnable");
-
-    totalDistance = preferences.getInt("totalDistance");
-    totalTreatsDispensed = preferences.getInt("totalTreatsDispensed");
+    loadConfig();
     preferences.end();
+
+    int32_t savedDistance = 0;
+    int32_t savedTreats = 0;
+    halNvsReadInt("conf", "totalDistance", savedDistance);
+    halNvsReadInt("conf", "totalTreatsDispensed", savedTreats);
+    wheel.setCounters(savedDistance, savedTreats, 0);
   }
 
+  // The journal has the newest totals, the values from Preferences above only matter the first time (migration).
+  //   If we just reset rather than lost power, RTC memory has newer ones still.
+  loadStatistics();
+  restoreRtcCounters();
+  loadDispenseProfile();
+  publishTelemetrySnapshot(); // so the other tasks start off with the saved totals, before mainTask takes over
+
   // Create FreeRTOS resources
-  wifiQueue = xQueueCreate(1, sizeof(WiFiConfig));
-  mqttQueue = xQueueCreate(1, sizeof(MQTTConfig));
+  wifiQueue = xQueueCreate(1, sizeof(WifiSetupMessage));
+  wifiEventQueue = xQueueCreate(8, sizeof(WifiEvent));
+  dispenseQueue = xQueueCreate(8, sizeof(DispenseRequest));
+  dispenseResultQueue = xQueueCreate(8, sizeof(DispenseCompletion));
+  outboxQueue = xQueueCreate(16, sizeof(OutboxEvent));
+  bootId = esp_random();
+  wifiScanMutex = xSemaphoreCreateMutex();
+  commandConfigMutex = xSemaphoreCreateMutex();
 
   // Start tasks
   if (pdPASS != xTaskCreatePinnedToCore(wifiManagerTask, "WiFiManager", 4096, NULL, 1, &wifiTaskHandle, 1))
@@ -202,15 +543,22 @@ void setup()
       ;
   }
 
-  if (pdPASS != xTaskCreatePinnedToCore(saveStatisticsTask, "saveStatistics", 1024, NULL, 1, NULL, 1))
+  if (pdPASS != xTaskCreatePinnedToCore(saveStatisticsTask, "saveStatistics", 3072, NULL, 1, &statsTaskHandle, 1))
   {
     Serial.println("Failed to create statistics task!");
     while (1)
       ;
   }
 
+  if (pdPASS != xTaskCreatePinnedToCore(traceTask, "trace", 3072, NULL, 1, &traceTaskHandle, 1))
+  {
+    Serial.println("Failed to create trace task!");
+    while (1)
+      ;
+  }
+
   // Run our main task on its own core to avoid timing issues with physical motion
-  if (pdPASS != xTaskCreatePinnedToCore(mainTask, "main", 2048, NULL, 1, NULL, 0))
+  if (pdPASS != xTaskCreatePinnedToCore(mainTask, "main", MAIN_TASK_STACK, NULL, 1, &mainTaskHandle, 0))
   {
     Serial.println("Failed to create test led task!");
     while (1)
@@ -235,336 +583,1930 @@ void mainTask(void *pvParameters)
 
   Serial.println("[main]: task starting...");
 
-  continuousServo.writeMicroseconds(1500); // Write a stop command, since if the MCU resets during motor movement, we want to halt it!
-  vTaskDelay(1000 / portTICK_PERIOD_MS);   // Delay for 1 second before starting task loop to make sure everything is setup.
+  halServoWrite(TreatDispenser::MOTOR_STOP_US); // Write a stop command, since if the MCU resets during motor movement, we want to halt it!
+  vTaskDelay(1000 / portTICK_PERIOD_MS);        // Delay for 1 second before starting task loop to make sure everything is setup.
+
+  WheelControllerIO wheelIO = {{setDispenserSensorLeds, setDispenserMotor}, setErrorLed, requestDispense, takeDispenseRequest,
+                               reportDispenseCompletion, recordOutboxEvent, logLine};
+  wheel.begin(wheelIO, hallEffectRunDistanceMultiplier);
+  wheel.setDebugDistance(DEBUG_DIST);
+  wheel.scheduler().configure(DISPENSE_COALESCE_MS, DISPENSE_MIN_INTERVAL_MS, DISPENSE_MAX_PER_REQUEST);
+  uint32_t mirroredHallEffectCount = wheel.hallEffectCount();
+  uint32_t mirroredDistance = wheel.totalDistance();
+  uint32_t mirroredTreats = wheel.totalTreats();
+
+  // Our own copy of the distance per treat, only refreshed when the settings actually change (see appConfig.h)
+  uint32_t configChanges = configStore.changeCount();
+  wheel.setDistanceThreshold(configStore.current()->distanceThreshold);
 
   while (1)
   {
-    if (outOfTreats)
+    // Sleep until the next tick, or until a photodiode ISR (or the web server) pokes us
+    uint32_t notifyBits = 0;
+    xTaskNotifyWait(0, 0xFFFFFFFF, &notifyBits, pdMS_TO_TICKS(5));
+    uint32_t now = halMillis();
+    int64_t nowUs = halMicros();
+
+    if ((notifyBits & MAIN_NOTIFY_TRACE_START) && !traceRecorder.recording())
     {
-      digitalWrite(errorLEDPin, HIGH);
+      startTrace(nowUs);
     }
-    else
+
+    // Everything that goes into the controller also goes into the trace, if one is being recorded (see sensorTrace.h)
+    if (notifyBits & MAIN_NOTIFY_DISPENSE_BEAM)
+    {
+      int64_t beamUs = beamTimeUs(dispenseBeamUs, nowUs);
+      traceRecorder.record(beamUs, TraceEvent::DISPENSE_BEAM, 0);
+#if PERF_ENABLED
+      int64_t previousStopUs = motorStopUs;
+#endif
+      wheel.onDispenseBeam(now);
+#if PERF_ENABLED
+      if (motorStopUs != previousStopUs) // the beam was the treat we were waiting for, not the LEDs switching
+      {
+        int64_t loopStopUs = motorStopUs - beamUs;
+        uint32_t fastStopUs = fastStopLatencyUs.exchange(0, std::memory_order_relaxed);
+        beamToLoopStopLatency.record(loopStopUs);
+        beamToStopLatency.record(fastStopUs != 0 && fastStopUs - 1 < loopStopUs ? fastStopUs - 1 : loopStopUs);
+      }
+#endif
+    }
+    if (notifyBits & MAIN_NOTIFY_HOPPER_BEAM)
+    {
+      traceRecorder.record(beamTimeUs(hopperBeamUs, nowUs), TraceEvent::HOPPER_BEAM, 0);
+      wheel.onHopperBeam(now);
+    }
+    if (notifyBits & MAIN_NOTIFY_RESET_ERRORS)
+    {
+      traceRecorder.record(nowUs, TraceEvent::RESET_ERRORS, 0);
+      wheel.resetErrors();
+    }
+    if (configStore.changeCount() != configChanges)
+    {
+      configChanges = configStore.changeCount();
+      wheel.setDistanceThreshold(configStore.current()->distanceThreshold);
+      traceRecorder.record(nowUs, TraceEvent::THRESHOLD, wheel.distanceThreshold());
+    }
+    if (notifyBits & MAIN_NOTIFY_RESET_STATS)
+    {
+      traceRecorder.record(nowUs, TraceEvent::RESET_STATS, 0);
+      wheel.resetStats();
+    }
+
+    // Edges are counted by the pulse counter in hardware, so we just pick up everything that happened since the last loop
+    uint32_t newHallEdges = odometryTakeNewEdges();
+    if (newHallEdges > 0)
     {
-      digitalWrite(errorLEDPin, LOW);
+      traceRecorder.record(nowUs, TraceEvent::EDGE_COUNT, newHallEdges);
+      wheel.addEdges(newHallEdges);
     }
+#if PERF_ENABLED
+    int64_t countedUs = halMicros();
+#endif
 
-    hallEffect.loop();
-    if (hallEffect.isPressed())
+    // Pull edge timestamps out of the ring for speed / cadence. This never blocks the ISR.
+    int64_t edgeTimeUs;
+    while (hallEdgeTimes.pop(edgeTimeUs))
     {
-      hallEffectCount++;
-      totalDistance += hallEffectRunDistanceMultiplier;
-      if (DEBUG_DIST)
+      traceRecorder.record(edgeTimeUs, TraceEvent::HALL_EDGE, 0);
+      wheel.addEdgeTime(edgeTimeUs);
+#if PERF_ENABLED
+      // An edge newer than the pulse counter read only gets counted next loop, leave it out rather than guess
+      if (edgeTimeUs <= countedUs)
       {
-        Serial.println("distance:");
-        Serial.print("\t");
-        Serial.println(hallEffectCount * hallEffectRunDistanceMultiplier);
-        Serial.println("distance threshold:");
-        Serial.print("\t");
-        Serial.println(distanceThreshold);
-        Serial.println("");
+        edgeToCountLatency.record(countedUs - edgeTimeUs);
       }
+#endif
+    }
+
+#if PERF_ENABLED
+    if (notifyBits & MAIN_NOTIFY_PERF_RESET)
+    {
+      edgeToCountLatency.reset();
+      beamToStopLatency.reset();
+      beamToLoopStopLatency.reset();
+    }
+#endif
+
+    // Everything else - when a treat is earned, the dispenser, running out of treats - is in wheelController.h
+    bool telemetryChanged = wheel.update(now, nowUs);
+    dispenseBeamWatched.store(wheel.dispenser().watchingBeam(now), std::memory_order_relaxed);
+    traceRecorder.observe(wheel, halMicros());
+
+    if ((notifyBits & MAIN_NOTIFY_TRACE_STOP) && traceRecorder.recording())
+    {
+      traceRecorder.stop();
+      xTaskNotifyGive(traceTaskHandle);
+    }
+
+    // Keep the copy in RTC memory current, so a reset doesn't lose anything (see rtcCounters.h)
+    if (wheel.hallEffectCount() != mirroredHallEffectCount || wheel.totalDistance() != mirroredDistance || wheel.totalTreats() != mirroredTreats)
+    {
+      mirroredHallEffectCount = wheel.hallEffectCount();
+      mirroredDistance = wheel.totalDistance();
+      mirroredTreats = wheel.totalTreats();
+      rtcCounters.write(mirroredDistance, mirroredTreats, mirroredHallEffectCount);
     }
 
-    if ((!outOfTreats && hallEffectCount * hallEffectRunDistanceMultiplier >= distanceThreshold) || forceDispense)
+    publishTelemetrySnapshot();
+
+    if (telemetryChanged && webTaskHandle != NULL)
+    {
+      xTaskNotifyGive(webTaskHandle);
+    }
+    if ((notifyBits & MAIN_NOTIFY_RESET_STATS) && statsTaskHandle != NULL)
     {
-      hallEffectCount = 0;
-      forceDispense = false;
-      dispenseTreat();
+      xTaskNotifyGive(statsTaskHandle); // save the reset straight away
     }
-    vTaskDelay(5 / portTICK_PERIOD_MS); // Delay for 5ms
   }
 }
 
-void saveStatisticsTask(void *pvParameters)
+// Called by mainTask, so the header and the first records are all from the same moment
+void startTrace(int64_t nowUs)
 {
-  // This is for logging on device. in the future it would probably be good to see if theres a newer value we can read back off from mqtt, but eh - good enough for now.
-  // because MCU's have limited write cycles to their memory, we want to limit how often we store our values. Assuming we write once every 30 min, and memory fails at 100k writes, this shouldn't be an issue for ~5.75 years.
-  // We also only write if values change.
+  TraceRecorder::fillHeader(traceHeader, wheel, hallEffectMagnetCount, WHEEL_SESSION_GAP_MS, WHEEL_MIN_EDGE_INTERVAL_US, DISPENSE_COALESCE_MS,
+                            DISPENSE_MIN_INTERVAL_MS, DISPENSE_MAX_PER_REQUEST, nowUs);
+  TraceSink sink = {pushTraceRecord};
+  traceRecorder.start(sink, traceHeader, wheel);
+  xTaskNotifyGive(traceTaskHandle);
+}
 
-  uint32_t lastSavedTotalDistance = 0;
-  uint32_t lastSavedTotalTreatsDispensed = 0;
+bool pushTraceRecord(const TraceRecord &record)
+{
+  return traceRing.push(record);
+}
 
-  Serial.println("[stats saver]: task starting...");
+// Writes the trace out to SPIFFS, a batch at a time, while one is being recorded. Starting a trace replaces the last one.
+void traceTask(void *pvParameters)
+{
+  Serial.println("[trace]: task starting...");
 
+  File file;
   while (true)
   {
-    if (totalDistance > lastSavedTotalDistance)
+    ulTaskNotifyTake(pdTRUE, traceWriting ? pdMS_TO_TICKS(250) : portMAX_DELAY);
+    bool recording = traceRecorder.recording();
+
+    if (recording && !traceWriting)
+    {
+      file = SPIFFS.begin(true) ? SPIFFS.open(TRACE_FILE, FILE_WRITE) : File();
+      if (file)
+      {
+        traceBytes = file.write((const uint8_t *)&traceHeader, sizeof(traceHeader));
+        Serial.println("[trace] - recording");
+      }
+      else
+      {
+        // carry on as if we were writing, so whatever mainTask records until it stops gets drained and thrown away
+        Serial.println("[trace] - couldn't create the trace file");
+        xTaskNotify(mainTaskHandle, MAIN_NOTIFY_TRACE_STOP, eSetBits);
+        traceBytes = 0;
+      }
+      traceWriting = true;
+    }
+    if (!traceWriting)
+    {
+      continue;
+    }
+
+    TraceRecord batch[32];
+    size_t count = 0;
+    while (traceRing.pop(batch[count]))
+    {
+      if (++count == 32)
+      {
+        traceBytes += file.write((const uint8_t *)batch, sizeof(batch));
+        count = 0;
+      }
+    }
+    if (count > 0)
+    {
+      traceBytes += file.write((const uint8_t *)batch, count * sizeof(TraceRecord));
+    }
+
+    if (recording && traceBytes >= TRACE_MAX_BYTES)
     {
-      preferences.begin("conf", false);
-      preferences.putInt("totalDistance", lastSavedTotalDistance);
-      preferences.end();
-      lastSavedTotalDistance = totalDistance;
+      Serial.println("[trace] - trace file is full, stopping");
+      xTaskNotify(mainTaskHandle, MAIN_NOTIFY_TRACE_STOP, eSetBits);
     }
-    if (totalTreatsDispensed > lastSavedTotalTreatsDispensed)
+    if (!recording)
     {
-      preferences.begin("conf", false);
-      preferences.putInt("totalTreatsDispensed", lastSavedTotalTreatsDispensed);
-      preferences.end();
-      lastSavedTotalTreatsDispensed = totalTreatsDispensed;
+      // mainTask stopped before we looked, so everything it recorded was already in the ring and is written now
+      if (file)
+      {
+        file.close();
+      }
+      traceWriting = false;
+      Serial.printf("[trace] - stopped, %lu bytes, %lu records lost\n", (unsigned long)traceBytes, (unsigned long)traceRecorder.lost());
     }
-    vTaskDelay(pdMS_TO_TICKS(1800000)); // 30 minutes
   }
 }
 
-void wifiManagerTask(void *pvParameters)
+// Hands the other tasks a fresh copy of the counters, if anything in it changed. mainTask is the only caller once it's
+//   running (setup() calls it once before that), which is what the seqlock needs - one writer at a time.
+void publishTelemetrySnapshot()
 {
-  Serial.println("[wifiManager]: task starting...");
+  static TelemetrySnapshot lastPublished;
+  static bool published = false;
+
+  TelemetrySnapshot snapshot;
+  memset(&snapshot, 0, sizeof(snapshot)); // padding too, so memcmp below works
+  snapshot.totalDistance = wheel.totalDistance();
+  snapshot.totalTreats = wheel.totalTreats();
+  snapshot.progressDistance = wheel.progressDistance();
+  snapshot.speed = wheel.wheelSpeed().speedCmPerSec();
+  snapshot.peakSpeed = wheel.wheelSpeed().peakCmPerSec();
+  snapshot.cadence = wheel.wheelSpeed().sessionCadenceRpm();
+  snapshot.outOfTreats = wheel.outOfTreats();
+  snapshot.hopperEmpty = wheel.hopperEmpty();
+  snapshot.dispensing = wheel.dispensing();
+  snapshot.dispenseProfile = wheel.dispenser().profile().state();
+  snapshot.dispenseStats = wheel.dispenser().profile().stats();
+
+  if (published && memcmp(&snapshot, &lastPublished, sizeof(snapshot)) == 0)
+  {
+    return;
+  }
+  telemetry.write(snapshot);
+  lastPublished = snapshot;
+  published = true;
+}
+
+void saveStatisticsTask(void *pvParameters)
+{
+  // Checkpoints the totals every few seconds while they're changing, and not at all while the wheel sits still.
+  //   The journal spreads those writes over its whole partition, so this is easy on the flash (see statsJournal.h).
+  // Without the journal we're writing to Preferences instead, and go back to only doing that every 30 minutes.
+  // Resetting the stats notifies us, so that gets saved straight away either way.
+
+  TelemetrySnapshot startup = telemetry.read();
+  uint32_t lastSavedTotalDistance = startup.totalDistance;
+  uint32_t lastSavedTotalTreatsDispensed = startup.totalTreats;
+  uint32_t lastPreferencesSave = millis();
+  uint32_t lastSavedProfileLearned = startup.dispenseProfile.learned;
+
+  Serial.println("[stats saver]: task starting...");
+
   while (true)
   {
-    if (strlen(config.ssid))
+    bool forced = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STATS_CHECKPOINT_MS)) > 0;
+
+    TelemetrySnapshot snapshot = telemetry.read();
+
+    // The learned dispense profile only moves a little with each treat, so every so many is plenty
+    if (snapshot.dispenseProfile.learned - lastSavedProfileLearned >= DISPENSE_PROFILE_SAVE_EVERY)
     {
-      connectToWiFi();
-      if (networkState != NetworkState::CONNECTED)
+      if (halNvsWriteBlob("dispense", "profile", &snapshot.dispenseProfile, sizeof(DispenseProfileState)))
       {
-        Serial.println("[wifiManager]: wifi not connected, starting config AP");
-        startAPMode();
+        lastSavedProfileLearned = snapshot.dispenseProfile.learned;
       }
     }
-    else
+
+    uint32_t distance = snapshot.totalDistance;
+    uint32_t treats = snapshot.totalTreats;
+    if (distance == lastSavedTotalDistance && treats == lastSavedTotalTreatsDispensed)
     {
-      Serial.println("[wifiManager]: wifi not configured, starting config AP");
-      startAPMode();
+      continue;
     }
 
-    // Maintain connection
-    while (true)
+    if (statsJournalReady)
     {
-      uint8_t currentConnectionStatus = WiFi.status();
-      if (networkState == NetworkState::CONNECTED && currentConnectionStatus != WL_CONNECTED)
+      if (!statsJournal.append(distance, treats))
       {
-        Serial.println("Detected problem with wifi - reconnecting");
-        networkState = NetworkState::DISCONNECTED;
+        Serial.println("[stats saver]: journal write failed");
+        continue;
       }
-
-      WiFiConfig recv_msg;
-      if (xQueueReceive(wifiQueue, &recv_msg, pdMS_TO_TICKS(100)) == pdTRUE)
+    }
+    else
+    {
+      if (!forced && millis() - lastPreferencesSave < STATS_PREFERENCES_CHECKPOINT_MS)
       {
-        // Handle messages from web server
-        Serial.println("[wifiManager]: new wifi credentials received, saving...");
-        strncpy(config.ssid, recv_msg.ssid, sizeof(config.ssid));
-        strncpy(config.password, recv_msg.password, sizeof(config.password));
-        saveWifi();
-        WiFi.disconnect(true);
-        WiFi.mode(WIFI_MODE_STA);
-        networkState = NetworkState::DISCONNECTED;
+        continue;
       }
+      halNvsWriteInt("conf", "totalDistance", distance);
+      halNvsWriteInt("conf", "totalTreatsDispensed", treats);
+      lastPreferencesSave = millis();
+    }
+    lastSavedTotalDistance = distance;
+    lastSavedTotalTreatsDispensed = treats;
+  }
+}
 
-      // If the network state has been changed to DISCONNECTED, break out of our loop to reconnect
-      if (networkState == NetworkState::DISCONNECTED)
-      {
-        Serial.println("WiFi set to disconnect");
-        WiFi.disconnect(true);
-        break;
-      }
+// Flash access for the stats journal, offsets are relative to the start of the journal partition
+bool statsJournalRead(uint32_t offset, void *buffer, size_t length)
+{
+  return esp_partition_read(statsPartition, offset, buffer, length) == ESP_OK;
+}
 
-      vTaskDelay(pdMS_TO_TICKS(200));
-    }
-    vTaskDelay(pdMS_TO_TICKS(200));
+bool statsJournalWrite(uint32_t offset, const void *buffer, size_t length)
+{
+  return esp_partition_write(statsPartition, offset, buffer, length) == ESP_OK;
+}
+
+bool statsJournalErase(uint32_t offset)
+{
+  return esp_partition_erase_range(statsPartition, offset, StatsJournal::SECTOR_SIZE) == ESP_OK;
+}
+
+// Called from setup() after loadStatistics(). After anything short of a power cut (crash, watchdog, restart after an
+//   update, brownout) RTC memory still holds the counters from the moment we went down, which is newer than the last
+//   journal checkpoint - so take those, including the progress towards the next treat, and journal them straight away.
+//   That is also our brownout flush: the brownout handler resets the chip immediately and the flash can't be trusted at
+//   that voltage anyway, so the RTC copy carries the counters over and they get written here once the supply is back.
+void restoreRtcCounters()
+{
+  esp_reset_reason_t reason = esp_reset_reason();
+  RtcCounters saved;
+  if (reason == ESP_RST_POWERON || !rtcCounters.restore(saved))
+  {
+    rtcCounters.write(wheel.totalDistance(), wheel.totalTreats(), 0);
+    return;
+  }
+
+  Serial.printf("[stats]: restored counters from RTC memory (reset reason %d, %lu cm towards the next treat)\n", (int)reason,
+                (unsigned long)(saved.hallEffectCount * hallEffectRunDistanceMultiplier));
+  bool newerThanJournal = saved.totalDistance != wheel.totalDistance() || saved.totalTreats != wheel.totalTreats();
+  wheel.setCounters(saved.totalDistance, saved.totalTreats, saved.hallEffectCount);
+  if (statsJournalReady && newerThanJournal)
+  {
+    statsJournal.append(saved.totalDistance, saved.totalTreats);
   }
 }
 
-void webServerTask(void *pvParameters)
+// Called from setup() after the Preferences have been read. Picks up the newest totals from the journal, or starts the
+//   journal off with what was in Preferences if this is the first boot since it was added.
+void loadStatistics()
 {
-  Serial.println("[webServer]: task starting...");
-  AsyncWebServer server(80);
+  statsPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "journal");
+  if (statsPartition == NULL)
+  {
+    Serial.println("[stats]: no journal partition, saving stats to preferences instead");
+    return;
+  }
+
+  JournalFlash flash = {statsJournalRead, statsJournalWrite, statsJournalErase, statsPartition->size};
+  StatsRecord latest;
+  if (statsJournal.recover(flash, latest))
+  {
+    wheel.setCounters(latest.totalDistance, latest.totalTreats, 0);
+    Serial.printf("[stats]: restored checkpoint %lu from journal\n", (unsigned long)latest.sequence);
+  }
+  else
+  {
+    Serial.println("[stats]: journal empty, starting it from saved preferences");
+    statsJournal.append(wheel.totalDistance(), wheel.totalTreats());
+  }
+  statsJournalReady = true;
+}
+
+// The dispenser's learned motor speed profile (see dispenseProfile.h), saved by saveStatisticsTask. Without one it
+//   runs at full speed and learns from scratch.
+void loadDispenseProfile()
+{
+  DispenseProfileState saved;
+  if (halNvsReadBlob("dispense", "profile", &saved, sizeof(saved)) && wheel.dispenser().profile().restore(saved))
+  {
+    Serial.printf("[stats]: dispense profile restored, treats after %lums (+-%lums) of motor travel\n", (unsigned long)saved.expectedMs,
+                  (unsigned long)saved.deviationMs);
+  }
+}
+
+void wifiManagerTask(void *pvParameters)
+{
+  Serial.println("[wifiManager]: task starting...");
+
+  // We do our own reconnecting (with backoff), so don't let the driver retry behind our back
+  WiFi.onEvent(onWifiEvent);
+  WiFi.setAutoReconnect(false);
+
+  Backoff reconnectBackoff;
+  reconnectBackoff.configure(WIFI_RETRY_BASE_MS, WIFI_RETRY_MAX_MS);
+  bool everConnected = false; // once we've made it onto the network the credentials are good, so don't fall back to AP mode after that
+  uint32_t firstAttemptMs = millis();
+  uint32_t attemptStartMs = firstAttemptMs;
+  uint32_t retryAtMs = 0;
+  bool directedAttempt = false; // this attempt is going straight to the cached access point
+  bool directedRetry = false;   // the next retry should try the cached access point first
+
+  if (strlen(config.ssid))
+  {
+    bootTimeline.wifiStartMs = millis();
+    directedAttempt = networkCacheValid;
+    connectToWiFi(directedAttempt);
+  }
+  else
+  {
+    Serial.println("[wifiManager]: wifi not configured, starting config AP");
+    startAPMode();
+  }
 
-  bool serverRunning = false;
   while (true)
   {
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    // Sleep until the driver or the web server tells us something, or until the connect timeout / next retry is due
+    uint32_t now = millis();
+    TickType_t wait = portMAX_DELAY;
+    uint32_t attemptTimeoutMs = directedAttempt ? WIFI_DIRECTED_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS;
+    if (networkState == NetworkState::CONNECTING)
+    {
+      int32_t remaining = (int32_t)(attemptStartMs + attemptTimeoutMs - now);
+      wait = remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+    }
+    else if (networkState == NetworkState::DISCONNECTED)
+    {
+      int32_t remaining = (int32_t)(retryAtMs - now);
+      wait = remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+    }
 
-    // Only start server if we're in the right state
-    if ((networkState == NetworkState::AP_MODE || networkState == NetworkState::CONNECTED) && !serverRunning)
+    WifiEvent event;
+    bool gotEvent = xQueueReceive(wifiEventQueue, &event, wait) == pdTRUE;
+    now = millis();
+    bool attemptFailed = false;
+
+    if (gotEvent)
     {
-      setupWebServerRoutes(server);
-      serverRunning = true;
-      server.begin();
-      Serial.println("[webServer]: Server started");
+      switch (event.type)
+      {
+      case WifiEventType::GOT_IP:
+        if (networkState == NetworkState::CONNECTING || networkState == NetworkState::DISCONNECTED)
+        {
+          everConnected = true;
+          reconnectBackoff.reset();
+          setNetworkState(NetworkState::CONNECTED);
+          Serial.printf("\t[wifiManager]: Connected in %lums%s, ip addr: %s\n", (unsigned long)(now - attemptStartMs), directedAttempt ? " (cached access point)" : "",
+                        WiFi.localIP().toString().c_str());
+          if (bootTimeline.connectedMs == 0)
+          {
+            bootTimeline.connectedMs = now;
+            bootTimeline.fastConnect = directedAttempt;
+          }
+          saveNetworkCache();
+
+          // Real time for the outbox timestamps. SNTP keeps it in sync in the background from here on.
+          static bool clockStarted = false;
+          if (!clockStarted)
+          {
+            configTime(0, 0, "pool.ntp.org");
+            clockStarted = true;
+          }
+        }
+        break;
+
+      case WifiEventType::STA_DISCONNECTED:
+      case WifiEventType::LOST_IP:
+        // ASSOC_LEAVE is just us calling WiFi.disconnect(), not a problem with the network
+        if (event.type == WifiEventType::STA_DISCONNECTED && event.reason == WIFI_REASON_ASSOC_LEAVE)
+        {
+          break;
+        }
+        if (networkState == NetworkState::CONNECTED)
+        {
+          Serial.printf("[wifiManager]: lost connection (reason %u) - reconnecting\n", event.reason);
+          directedRetry = networkCacheValid; // most likely the same access point just blipped
+          attemptFailed = true;
+        }
+        else if (networkState == NetworkState::CONNECTING)
+        {
+          Serial.printf("\t[wifiManager]: Connection failed (reason %u)\n", event.reason);
+          attemptFailed = true;
+        }
+        break;
+
+      case WifiEventType::SCAN_REQUESTED:
+        startWifiScan();
+        break;
+
+      case WifiEventType::SCAN_DONE:
+        finishWifiScan();
+        break;
+
+      case WifiEventType::NEW_CREDENTIALS:
+      {
+        WifiSetupMessage recv_msg;
+        if (xQueueReceive(wifiQueue, &recv_msg, 0) == pdTRUE)
+        {
+          // Handle messages from web server
+          Serial.println("[wifiManager]: new wifi credentials received, saving...");
+          strncpy(config.ssid, recv_msg.wifi.ssid, sizeof(config.ssid));
+          strncpy(config.password, recv_msg.wifi.password, sizeof(config.password));
+          staticIp = recv_msg.staticIp;
+          saveWifi();
+          clearNetworkCache(); // different network, the old access point is no use to us
+          WiFi.disconnect(true);
+          WiFi.mode(WIFI_MODE_STA);
+
+          // brand new credentials, so they get the same chance to prove themselves as the ones we booted with
+          everConnected = false;
+          reconnectBackoff.reset();
+          firstAttemptMs = now;
+          attemptStartMs = now;
+          directedAttempt = false;
+          connectToWiFi(false);
+        }
+        break;
+      }
+
+      case WifiEventType::TRIAL_MODE:
+        if (networkState == NetworkState::AP_MODE)
+        {
+          setNetworkState(NetworkState::TRIAL_MODE);
+        }
+        break;
+      }
     }
-    else if (networkState == NetworkState::DISCONNECTED && serverRunning)
+    else if (networkState == NetworkState::CONNECTING && now - attemptStartMs >= attemptTimeoutMs)
     {
-      serverRunning = false;
-      server.end();
-      Serial.println("[webServer]: Server stopped");
+      Serial.println("\t[wifiManager]: Connection attempt timed out");
+      attemptFailed = true;
+    }
+    else if (networkState == NetworkState::DISCONNECTED && (int32_t)(now - retryAtMs) >= 0)
+    {
+      attemptStartMs = now;
+      directedAttempt = directedRetry;
+      directedRetry = false;
+      connectToWiFi(directedAttempt);
+    }
+
+    if (attemptFailed && directedAttempt)
+    {
+      // The cached access point didn't work out (moved channel, replaced router...), go straight on to a normal
+      //   connect with a full scan rather than waiting out a backoff
+      Serial.println("\t[wifiManager]: cached access point didn't answer, scanning for the network instead");
+      WiFi.disconnect();
+      attemptStartMs = now;
+      directedAttempt = false;
+      connectToWiFi(false);
     }
+    else if (attemptFailed)
+    {
+      if (!everConnected && now - firstAttemptMs >= WIFI_CONNECT_TIMEOUT_MS)
+      {
+        Serial.println("[wifiManager]: wifi not connected, starting config AP");
+        startAPMode();
+      }
+      else
+      {
+        WiFi.disconnect();
+        uint32_t delayMs = reconnectBackoff.nextDelayMs(esp_random());
+        retryAtMs = now + delayMs;
+        setNetworkState(NetworkState::DISCONNECTED);
+        Serial.printf("\t[wifiManager]: retrying in %lums (attempt %lu)\n", (unsigned long)delayMs, (unsigned long)reconnectBackoff.attempts());
+      }
+    }
+  }
+}
+
+// Runs in the Arduino WiFi event task, so keep it short and just pass the event on to wifiManagerTask
+void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  WifiEvent wifiEvent = {WifiEventType::GOT_IP, 0};
+  switch (event)
+  {
+  case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+    break;
+  case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+    wifiEvent.type = WifiEventType::LOST_IP;
+    break;
+  case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    wifiEvent.type = WifiEventType::STA_DISCONNECTED;
+    wifiEvent.reason = info.wifi_sta_disconnected.reason;
+    break;
+  case ARDUINO_EVENT_WIFI_SCAN_DONE:
+    wifiEvent.type = WifiEventType::SCAN_DONE;
+    break;
+  default:
+    return;
+  }
+  xQueueSend(wifiEventQueue, &wifiEvent, 0);
+}
+
+// For the other tasks (ie the web server) to poke wifiManagerTask
+void postWifiEvent(WifiEventType type)
+{
+  WifiEvent wifiEvent = {type, 0};
+  xQueueSend(wifiEventQueue, &wifiEvent, 0);
+}
+
+// Only called from wifiManagerTask. The web server gets a nudge so it can start or stop straight away.
+void setNetworkState(NetworkState state)
+{
+  if (networkState == state)
+  {
+    return;
+  }
+  networkState = state;
+  if (webTaskHandle != NULL)
+  {
+    xTaskNotifyGive(webTaskHandle);
+  }
+  notifyMqttTask();
+}
+
+// Wake the mqtt task up so it looks at the network state and settings again, rather than on its next timeout
+void notifyMqttTask()
+{
+  if (mqttTaskHandle != NULL)
+  {
+    xTaskNotifyGive(mqttTaskHandle);
+  }
+}
+
+void webServerTask(void *pvParameters)
+{
+  Serial.println("[webServer]: task starting...");
+  AsyncWebServer server(80);
+
+  bool serverRunning = false;
+  bool routesConfigured = false;
+  uint32_t lastTelemetryPush = 0;
+  TelemetryState lastTelemetry = {};
+
+  while (true)
+  {
+    // mainTask wakes us up when there is new telemetry, otherwise we just check on the network once a second
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+    // Only start server if we're in the right state
+    if ((networkState == NetworkState::AP_MODE || networkState == NetworkState::CONNECTED) && !serverRunning)
+    {
+      if (!routesConfigured)
+      {
+        setupWebServerRoutes(server);
+        routesConfigured = true;
+      }
+      serverRunning = true;
+      server.begin();
+      Serial.println("[webServer]: Server started");
+
+      if (bootTimeline.httpReadyMs == 0 && networkState == NetworkState::CONNECTED)
+      {
+        bootTimeline.httpReadyMs = millis();
+        Serial.printf("[boot] wifi started at %lums, connected at %lums (%s), http ready at %lums\n", (unsigned long)bootTimeline.wifiStartMs,
+                      (unsigned long)bootTimeline.connectedMs, bootTimeline.fastConnect ? "cached access point" : "full scan", (unsigned long)bootTimeline.httpReadyMs);
+      }
+    }
+    else if (networkState == NetworkState::DISCONNECTED && serverRunning)
+    {
+      serverRunning = false;
+      server.end();
+      Serial.println("[webServer]: Server stopped");
+    }
+
+    if (serverRunning && telemetryEvents.count() > 0)
+    {
+      // Rate limit. Anything else that changes while we wait here goes out in the same update.
+      uint32_t sinceLastPush = millis() - lastTelemetryPush;
+      if (sinceLastPush < TELEMETRY_PUSH_INTERVAL_MS)
+      {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_PUSH_INTERVAL_MS - sinceLastPush));
+      }
+
+      TelemetryState telemetry;
+      readTelemetryState(telemetry);
+      char json[256];
+      if (buildTelemetryDeltaJson(lastTelemetry, telemetry, json, sizeof(json)) > 0)
+      {
+        telemetryEvents.send(json, "delta", millis());
+        lastTelemetryPush = millis();
+      }
+      lastTelemetry = telemetry;
+    }
+  }
+}
+
+void mqttServerTask(void *parameter)
+{
+  uint32_t lastMqttPublishTime = 0;
+  int mqttPublishInterval = (1000 * 60 * 5); // every 5 minutes
+
+  // The settings we're connected with. PubSubClient keeps pointers into this (server name), so we hold on to it until
+  //   we reconnect with new settings.
+  ConfigStore::Ref conf = configStore.current();
+  uint32_t confChanges = configStore.changeCount();
+
+  Backoff reconnectBackoff;
+  reconnectBackoff.configure(MQTT_RETRY_BASE_MS, MQTT_RETRY_MAX_MS);
+  uint32_t nextConnectAttempt = millis();
+  bool waitingLogged = false;
+  uint32_t loadWindowsLogged = 0;
+
+  mqttClient.setKeepAlive(MQTT_KEEPALIVE_S);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S); // connect() blocks for up to this long if the broker is slow
+  mqttClient.setCallback(mqttCallback);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
+  mqttTopics.build(conf->mqttPrefix);
+
+  String mac = WiFi.macAddress();
+  mac.replace(":", "");
+  mac.toLowerCase();
+  snprintf(mqttNodeId, sizeof(mqttNodeId), "catwheel_%s", mac.c_str() + (mac.length() > 6 ? mac.length() - 6 : 0));
+
+  // Mounting SPIFFS can take a while the very first time (it formats it), so it happens here rather than in setup()
+  outboxSpillReady = outboxSpillBegin();
+  OutboxSpill spill = {outboxSpillAppend, outboxSpillRead, outboxSpillDrop, outboxSpillCount, outboxSpillReady ? OUTBOX_SPILL_EVENTS : 0};
+  mqttOutbox.begin(spill, OUTBOX_ACK_TIMEOUT_MS);
+
+  mqttTaskLoad.awake(esp_timer_get_time());
+  while (1)
+  {
+    // Log our CPU share once per measuring window
+    if (mqttTaskLoad.windowsCompleted() != loadWindowsLogged)
+    {
+      loadWindowsLogged = mqttTaskLoad.windowsCompleted();
+      Serial.printf("[mqtt] task cpu: %.2f%%\n", mqttTaskLoad.percent());
+    }
+
+    // Settings changed, drop the connection so we come back with the new ones straight away
+    if (configStore.changeCount() != confChanges)
+    {
+      confChanges = configStore.changeCount();
+      conf = configStore.current();
+      if (mqttClient.connected())
+      {
+        mqttDisconnect(); // still on the old topics, so the old availability goes offline
+      }
+      if (!mqttTopics.build(conf->mqttPrefix))
+      {
+        Serial.println("[mqtt] topic prefix is too long, topics have been cut short");
+      }
+      reconnectBackoff.reset();
+      nextConnectAttempt = millis();
+    }
+
+    // New events go in the outbox while mqtt is on, otherwise nobody wants them
+    OutboxEvent event;
+    while (xQueueReceive(outboxQueue, &event, 0) == pdTRUE)
+    {
+      if (conf->mqttEnabled)
+      {
+        mqttOutbox.push(event);
+      }
+    }
+
+    // Can't reach the broker, so anything waiting goes to flash where it survives a reboot
+    if (!mqttClient.connected())
+    {
+      mqttOutbox.connectionLost();
+      mqttOutbox.persist();
+    }
+
+    if (!conf->mqttEnabled || networkState != NetworkState::CONNECTED)
+    {
+      if (mqttClient.connected())
+      {
+        mqttDisconnect();
+      }
+      if (!waitingLogged)
+      {
+        Serial.println("[mqtt] - waiting to be enabled...");
+        waitingLogged = true;
+      }
+      // Both of these notify us when they change, the timeout is just a safety net
+      mqttWaitForNotify(MQTT_IDLE_WAIT_MS);
+      continue;
+    }
+    waitingLogged = false;
+
+    // Reconnect to MQTT if disconnected, spacing the attempts out so a broker that's down doesn't get hammered
+    if (!mqttClient.connected())
+    {
+      uint32_t now = millis();
+      int32_t untilAttempt = (int32_t)(nextConnectAttempt - now);
+      if (untilAttempt > 0)
+      {
+        mqttWaitForNotify(untilAttempt);
+        continue;
+      }
+
+      Serial.print("[mqtt] setting mqtt server host to: ");
+      Serial.println(conf->mqttServer);
+
+      mqttClient.setServer(conf->mqttServer, conf->mqttPort);
+      mqttReconnect(*conf);
+      if (!mqttClient.connected())
+      {
+        uint32_t delayMs = reconnectBackoff.nextDelayMs(esp_random());
+        nextConnectAttempt = millis() + delayMs;
+        Serial.printf("[mqtt] next attempt in %lums\n", (unsigned long)delayMs);
+        continue;
+      }
+      reconnectBackoff.reset();
+      lastMqttPublishTime = millis() - mqttPublishInterval; // refresh the retained state straight away
+    }
+
+    // Let everyone know how their dispense requests went
+    DispenseCompletion completion;
+    while (mqttClient.connected() && xQueueReceive(dispenseResultQueue, &completion, 0) == pdTRUE)
+    {
+      mqttPublishDispenseCompletion(*conf, completion);
+    }
+
+    if (mqttDiscoveryPending && mqttClient.connected())
+    {
+      mqttPublishDiscovery();
+    }
+
+    // Send whatever is waiting in the outbox, oldest first
+    mqttPublishOutbox();
+
+    // Publish usage statistics via MQTT
+    if (mqttClient.connected() && (millis() - lastMqttPublishTime >= mqttPublishInterval))
+    {
+      mqttPublishUsageStats(*conf);
+      lastMqttPublishTime = millis();
+    }
+
+    // Reads one incoming packet if there is one, and sends the keepalive ping when it's due
+    mqttClient.loop();
+
+    // Sleep until the broker sends us something, or the next tick. The tick is what picks up dispense results and
+    //   drives the keepalive, so it has to stay well under MQTT_KEEPALIVE_S.
+    uint32_t waitMs = MQTT_TICK_MS;
+    uint32_t sincePublish = millis() - lastMqttPublishTime;
+    if (sincePublish < (uint32_t)mqttPublishInterval && mqttPublishInterval - sincePublish < waitMs)
+    {
+      waitMs = mqttPublishInterval - sincePublish;
+    }
+    mqttWaitForSocket(waitMs);
+  }
+}
+
+// Blocks until the broker connection has something for us to read, or timeoutMs is up. WiFiClient reads ahead into its
+//   own buffer, so anything already sitting in there counts as readable too (select() can't see it).
+void mqttWaitForSocket(uint32_t timeoutMs)
+{
+  publishMqttStatus();
+  if (espClient.available() > 0)
+  {
+    return;
+  }
+  int fd = espClient.fd();
+  if (fd < 0)
+  {
+    mqttWaitForNotify(timeoutMs);
+    return;
+  }
+
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(fd, &readable);
+  struct timeval timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+  mqttTaskLoad.asleep(esp_timer_get_time());
+  select(fd + 1, &readable, NULL, NULL, &timeout); // an error (ie the connection dropped) shows up in loop() next time round
+  mqttTaskLoad.awake(esp_timer_get_time());
+}
+
+// Only from mqttServerTask
+void publishMqttStatus()
+{
+  MqttStatusSnapshot status;
+  status.connected = mqttClient.connected();
+  status.queued = mqttOutbox.size();
+  status.inFlight = mqttOutbox.inFlight();
+  status.delivered = mqttOutbox.delivered();
+  status.dropped = mqttOutbox.dropped();
+  status.resends = mqttOutbox.resends();
+  mqttStatus.write(status);
+}
+
+// Blocks until someone pokes the mqtt task (network state or settings changed), or timeoutMs is up
+void mqttWaitForNotify(uint32_t timeoutMs)
+{
+  publishMqttStatus();
+  mqttTaskLoad.asleep(esp_timer_get_time());
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+  mqttTaskLoad.awake(esp_timer_get_time());
+}
+
+////////////////////////
+///   Meat Space    ///
+//////////////////////
+// Queue up a dispense from any task. Never blocks - returns the request id, or 0 if too many requests are already waiting.
+uint32_t requestDispense(DispenseSource source, uint8_t count)
+{
+  DispenseRequest request;
+  portENTER_CRITICAL(&dispenseMux);
+  request.id = nextDispenseRequestId++;
+  portEXIT_CRITICAL(&dispenseMux);
+  request.source = source;
+  request.count = count;
+  request.receivedMs = millis();
+
+  if (xQueueSend(dispenseQueue, &request, 0) != pdTRUE)
+  {
+    Serial.printf("[main] - dispense request %u from %s dropped, queue full\n", request.id, dispenseSourceName(source));
+    DispenseCompletion completion = {request.id, source, DispenseStatus::REJECTED, count, 0, 0};
+    reportDispenseCompletion(completion);
+    return 0;
+  }
+  return request.id;
+}
+
+// Called by mainTask when a request is finished with. Keeps a copy for the web UI, and hands it to the mqtt task to publish.
+void reportDispenseCompletion(const DispenseCompletion &completion)
+{
+  Serial.printf("[main] - dispense request %u from %s: %s (%u/%u)\n", completion.id, dispenseSourceName(completion.source), dispenseStatusName(completion.status), completion.dispensed, completion.requested);
+
+  portENTER_CRITICAL(&dispenseMux);
+  recentDispenseCompletions[recentDispenseCompletionsNext] = completion;
+  recentDispenseCompletionsNext = (recentDispenseCompletionsNext + 1) % RECENT_DISPENSE_COMPLETIONS;
+  portEXIT_CRITICAL(&dispenseMux);
+
+  // if mqtt is off nobody drains this queue, so just drop the event rather than wait
+  xQueueSend(dispenseResultQueue, &completion, 0);
+
+  uint32_t packed = completion.requested | (completion.dispensed << 8) | ((uint32_t)completion.source << 16) | ((uint32_t)completion.status << 24);
+  recordOutboxEvent(OutboxEventType::DISPENSE, completion.id, packed, completion.mergedInto);
+}
+
+// Hands an event to the mqtt task for the outbox. Fine to call from any task, never blocks.
+void recordOutboxEvent(OutboxEventType type, uint32_t value0, uint32_t value1, uint32_t value2)
+{
+  OutboxEvent event = {};
+  portENTER_CRITICAL(&outboxMux);
+  event.sequence = nextOutboxSequence++;
+  portEXIT_CRITICAL(&outboxMux);
+  event.bootId = bootId;
+  event.uptimeMs = millis();
+  event.time = unixTimeNow();
+  event.type = type;
+  event.values[0] = value0;
+  event.values[1] = value1;
+  event.values[2] = value2;
+
+  if (xQueueSend(outboxQueue, &event, 0) != pdTRUE)
+  {
+    Serial.printf("[main] - outbox event %lu dropped, queue full\n", (unsigned long)event.sequence);
+  }
+}
+
+// Seconds since 1970, or 0 if SNTP hasn't set the clock yet
+uint32_t unixTimeNow()
+{
+  time_t now = time(NULL);
+  return now > 1600000000 ? (uint32_t)now : 0;
+}
+
+bool findDispenseCompletion(uint32_t id, DispenseCompletion &completion)
+{
+  bool found = false;
+  portENTER_CRITICAL(&dispenseMux);
+  for (int i = 0; i < RECENT_DISPENSE_COMPLETIONS; i++)
+  {
+    if (id != 0 && recentDispenseCompletions[i].id == id)
+    {
+      completion = recentDispenseCompletions[i];
+      found = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&dispenseMux);
+  return found;
+}
+
+// Hardware side of the dispenser state machine (see dispenser.h), mainTask advances it every loop
+void setDispenserSensorLeds(bool on)
+{
+  traceRecorder.record(halMicros(), TraceEvent::LEDS, on);
+  halDigitalWrite(hopperLightBreakSensorLEDPin, on);
+  halDigitalWrite(dispenseLightBreakSensorLEDPin, on);
+}
+
+void setDispenserMotor(int microseconds)
+{
+  static bool started = false; // told to run since the last stop
+  traceRecorder.record(halMicros(), TraceEvent::SERVO, microseconds);
+  bool running = microseconds != TreatDispenser::MOTOR_STOP_US;
+#if PERF_ENABLED
+  if (running && !started)
+  {
+    fastStopLatencyUs.store(0, std::memory_order_relaxed);
+  }
+#endif
+
+  // Once it's running the dispense ISR can stop it without waiting for us (see motorHandoff). The dispenser changes
+  //   speed along the way (see dispenseProfile.h), which mustn't start it again if that stop has already happened.
+  //   motorStopTask only ever holds the servo for one write, so waiting out STOPPING is a few microseconds at most.
+  MotorHandoff state = motorHandoff.load();
+  while (state == MotorHandoff::STOPPING || !motorHandoff.compare_exchange_weak(state, MotorHandoff::CHANGING))
+  {
+    state = motorHandoff.load();
+  }
+  bool write = !running || !started || state != MotorHandoff::STOPPED;
+  if (write)
+  {
+    halServoWrite(microseconds);
+  }
+  MotorHandoff changing = MotorHandoff::CHANGING;
+  if (!motorHandoff.compare_exchange_strong(changing, running && write ? MotorHandoff::ARMED : MotorHandoff::STOPPED))
+  {
+    halServoWrite(TreatDispenser::MOTOR_STOP_US); // the beam went while we were writing
+    motorHandoff.store(MotorHandoff::STOPPED);
+  }
+  started = running;
+
+#if PERF_ENABLED
+  if (!running)
+  {
+    motorStopUs = halMicros();
+  }
+#endif
+}
+
+// The rest of what the wheel controller needs from us (see wheelController.h)
+void setErrorLed(bool on)
+{
+  halDigitalWrite(errorLEDPin, on);
+}
+
+bool takeDispenseRequest(DispenseRequest &request)
+{
+  if (xQueueReceive(dispenseQueue, &request, 0) != pdTRUE)
+  {
+    return false;
+  }
+  traceRecorder.record(halMicros(), TraceEvent::REQUEST, (uint32_t)request.source | (request.count << 8));
+  return true;
+}
+
+void logLine(const char *message)
+{
+  Serial.println(message);
+}
+
+////////////////////////
+///    Commands     ///
+//////////////////////
+
+// The one place commands get carried out, for the web UI and MQTT alike (see commands.h). Anything the command has
+//   to say back goes into `result`, which the caller has already opened as a JSON object.
+CommandResult runCommand(const char *name, const CommandArgs &args, DispenseSource from, JsonWriter &result)
+{
+  char value[16];
+
+  if (strcmp(name, "dispense") == 0)
+  {
+    long count = 1;
+    if (args.get("count", value, sizeof(value)) >= 0)
+    {
+      count = atol(value);
+      if (count < 1)
+      {
+        return {CommandStatus::BAD_REQUEST, "count has to be at least 1", 0};
+      }
+      if (count > DISPENSE_MAX_PER_REQUEST)
+      {
+        return {CommandStatus::BAD_REQUEST, "count is more treats than one request can ask for (DISPENSE_MAX_PER_REQUEST)", 0};
+      }
+    }
+    uint32_t requestId = requestDispense(from, count);
+    if (requestId == 0)
+    {
+      return {CommandStatus::BUSY, "Too many treats are already waiting to be dispensed, try again in a bit", 0};
+    }
+    result.field("requestId", requestId);
+    return {CommandStatus::OK, NULL, requestId};
+  }
+
+  if (strcmp(name, "setConfig") == 0)
+  {
+    // Try the arguments out on a scratch copy first, so a bad one is caught before anything gets published. Then do
+    //   it for real on top of whatever is current (see appConfig.h), the mqtt task notices and reconnects by itself.
+    //   The web server and the mqtt task can both get here, the mutex keeps them from saving on top of each other.
+    xSemaphoreTake(commandConfigMutex, portMAX_DELAY);
+    AppConfig scratch = *configStore.current();
+    const char *error = applyConfigArgs(args, scratch);
+    AppConfig before, after;
+    if (error == NULL)
+    {
+      error = configStore.update([&](AppConfig &next)
+                                 { applyConfigArgs(args, next); },
+                                 &before, &after);
+    }
+    if (error == NULL)
+    {
+      Serial.println(after.mqttEnabled ? "Enabling MQTT" : "Disabling MQTT");
+      saveConfig(before, after, false);
+    }
+    xSemaphoreGive(commandConfigMutex);
+    if (error != NULL)
+    {
+      return {CommandStatus::BAD_REQUEST, error, 0};
+    }
+
+    notifyMqttTask();
+    result.field("version", after.version);
+    return {CommandStatus::OK, NULL, after.version};
+  }
+
+  if (strcmp(name, "resetErrors") == 0)
+  {
+    xTaskNotify(mainTaskHandle, MAIN_NOTIFY_RESET_ERRORS, eSetBits);
+    return {CommandStatus::OK, NULL, 0};
+  }
+
+  if (strcmp(name, "resetStats") == 0)
+  {
+    xTaskNotify(mainTaskHandle, MAIN_NOTIFY_RESET_STATS, eSetBits);
+    return {CommandStatus::OK, NULL, 0};
+  }
+
+  if (strcmp(name, "traceStart") == 0)
+  {
+    if (traceRecorder.recording() || traceWriting)
+    {
+      return {CommandStatus::BUSY, "A trace is already being recorded", 0};
+    }
+    xTaskNotify(mainTaskHandle, MAIN_NOTIFY_TRACE_START, eSetBits);
+    return {CommandStatus::OK, NULL, 0};
+  }
+
+  if (strcmp(name, "traceStop") == 0)
+  {
+    xTaskNotify(mainTaskHandle, MAIN_NOTIFY_TRACE_STOP, eSetBits);
+    return {CommandStatus::OK, NULL, 0};
+  }
+
+#if PERF_ENABLED
+  if (strcmp(name, "getPerf") == 0)
+  {
+    writePerfFields(result);
+    return {CommandStatus::OK, NULL, 0};
+  }
+
+  if (strcmp(name, "resetPerf") == 0)
+  {
+    xTaskNotify(mainTaskHandle, MAIN_NOTIFY_PERF_RESET, eSetBits);
+    return {CommandStatus::OK, NULL, 0};
+  }
+#endif
+
+  if (strcmp(name, "getState") == 0)
+  {
+    ConfigStore::Ref conf = configStore.current();
+    writeStatusFields(result);
+    result.field("mainTaskStackFree", mainTaskHandle != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(mainTaskHandle) : 0); // bytes never used so far
+    result.beginObject("config")
+        .field("version", conf->version)
+        .field("distanceThreshold", conf->distanceThreshold / 100)
+        .field("mqttEnabled", conf->mqttEnabled)
+        .field("mqttServer", conf->mqttServer)
+        .field("mqttPort", conf->mqttPort)
+        .field("mqttUsername", conf->mqttUser)
+        .field("mqttTopicPrefix", conf->mqttPrefix)
+        .field("mqttPerFieldTopics", conf->mqttPerFieldTopics)
+        .endObject();
+    return {CommandStatus::OK, NULL, 0};
+  }
+
+  return {CommandStatus::UNKNOWN, "Unknown command", 0};
+}
+
+// Copies whichever settings are in `args` over `config`, anything not mentioned stays as it was. The names are the
+//   ones from the settings form. Returns NULL, or what's wrong with the arguments.
+const char *applyConfigArgs(const CommandArgs &args, AppConfig &config)
+{
+  char value[128];
+
+  if (args.get("distanceThreshold", value, sizeof(value)) >= 0)
+  {
+    //we expect a dist in meters, but internally use cm
+    long meters = strtol(value, NULL, 10);
+    if (meters > (long)(UINT32_MAX / 100))
+    {
+      return "The distance per treat is too far"; // it wouldn't fit in cm
+    }
+    config.distanceThreshold = meters > 0 ? (uint32_t)meters * 100 : 0;
+  }
+
+  if (args.get("mqttPort", value, sizeof(value)) >= 0)
+  {
+    long port = strtol(value, NULL, 10);
+    config.mqttPort = (port > 0 && port <= 65535) ? port : 0;
+  }
+
+  const struct
+  {
+    const char *name;
+    char *dest;
+    size_t size;
+  } textFields[] = {{"mqttServer", config.mqttServer, sizeof(config.mqttServer)},
+                    {"mqttUsername", config.mqttUser, sizeof(config.mqttUser)},
+                    {"mqttPassword", config.mqttPass, sizeof(config.mqttPass)},
+                    {"mqttTopicPrefix", config.mqttPrefix, sizeof(config.mqttPrefix)}};
+  for (const auto &field : textFields)
+  {
+    int length = args.get(field.name, value, sizeof(value));
+    if (length >= (int)field.size)
+    {
+      return "One of the MQTT settings is too long";
+    }
+    if (length >= 0)
+    {
+      strlcpy(field.dest, value, field.size);
+    }
+  }
+
+  const struct
+  {
+    const char *name;
+    bool *dest;
+  } boolFields[] = {{"mqttEnabled", &config.mqttEnabled},
+                    {"mqttPerFieldTopics", &config.mqttPerFieldTopics}};
+  for (const auto &field : boolFields)
+  {
+    if (args.get(field.name, value, sizeof(value)) >= 0 && !CommandArgs::parseBool(value, *field.dest))
+    {
+      return "MQTT switches have to be true or false";
+    }
+  }
+  return NULL;
+}
+
+// Form fields from an HTTP request. A checkbox only shows up in a form post when it's ticked, so the ones listed in
+//   `checkboxes` read as "true" / "false" instead of being missing.
+class FormArgs : public CommandArgs
+{
+public:
+  FormArgs(AsyncWebServerRequest *request, const char *const *checkboxes = NULL, size_t checkboxCount = 0)
+      : request_(request), checkboxes_(checkboxes), checkboxCount_(checkboxCount) {}
+
+  int get(const char *key, char *out, size_t size) const override
+  {
+    bool present = request_->hasParam(key, true);
+    for (size_t i = 0; i < checkboxCount_; i++)
+    {
+      if (strcmp(key, checkboxes_[i]) == 0)
+      {
+        strlcpy(out, present ? "true" : "false", size);
+        return present ? 4 : 5;
+      }
+    }
+    if (!present)
+    {
+      return -1;
+    }
+    const String &value = request_->getParam(key, true)->value();
+    strlcpy(out, value.c_str(), size);
+    return value.length();
+  }
+
+private:
+  AsyncWebServerRequest *request_;
+  const char *const *checkboxes_;
+  size_t checkboxCount_;
+};
+
+////////////////////////
+///   MQTT Logic    ///
+//////////////////////
+
+bool mqttReconnect(const AppConfig &conf)
+{
+  Serial.print("[mqtt] Attempting MQTT connection...");
+
+  // If we drop off without saying goodbye, the broker marks us offline for us. The client ID is per wheel too, a broker
+  //   kicks off whoever was already connected with the same one, so two wheels with a shared ID would take turns.
+  if (mqttClient.connect(mqttNodeId, conf.mqttUser, conf.mqttPass, mqttTopics.availability, 1, true, "offline"))
+  {
+    Serial.println("\tconnected");
+    mqttClient.publish(mqttTopics.availability, "online", true);
+    mqttClient.subscribe(mqttTopics.manualDispense);
+    mqttClient.subscribe(mqttTopics.events, 1); // our own events coming back are the outbox acks
+    mqttClient.subscribe(HA_STATUS_TOPIC);
+    mqttClient.subscribe(mqttTopics.commands);
+    mqttDiscoveryPending = true; // the broker might have restarted and lost the retained configs
+    return true;
+  }
+  else
+  {
+    Serial.print("\tfailed, rc=");
+    Serial.println(mqttClient.state());
+    return false;
+  }
+}
+
+// All the usage stats in one retained JSON message on <prefix>/state, so anything that subscribes later gets the
+//   latest straight away
+void mqttPublishUsageStats(const AppConfig &conf)
+{
+  TelemetrySnapshot snapshot = telemetry.read();
+  char json[256];
+  buildMqttStateJson(snapshot, json, sizeof(json));
+  mqttClient.publish(mqttTopics.state, json, true);
+#if PERF_ENABLED
+  char perfJson[384];
+  JsonWriter perf(perfJson, sizeof(perfJson));
+  perf.beginObject();
+  writePerfFields(perf);
+  perf.endObject();
+  mqttClient.publish(mqttTopics.perf, perfJson, true);
+#endif
+  if (conf.mqttPerFieldTopics)
+  {
+    mqttPublishPerFieldStats(snapshot);
+  }
+  Serial.print(".");
+}
+
+// The old layout, one topic per value, for setups that were built around it
+void mqttPublishPerFieldStats(const TelemetrySnapshot &snapshot)
+{
+  char value[16];
+  snprintf(value, sizeof(value), "%lu", (unsigned long)(snapshot.totalDistance / 100));
+  mqttClient.publish(mqttTopics.totalDistance, value);
+  snprintf(value, sizeof(value), "%lu", (unsigned long)snapshot.totalTreats);
+  mqttClient.publish(mqttTopics.totalTreatsDispensed, value);
+  mqttClient.publish(mqttTopics.isOutOfTreats, snapshot.outOfTreats ? "True" : "False");
+  snprintf(value, sizeof(value), "%.2f", snapshot.speed / 100.0);
+  mqttClient.publish(mqttTopics.speed, value);
+  snprintf(value, sizeof(value), "%.2f", snapshot.peakSpeed / 100.0);
+  mqttClient.publish(mqttTopics.peakSpeed, value);
+  snprintf(value, sizeof(value), "%.1f", snapshot.cadence);
+  mqttClient.publish(mqttTopics.sessionCadence, value);
+}
+
+void mqttPublishDispenseCompletion(const AppConfig &conf, const DispenseCompletion &completion)
+{
+  char json[160];
+  buildDispenseCompletionJson(completion, json, sizeof(json));
+  mqttClient.publish(mqttTopics.dispenseResult, json);
+}
+
+// Goes offline on purpose, so the last will isn't needed
+void mqttDisconnect()
+{
+  mqttClient.publish(mqttTopics.availability, "offline", true);
+  mqttClient.disconnect();
+}
+
+// One retained Home Assistant config per entity. The sensors all read from the JSON on <prefix>/state, and the button
+//   sends a 1 to <prefix>/manualDispense.
+void mqttPublishDiscovery()
+{
+  struct Entity
+  {
+    const char *component;
+    const char *objectId;
+    const char *name;
+    const char *valueTemplate; // NULL for the button
+    const char *unit;
+    const char *deviceClass;
+    const char *stateClass;
+    const char *icon;
+  };
+  static const Entity entities[] = {
+      {"sensor", "distance", "Total distance", "{{ value_json.totalDistance }}", "m", "distance", "total_increasing", NULL},
+      {"sensor", "treats", "Treats dispensed", "{{ value_json.totalTreatsDispensed }}", NULL, NULL, "total_increasing", "mdi:cookie"},
+      {"sensor", "speed", "Speed", "{{ value_json.speed }}", "m/s", "speed", "measurement", NULL},
+      {"binary_sensor", "hopper", "Hopper empty", "{{ 'ON' if value_json.hopperEmpty else 'OFF' }}", NULL, "problem", NULL, NULL},
+      {"button", "dispense", "Dispense treat", NULL, NULL, NULL, NULL, "mdi:cat"},
+  };
+
+  for (const Entity &entity : entities)
+  {
+    char topic[96];
+    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/config", HA_DISCOVERY_PREFIX, entity.component, mqttNodeId, entity.objectId);
+    char uniqueId[48];
+    snprintf(uniqueId, sizeof(uniqueId), "%s_%s", mqttNodeId, entity.objectId);
+
+    char json[768];
+    JsonWriter config(json, sizeof(json));
+    config.beginObject()
+        .field("name", entity.name)
+        .field("unique_id", uniqueId)
+        .field("availability_topic", mqttTopics.availability);
+    if (entity.valueTemplate != NULL)
+    {
+      config.field("state_topic", mqttTopics.state)
+          .field("value_template", entity.valueTemplate);
+    }
+    else
+    {
+      config.field("command_topic", mqttTopics.manualDispense)
+          .field("payload_press", "1");
+    }
+    if (entity.unit != NULL)
+    {
+      config.field("unit_of_measurement", entity.unit);
+    }
+    if (entity.deviceClass != NULL)
+    {
+      config.field("device_class", entity.deviceClass);
+    }
+    if (entity.stateClass != NULL)
+    {
+      config.field("state_class", entity.stateClass);
+    }
+    if (entity.icon != NULL)
+    {
+      config.field("icon", entity.icon);
+    }
+    config.beginObject("device")
+        .beginArray("identifiers")
+        .value(mqttNodeId)
+        .endArray()
+        .field("name", "Cat Wheel")
+        .field("manufacturer", "MethodicalMaker")
+        .field("model", "Cat Wheel Treat Dispenser")
+        .endObject()
+        .endObject();
+
+    if (config.overflowed() || !mqttClient.publish(topic, json, true))
+    {
+      Serial.printf("[mqtt] couldn't publish discovery for %s\n", entity.objectId);
+      return; // try again next time round
+    }
+  }
+  mqttDiscoveryPending = false;
+  Serial.println("[mqtt] published Home Assistant discovery");
+}
+
+// A command on <prefix>/cmd/<name>, with a flat JSON object as the payload (or nothing). The answer goes to
+//   <prefix>/reply: {"id":..,"command":..,"result":{..},"ok":true} or with "ok":false and an "error". "id" is whatever
+//   the sender put in theirs (always as a string), so they can match the answer up.
+void mqttHandleCommand(const char *name, const byte *payload, unsigned int length)
+{
+  // Both of these point into PubSubClient's buffer, which publishing the reply overwrites
+  char command[32];
+  strlcpy(command, name, sizeof(command));
+  char request[384];
+  if (length == 0)
+  {
+    strcpy(request, "{}");
+    length = 2;
+  }
+  else if (length < sizeof(request))
+  {
+    memcpy(request, payload, length);
+    request[length] = '\0';
+  }
+  else
+  {
+    length = 0; // fails as not being a JSON object
+  }
+
+  JsonArgs args(request, length);
+  char correlationId[48];
+  bool haveId = args.get("id", correlationId, sizeof(correlationId)) >= 0;
+
+  char reply[MQTT_BUFFER_SIZE];
+  JsonWriter json(reply, sizeof(reply));
+  json.beginObject();
+  if (haveId)
+  {
+    json.field("id", correlationId);
+  }
+  json.field("command", command);
+
+  CommandResult outcome = {CommandStatus::BAD_REQUEST, "The payload has to be a flat JSON object, under 384 bytes", 0};
+  if (args.valid())
+  {
+    json.beginObject("result");
+    outcome = runCommand(command, args, DispenseSource::MQTT, json);
+    json.endObject();
+  }
+  json.field("ok", outcome.status == CommandStatus::OK);
+  if (outcome.message != NULL)
+  {
+    json.field("error", outcome.message);
+  }
+  json.endObject();
+
+  Serial.printf("[mqtt] command %s: %s\n", command, outcome.message != NULL ? outcome.message : "ok");
+  // Cut off JSON is no use to anyone, and neither is silence - say it didn't fit. The topic and PubSubClient's header
+  //   (up to 5 bytes, plus 2 for the topic length) share the packet, so a reply that only just fits in `reply` can
+  //   still be too big to publish.
+  if (json.overflowed() || 5 + 2 + strlen(mqttTopics.reply) + json.length() > MQTT_BUFFER_SIZE)
+  {
+    Serial.printf("[mqtt] reply to %s too large (%u bytes)\n", command, (unsigned)json.length());
+    JsonWriter error(reply, sizeof(reply));
+    error.beginObject();
+    if (haveId)
+    {
+      error.field("id", correlationId);
+    }
+    error.field("command", command).field("ok", false).field("error", "reply too large").endObject();
+  }
+  mqttClient.publish(mqttTopics.reply, reply);
+}
+
+// Sends the next batch from the outbox, as much as the in-flight window allows
+void mqttPublishOutbox()
+{
+  mqttOutbox.checkTimeout(millis());
+  OutboxEvent event;
+  while (mqttClient.connected() && mqttOutbox.nextToSend(event))
+  {
+    char json[256];
+    buildOutboxEventJson(event, json, sizeof(json));
+    if (!mqttClient.publish(mqttTopics.events, json))
+    {
+      break;
+    }
+    mqttOutbox.markSent(millis());
+  }
+}
+
+// Runs on the mqtt task, from inside mqttClient.loop()
+void mqttCallback(char *topic, byte *payload, unsigned int length)
+{
+  // One of our events back from the broker, which means it got there (see mqttOutbox.h)
+  if (strcmp(topic, mqttTopics.events) == 0)
+  {
+    char echo[48];
+    size_t echoLength = length < sizeof(echo) - 1 ? length : sizeof(echo) - 1;
+    memcpy(echo, payload, echoLength);
+    echo[echoLength] = '\0';
+    unsigned long eventBootId, sequence;
+    if (sscanf(echo, "{\"boot\":%lu,\"seq\":%lu", &eventBootId, &sequence) == 2)
+    {
+      mqttOutbox.acknowledge(eventBootId, sequence, millis());
+    }
+    return;
+  }
+
+  // <prefix>/cmd/<name>
+  size_t commandBaseLength = strlen(mqttTopics.commandBase);
+  if (strncmp(topic, mqttTopics.commandBase, commandBaseLength) == 0)
+  {
+    mqttHandleCommand(topic + commandBaseLength, payload, length);
+    return;
+  }
+
+  // Home Assistant (re)started and wants everyone's discovery configs again
+  if (strcmp(topic, HA_STATUS_TOPIC) == 0)
+  {
+    if (length == 6 && memcmp(payload, "online", 6) == 0)
+    {
+      mqttDiscoveryPending = true;
+    }
+    return;
+  }
+
+  Serial.printf("[mqtt] got message on %s: %.*s\n", topic, (int)length, (const char *)payload);
+
+  // payload is the number of treats wanted, "1" being the usual
+  if (strcmp(topic, mqttTopics.manualDispense) == 0)
+  {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < length && payload[i] >= '0' && payload[i] <= '9'; i++)
+    {
+      count = count * 10 + (payload[i] - '0');
+      if (count > 255)
+      {
+        count = 255;
+        break;
+      }
+    }
+    if (count > 0)
+    {
+      requestDispense(DispenseSource::MQTT, count);
+    }
+  }
+}
+
+// Outbox spill-over in SPIFFS (see mqttOutbox.h). Events are appended to OUTBOX_FILE, and dropping them from the front
+//   just moves the start along (saved in OUTBOX_POS_FILE) until the file is either empty and gets deleted, or half of
+//   it is dead space and gets compacted.
+bool outboxSpillBegin()
+{
+  if (!SPIFFS.begin(true))
+  {
+    Serial.println("[mqtt] - couldn't mount SPIFFS, the outbox is RAM only");
+    return false;
+  }
+
+  // a compact that got cut off between the remove and the rename
+  if (!SPIFFS.exists(OUTBOX_FILE) && SPIFFS.exists(OUTBOX_TMP_FILE))
+  {
+    SPIFFS.rename(OUTBOX_TMP_FILE, OUTBOX_FILE);
+  }
+
+  size_t bytes = 0;
+  if (SPIFFS.exists(OUTBOX_FILE))
+  {
+    File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+    bytes = file.size();
+    file.close();
+  }
+  outboxSpillEnd = bytes / sizeof(OutboxEvent);
+  outboxSpillFirst = 0;
+  if (SPIFFS.exists(OUTBOX_POS_FILE))
+  {
+    File file = SPIFFS.open(OUTBOX_POS_FILE, FILE_READ);
+    if (file.read((uint8_t *)&outboxSpillFirst, sizeof(outboxSpillFirst)) != sizeof(outboxSpillFirst) || outboxSpillFirst > outboxSpillEnd)
+    {
+      outboxSpillFirst = 0;
+    }
+    file.close();
+  }
+
+  outboxSpillReady = true;
+  if (bytes % sizeof(OutboxEvent) != 0)
+  {
+    outboxSpillCompact(); // an append got cut off by a reset, get rid of the half written event at the end
+  }
+  if (outboxSpillCount() > 0)
+  {
+    Serial.printf("[mqtt] - %lu events in the outbox from before the restart\n", (unsigned long)outboxSpillCount());
+  }
+  return true;
+}
 
-    vTaskDelay(pdMS_TO_TICKS(100));
+bool outboxSpillAppend(const OutboxEvent *events, uint32_t count)
+{
+  if (!outboxSpillReady)
+  {
+    return false;
+  }
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_APPEND);
+  if (!file)
+  {
+    return false;
   }
+  size_t bytes = count * sizeof(OutboxEvent);
+  size_t written = file.write((const uint8_t *)events, bytes);
+  file.close();
+  if (written != bytes)
+  {
+    outboxSpillCompact(); // SPIFFS full, cut the partial write back off
+    return false;
+  }
+  outboxSpillEnd += count;
+  return true;
 }
 
-void mqttServerTask(void *parameter)
+bool outboxSpillRead(uint32_t index, OutboxEvent &event)
 {
-  uint32_t lastMqttPublishTime = 0;
-  int mqttPublishInterval = (1000 * 60 * 5); // every 5 minutes
+  if (!outboxSpillReady || outboxSpillFirst + index >= outboxSpillEnd)
+  {
+    return false;
+  }
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  bool ok = file && file.seek((outboxSpillFirst + index) * sizeof(OutboxEvent)) && file.read((uint8_t *)&event, sizeof(event)) == sizeof(event);
+  file.close();
+  return ok;
+}
 
-  while (1)
+void outboxSpillDrop(uint32_t count)
+{
+  outboxSpillFirst += count;
+  if (outboxSpillFirst >= outboxSpillEnd)
   {
-    while (mqttConf.mqttEnabled && networkState == NetworkState::CONNECTED)
-    {
+    SPIFFS.remove(OUTBOX_FILE);
+    SPIFFS.remove(OUTBOX_POS_FILE);
+    outboxSpillFirst = 0;
+    outboxSpillEnd = 0;
+    return;
+  }
+  if (outboxSpillFirst >= OUTBOX_SPILL_EVENTS / 2)
+  {
+    outboxSpillCompact();
+    return;
+  }
+  File file = SPIFFS.open(OUTBOX_POS_FILE, FILE_WRITE);
+  file.write((const uint8_t *)&outboxSpillFirst, sizeof(outboxSpillFirst));
+  file.close();
+}
 
-      // Publish usage statistics via MQTT
-      if (mqttClient.connected() && (millis() - lastMqttPublishTime >= mqttPublishInterval))
-      {
-        mqttPublishUsageStats();
-        lastMqttPublishTime = millis();
-      }
+uint32_t outboxSpillCount()
+{
+  return outboxSpillEnd - outboxSpillFirst;
+}
 
-      // Reconnect to MQTT if disconnected
-      if (!mqttClient.connected())
+// Copies the events that are still wanted into a fresh file, leaving the dropped ones (and any half written one at
+//   the end) behind
+void outboxSpillCompact()
+{
+  File from = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  File to = SPIFFS.open(OUTBOX_TMP_FILE, FILE_WRITE);
+  uint32_t kept = 0;
+  if (from && to && from.seek(outboxSpillFirst * sizeof(OutboxEvent)))
+  {
+    OutboxEvent events[8];
+    while (outboxSpillFirst + kept < outboxSpillEnd)
+    {
+      uint32_t batch = outboxSpillEnd - outboxSpillFirst - kept;
+      if (batch > 8)
       {
-        Serial.print("[mqtt] setting mqtt server host to: ");
-        Serial.println(mqttConf.server);
-
-        mqttClient.setServer(mqttConf.server.c_str(), mqttConf.port);
-        mqttReconnect();
+        batch = 8;
       }
-      else
+      size_t bytes = batch * sizeof(OutboxEvent);
+      if (from.read((uint8_t *)events, bytes) != bytes || to.write((const uint8_t *)events, bytes) != bytes)
       {
-        mqttClient.loop();
+        break;
       }
+      kept += batch;
     }
-    Serial.println("[mqtt] - waiting to be enabled...");
-    vTaskDelay(5000 / portTICK_PERIOD_MS); // Delay for 5 seconds
   }
+  from.close();
+  to.close();
+
+  SPIFFS.remove(OUTBOX_FILE);
+  SPIFFS.remove(OUTBOX_POS_FILE);
+  SPIFFS.rename(OUTBOX_TMP_FILE, OUTBOX_FILE);
+  outboxSpillFirst = 0;
+  outboxSpillEnd = kept;
 }
 
 ////////////////////////
-///   Meat Space    ///
+///   Networking    ///
 //////////////////////
-void dispenseTreat()
-{
-  Serial.println("[main-dispenseTreat()] - dispensing treat");
-
-  digitalWrite(hopperLightBreakSensorLEDPin, HIGH);
-  digitalWrite(dispenseLightBreakSensorLEDPin, HIGH);
-  vTaskDelay(700 / portTICK_PERIOD_MS); // Delay for 200ms to make sure light break sensor is reading high
 
-  ISR_GUARD = false;
-  dispensingTreat = true;
+// Kicks off a connection attempt and returns straight away. wifiManagerTask hears how it went from the WiFi events
+//   (got ip / disconnected), or gives up on it after the connect timeout.
+//   directed: go straight to the access point and channel in networkCache, rather than scanning for the ssid.
+void connectToWiFi(bool directed)
+{
+  static bool addressConfigured = false; // have we told the driver to use a fixed address, that needs undoing to get DHCP back
 
-  unsigned long looptime = millis();
-  ;
-  unsigned long treatDispenseStartTime = millis();
-  continuousServo.writeMicroseconds(1500 + 500);
+  setNetworkState(NetworkState::CONNECTING);
+  Serial.printf("\t[wifiManager]: Attempting to connect to ssid %s\n", config.ssid);
 
-  while (dispensingTreat == true)
+  // A static ip from the setup page always wins. Otherwise the directed attempt can reuse the last lease, if allowed.
+  if (staticIp.ip != 0)
   {
-    vTaskDelay(1 / portTICK_PERIOD_MS); // Delay for 1ms, this is needed or the watchdog for the task will kill it!
-
-    // yeah, this isn't the ideal way to do the timing, but it works.
-    // we want this so our hopper time carries over between dispense treat calls
-    //  (ie, nothing detected for 4 of 5 seconds, treat leaves main body, dispenseTreat is called again, it should detect hopper empty after 1 more second.)
-    accumulatedDispensingTimeWithoutHopperTreat_ms += millis() - looptime;
-    looptime = millis();
-    if (accumulatedDispensingTimeWithoutHopperTreat_ms > 5000)
-    {
-      if (!outOfTreats_hopper)
-      {
-        Serial.print("[main] hopper out of treats! - accumulatedDispensingTimeWithoutHopperTreat_ms  > 5000");
-        outOfTreats_hopper = true;
-      }
-    }
-
-    // If the threshold of 30 seconds for dispensing a treat is exceeded, set the error flag and give up.
-    if (looptime - treatDispenseStartTime > 30000)
-    {
-      outOfTreats = true;
-      dispensingTreat = false;
-      Serial.println("[main] fully out of treats! - threshold of 30 seconds for dispensing a treat is exceeded");
-      break;
-    }
+    WiFi.config(IPAddress(staticIp.ip), IPAddress(staticIp.gateway), IPAddress(staticIp.subnet), IPAddress(staticIp.dns));
+    addressConfigured = true;
   }
-  continuousServo.writeMicroseconds(1500);
-
-  ISR_GUARD = true;
-  vTaskDelay(200 / portTICK_PERIOD_MS); // Delay for 200ms to make sure ISR logic is guarded
-  digitalWrite(hopperLightBreakSensorLEDPin, LOW);
-  digitalWrite(dispenseLightBreakSensorLEDPin, LOW);
-
-  if (!outOfTreats) // We just dispensed one
+  else if (directed && WIFI_REUSE_DHCP_LEASE && networkCache.ip != 0)
+  {
+    WiFi.config(IPAddress(networkCache.ip), IPAddress(networkCache.gateway), IPAddress(networkCache.subnet), IPAddress(networkCache.dns));
+    addressConfigured = true;
+  }
+  else if (addressConfigured)
   {
-    totalTreatsDispensed++;
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // all zeros turns DHCP back on
+    addressConfigured = false;
   }
 
-  return;
+  if (directed)
+  {
+    const uint8_t *b = networkCache.bssid;
+    Serial.printf("\t[wifiManager]: going straight to %02x:%02x:%02x:%02x:%02x:%02x on channel %u\n", b[0], b[1], b[2], b[3], b[4], b[5], networkCache.channel);
+    WiFi.begin(config.ssid, config.password, networkCache.channel, networkCache.bssid);
+  }
+  else
+  {
+    WiFi.begin(config.ssid, config.password);
+  }
+  WiFi.setSleep(false);
 }
 
-////////////////////////
-///   MQTT Logic    ///
-//////////////////////
-
-void mqttReconnect()
+// Remember the access point and lease we just got, for the next boot. Only touches flash when something changed.
+void saveNetworkCache()
 {
-  Serial.print("[mqtt] Attempting MQTT connection...");
-
-  if (mqttClient.connect("Cat_wheel", mqttConf.username.c_str(), mqttConf.password.c_str()))
+  WifiNetworkCache current;
+  memset(&current, 0, sizeof(current)); // zero the padding too, so memcmp below works
+  const uint8_t *bssid = WiFi.BSSID();
+  if (bssid == NULL)
   {
-    Serial.println("\tconnected");
-    mqttClient.setCallback(mqttCallback);
-    mqttClient.subscribe((mqttConf.topicPrefix + "/manualDispense").c_str());
+    return;
   }
-  else
+  memcpy(current.bssid, bssid, sizeof(current.bssid));
+  current.channel = WiFi.channel();
+  current.ip = WiFi.localIP();
+  current.gateway = WiFi.gatewayIP();
+  current.subnet = WiFi.subnetMask();
+  current.dns = WiFi.dnsIP();
+
+  if (networkCacheValid && memcmp(&current, &networkCache, sizeof(current)) == 0)
   {
-    Serial.print("\tfailed, rc=");
-    Serial.println(mqttClient.state());
+    return;
   }
+  networkCache = current;
+  networkCacheValid = true;
+
+  preferences.begin("conf", false);
+  preferences.putBytes("netCache", &networkCache, sizeof(networkCache));
+  preferences.end();
+  Serial.println("\t[wifiManager]: saved access point for fast reconnect");
 }
 
-void mqttPublishUsageStats()
+void clearNetworkCache()
 {
-  mqttClient.publish((mqttConf.topicPrefix + "/totalDistance").c_str(), String(totalDistance / 100).c_str());
-  mqttClient.publish((mqttConf.topicPrefix + "/totalTreatsDispensed").c_str(), String(totalTreatsDispensed).c_str());
-  mqttClient.publish((mqttConf.topicPrefix + "/isOutOfTreats").c_str(), String(outOfTreats ? "True" : "False").c_str());
-  Serial.print(".");
+  memset(&networkCache, 0, sizeof(networkCache));
+  networkCacheValid = false;
+  preferences.begin("conf", false);
+  preferences.remove("netCache");
+  preferences.end();
 }
 
-void mqttCallback(char *topic, byte *payload, unsigned int length)
+// Called from wifiManagerTask when someone asked for a scan
+void startWifiScan()
+{
+  if (!wifiScanRequested || wifiScanInProgress)
+  {
+    return;
+  }
+  wifiScanRequested = false;
+  if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED)
+  {
+    Serial.println("\t[wifiManager]: couldn't start scan");
+    return;
+  }
+  wifiScanInProgress = true;
+}
+
+// Called from wifiManagerTask on the scan done event, turns the results into JSON for /scan
+void finishWifiScan()
 {
-  String message;
-  for (unsigned int i = 0; i < length; i++)
+  if (!wifiScanInProgress)
   {
-    message += (char)payload[i];
+    return;
   }
 
-  Serial.println("Got message: " + message);
+  int16_t numNetworks = WiFi.scanComplete();
+  if (numNetworks == WIFI_SCAN_RUNNING)
+  {
+    return;
+  }
 
-  if (String(topic) == (mqttConf.topicPrefix + "/manualDispense") && message == "1")
+  if (numNetworks >= 0)
+  {
+    xSemaphoreTake(wifiScanMutex, portMAX_DELAY);
+    buildWifiScanJson(numNetworks, wifiScanJson, sizeof(wifiScanJson));
+    wifiScanCompletedAt = millis();
+    wifiScanHaveResults = true;
+    xSemaphoreGive(wifiScanMutex);
+    Serial.printf("\t[wifiManager]: scan found %d networks\n", numNetworks);
+  }
+  else
   {
-    forceDispense = true;
+    Serial.println("\t[wifiManager]: scan failed");
   }
+  WiFi.scanDelete();
+  wifiScanInProgress = false;
 }
 
-////////////////////////
-///   Networking    ///
-//////////////////////
-
-void connectToWiFi()
+// Optional static ip fields from the setup page. Leaving ip blank means DHCP. Returns false if something didn't parse.
+bool parseStaticIp(AsyncWebServerRequest *request, StaticIpConfig &out)
 {
-  networkState = NetworkState::CONNECTING;
-  Serial.printf("\t[wifiManager]: Attempting to connect to ssid %s\n", config.ssid);
+  memset(&out, 0, sizeof(out));
+  if (!request->hasParam("ip") || request->getParam("ip")->value().length() == 0)
+  {
+    return true;
+  }
 
-  vTaskDelay(pdMS_TO_TICKS(100));
+  IPAddress ip, gateway, subnet(255, 255, 255, 0), dns;
+  if (!ip.fromString(request->getParam("ip")->value().c_str()) ||
+      !request->hasParam("gateway") || !gateway.fromString(request->getParam("gateway")->value().c_str()))
+  {
+    return false;
+  }
+  if (request->hasParam("subnet") && request->getParam("subnet")->value().length() > 0 && !subnet.fromString(request->getParam("subnet")->value().c_str()))
+  {
+    return false;
+  }
+  dns = gateway; // most home routers are the dns server too
+  if (request->hasParam("dns") && request->getParam("dns")->value().length() > 0 && !dns.fromString(request->getParam("dns")->value().c_str()))
+  {
+    return false;
+  }
 
-  unsigned long start = millis();
-  WiFi.begin(config.ssid, config.password);
-  WiFi.setSleep(false);
+  out.ip = ip;
+  out.gateway = gateway;
+  out.subnet = subnet;
+  out.dns = dns;
+  return true;
+}
 
-  while (millis() - start < 15000)
+void buildWifiScanJson(int numNetworks, char *buffer, size_t size)
+{
+  JsonWriter json(buffer, size);
+  json.beginArray();
+  for (int i = 0; i < numNetworks; i++)
   {
-    if (WiFi.status() == WL_CONNECTED)
+    // leave room to close the array off, we'd rather lose the weakest networks than send broken json
+    if (json.length() + 128 > size)
     {
-      networkState = NetworkState::CONNECTED;
-      Serial.println("\t[wifiManager]: Connected to existing network!");
-      vTaskDelay(pdMS_TO_TICKS(3000)); // wait for dhcp and stuff
-      Serial.printf("\t[wifiManager]: ip addr: %s\n", WiFi.localIP().toString().c_str());
-      return;
+      break;
+    }
+
+    const char *encryption;
+    switch (WiFi.encryptionType(i))
+    {
+    case WIFI_AUTH_OPEN: encryption = "Open"; break;
+    case WIFI_AUTH_WEP: encryption = "WEP"; break;
+    case WIFI_AUTH_WPA_PSK: encryption = "WPA"; break;
+    case WIFI_AUTH_WPA2_PSK: encryption = "WPA2"; break;
+    case WIFI_AUTH_WPA_WPA2_PSK: encryption = "WPA/WPA2"; break;
+    case WIFI_AUTH_WPA2_ENTERPRISE: encryption = "802.11x"; break;
+    case WIFI_AUTH_WPA3_PSK: encryption = "WPA3"; break;
+    case WIFI_AUTH_WPA2_WPA3_PSK: encryption = "WPA2/WPA3"; break;
+    default: encryption = "Unknown"; break;
     }
-    vTaskDelay(pdMS_TO_TICKS(200));
-  }
 
-  networkState = NetworkState::DISCONNECTED;
-  Serial.println("\t[wifiManager]: Connection failed");
+    json.beginObject()
+        .field("ssid", WiFi.SSID(i).c_str())
+        .field("rssi", (int)WiFi.RSSI(i))
+        .field("encryption", encryption)
+        .endObject();
+  }
+  json.endArray();
 }
 
 void startAPMode()
@@ -573,7 +2515,7 @@ void startAPMode()
   WiFi.mode(WIFI_AP);
   WiFi.softAP("CAT_WHEEL_SETUP", "");
 
-  networkState = NetworkState::AP_MODE;
+  setNetworkState(NetworkState::AP_MODE);
   Serial.printf("\t[wifiManager]: AP Mode enabled\n\t\tSSID: CAT_WHEEL_SETUP\n\t\tip addr: %s\n", WiFi.softAPIP().toString().c_str());
 }
 
@@ -581,34 +2523,98 @@ void startAPMode()
 ///     Config      ///
 //////////////////////
 
-void saveConfig()
+// Writes only the settings that differ between `before` and `after`, in one Preferences session.
+//   everything: write them all regardless, ie the first time round when nothing is stored yet.
+void saveConfig(const AppConfig &before, const AppConfig &after, bool everything)
 {
+  int written = 0;
   preferences.begin("conf", false);
-  preferences.putInt("dist", distanceThreshold);
-
-  preferences.putString("mqttServer", mqttConf.server);
-  preferences.putString("mqttUser", mqttConf.username);
-  preferences.putString("mqttPass", mqttConf.password);
-  preferences.putString("mqttTopic", mqttConf.topicPrefix);
-  preferences.putInt("mqttPort", mqttConf.port);
-  preferences.putBool("mqttEnable", mqttConf.mqttEnabled);
+  if (everything || before.distanceThreshold != after.distanceThreshold)
+  {
+    preferences.putInt("dist", after.distanceThreshold);
+    written++;
+  }
+  if (everything || strcmp(before.mqttServer, after.mqttServer) != 0)
+  {
+    preferences.putString("mqttServer", after.mqttServer);
+    written++;
+  }
+  if (everything || strcmp(before.mqttUser, after.mqttUser) != 0)
+  {
+    preferences.putString("mqttUser", after.mqttUser);
+    written++;
+  }
+  if (everything || strcmp(before.mqttPass, after.mqttPass) != 0)
+  {
+    preferences.putString("mqttPass", after.mqttPass);
+    written++;
+  }
+  if (everything || strcmp(before.mqttPrefix, after.mqttPrefix) != 0)
+  {
+    preferences.putString("mqttTopic", after.mqttPrefix);
+    written++;
+  }
+  if (everything || before.mqttPort != after.mqttPort)
+  {
+    preferences.putInt("mqttPort", after.mqttPort);
+    written++;
+  }
+  if (everything || before.mqttEnabled != after.mqttEnabled)
+  {
+    preferences.putBool("mqttEnable", after.mqttEnabled);
+    written++;
+  }
+  if (everything || before.mqttPerFieldTopics != after.mqttPerFieldTopics)
+  {
+    preferences.putBool("mqttPerField", after.mqttPerFieldTopics);
+    written++;
+  }
   preferences.end();
 
-  Serial.println("Configuration saved");
+  Serial.printf("Configuration saved (version %lu, %d settings written)\n", (unsigned long)after.version, written);
 }
 
-void clearConfig()
+// Called from setup() with the preferences already open
+void loadConfig()
 {
-  distanceThreshold = 100 * 100; // 100 meters
+  AppConfig loaded;
+  setAppConfigDefaults(loaded);
+  int storedDistance = preferences.getInt("dist", loaded.distanceThreshold);
+  loaded.distanceThreshold = storedDistance > 0 ? storedDistance : 0; // a negative one isn't a huge one, repaired below
+  strlcpy(loaded.mqttServer, preferences.getString("mqttServer", loaded.mqttServer).c_str(), sizeof(loaded.mqttServer));
+  strlcpy(loaded.mqttUser, preferences.getString("mqttUser", loaded.mqttUser).c_str(), sizeof(loaded.mqttUser));
+  strlcpy(loaded.mqttPass, preferences.getString("mqttPass", loaded.mqttPass).c_str(), sizeof(loaded.mqttPass));
+  strlcpy(loaded.mqttPrefix, preferences.getString("mqttTopic", loaded.mqttPrefix).c_str(), sizeof(loaded.mqttPrefix));
+  int storedPort = preferences.getInt("mqttPort", loaded.mqttPort);
+  loaded.mqttPort = (storedPort > 0 && storedPort <= 65535) ? storedPort : 0;
+  loaded.mqttEnabled = preferences.getBool("mqttEnable", loaded.mqttEnabled);
+  loaded.mqttPerFieldTopics = preferences.getBool("mqttPerField", loaded.mqttPerFieldTopics);
+
+  // One bad setting only costs that setting, the rest of what was saved still goes in
+  const char *problem = validateAppConfig(loaded);
+  if (problem != NULL)
+  {
+    int repaired = repairAppConfig(loaded);
+    Serial.printf("[main] - saved configuration had a bad setting (%s), put %d back to the default and kept the rest\n", problem,
+                  repaired);
+  }
 
-  mqttConf.password = "xxxxx";
-  mqttConf.port = 1883;
-  mqttConf.server = "10.4.0.4";
-  mqttConf.topicPrefix = "/iot/device/catwheel/";
-  mqttConf.username = "cat_wheel";
-  mqttConf.mqttEnabled = false;
+  const char *error = configStore.update([&](AppConfig &next)
+                                         { next = loaded; });
+  if (error != NULL)
+  {
+    Serial.printf("[main] - saved configuration is no good (%s), using the defaults\n", error);
+  }
+}
 
-  saveConfig();
+void clearConfig()
+{
+  AppConfig after;
+  configStore.update([](AppConfig &next)
+                     { setAppConfigDefaults(next); },
+                     NULL, &after);
+  saveConfig(after, after, true);
+  notifyMqttTask();
   Serial.println("Configuration cleared");
 }
 
@@ -616,6 +2622,7 @@ void saveWifi()
 {
   preferences.begin("conf", false);
   preferences.putBytes("config", &config, sizeof(config));
+  preferences.putBytes("staticIp", &staticIp, sizeof(staticIp));
   Serial.println("WiFi Configuration saved");
   preferences.end();
 }
@@ -624,24 +2631,18 @@ void clearWifi()
 {
   preferences.begin("conf", false);
   preferences.remove("config");
+  preferences.remove("staticIp");
+  preferences.remove("netCache");
   preferences.end();
   Serial.println("Configuration cleared");
 }
 
 void setInitialConfig()
 {
-  distanceThreshold = 100 * 100; // 100 meters
-
-  mqttConf.password = "xxxxx";
-  mqttConf.port = 1883;
-  mqttConf.server = "10.4.0.4";
-  mqttConf.topicPrefix = "/iot/device/catwheel/";
-  mqttConf.username = "cat_wheel";
-  mqttConf.mqttEnabled = false;
+  clearConfig();
 
   size_t configSize = sizeof(WiFiConfig);
   memset(&config, 0, configSize);
-  saveConfig();
   saveWifi();
 
   // this isn't in the normal save commands - so do it here as a one off begin / end
@@ -659,26 +2660,31 @@ void setupWebServerRoutes(AsyncWebServer &server)
   // Handle AP configuration mode routes
   server.on("/scan", HTTP_GET, [](AsyncWebServerRequest *request)
             {
-    int numNetworks = WiFi.scanNetworks();
-    String json = "[";
-    for (int i = 0; i < numNetworks; i++) {
-        json += "{\"ssid\":\"" + WiFi.SSID(i) + "\",\"rssi\":" + WiFi.RSSI(i) + ",\"encryption\":\"";
-        switch (WiFi.encryptionType(i)) {
-            case WIFI_AUTH_OPEN: json += "Open"; break;
-            case WIFI_AUTH_WEP: json += "WEP"; break;
-            case WIFI_AUTH_WPA_PSK: json += "WPA"; break;
-            case WIFI_AUTH_WPA2_PSK: json += "WPA2"; break;
-            case WIFI_AUTH_WPA_WPA2_PSK: json += "WPA/WPA2"; break;
-            case WIFI_AUTH_WPA2_ENTERPRISE: json += "802.11x"; break;
-            case WIFI_AUTH_WPA3_PSK: json += "WPA3"; break;
-            case WIFI_AUTH_WPA2_WPA3_PSK: json += "WPA2/WPA3"; break;
-            default: json += "Unknown"; break;
-        }
-        json += "\"}";
-        if (i < numNetworks - 1) json += ",";
+    // Never scan in here, that would hold up the whole async TCP task. Ask wifiManagerTask for a scan if what we have
+    // is stale, and send back the cached results straight away - the page polls again while scanning is true.
+    if (xSemaphoreTake(wifiScanMutex, pdMS_TO_TICKS(50)) != pdTRUE)
+    {
+      request->send(503, "text/plain", "Busy");
+      return;
+    }
+
+    bool fresh = wifiScanHaveResults && millis() - wifiScanCompletedAt < WIFI_SCAN_CACHE_MS;
+    if (!fresh && !wifiScanInProgress && !wifiScanRequested)
+    {
+      wifiScanRequested = true;
+      postWifiEvent(WifiEventType::SCAN_REQUESTED);
     }
-    json += "]";
-    request->send(200, "application/json", json); });
+
+    char header[64];
+    snprintf(header, sizeof(header), "{\"scanning\":%s,\"ageMs\":%ld,\"networks\":", (wifiScanInProgress || wifiScanRequested) ? "true" : "false",
+             wifiScanHaveResults ? (long)(millis() - wifiScanCompletedAt) : -1L);
+    String response;
+    response.reserve(strlen(header) + strlen(wifiScanJson) + 1);
+    response += header;
+    response += wifiScanJson;
+    response += "}";
+    xSemaphoreGive(wifiScanMutex);
+    request->send(200, "application/json", response); });
 
   server.on("/connect", HTTP_GET, [](AsyncWebServerRequest *request)
             {
@@ -687,12 +2693,17 @@ void setupWebServerRoutes(AsyncWebServer &server)
         String pass = request->getParam("pass")->value();
 
         // Send to WiFi task
-        WiFiConfig send_msg;
-        strncpy(send_msg.ssid, ssid.c_str(), sizeof(config.ssid));
-        strncpy(send_msg.password, pass.c_str(), sizeof(config.password));
-        xQueueSend(wifiQueue, &send_msg, portMAX_DELAY);
-
-        saveWifi();
+        WifiSetupMessage send_msg;
+        memset(&send_msg, 0, sizeof(send_msg));
+        strncpy(send_msg.wifi.ssid, ssid.c_str(), sizeof(config.ssid));
+        strncpy(send_msg.wifi.password, pass.c_str(), sizeof(config.password));
+        if (!parseStaticIp(request, send_msg.staticIp))
+        {
+          request->send(400, "text/plain", "Invalid static IP settings");
+          return;
+        }
+        xQueueOverwrite(wifiQueue, &send_msg);
+        postWifiEvent(WifiEventType::NEW_CREDENTIALS);
 
         String response = String(AP_CONFIG_PAGE_HEADER) + 
                         COMMON_HEADER +
@@ -713,7 +2724,7 @@ void setupWebServerRoutes(AsyncWebServer &server)
             {
       if (networkState == NetworkState::AP_MODE)
       {
-        networkState = NetworkState::TRIAL_MODE;
+        postWifiEvent(WifiEventType::TRIAL_MODE);
         String response = String(MAIN_PAGE_HEADER) + 
         COMMON_HEADER + 
       R"(
@@ -783,8 +2794,10 @@ void setupWebServerRoutes(AsyncWebServer &server)
 
   server.on("/resetErrorStates", HTTP_POST, [](AsyncWebServerRequest *request)
             {
-        outOfTreats = false;
-        outOfTreats_hopper = false;
+        char json[16];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        runCommand("resetErrors", FormArgs(request), DispenseSource::WEB, result);
 
         String response = String(MAIN_PAGE_HEADER) + 
                         COMMON_HEADER +
@@ -817,15 +2830,10 @@ void setupWebServerRoutes(AsyncWebServer &server)
 
   server.on("/resetStats", HTTP_POST, [](AsyncWebServerRequest *request)
             {
-
-        totalDistance = 0;
-        totalTreatsDispensed = 0;
-        hallEffectCount = 0;
-
-        preferences.begin("conf", false);
-        preferences.putInt("totalDistance", 0);
-        preferences.putInt("totalTreatsDispensed", 0);
-        preferences.end();
+        char json[16];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        runCommand("resetStats", FormArgs(request), DispenseSource::WEB, result);
 
         String response = String(MAIN_PAGE_HEADER) + 
                         COMMON_HEADER +
@@ -841,68 +2849,165 @@ void setupWebServerRoutes(AsyncWebServer &server)
 
   server.on("/dispenseTreat", HTTP_POST, [](AsyncWebServerRequest *request)
             {
-        forceDispense = true;
+        char json[48];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        CommandResult outcome = runCommand("dispense", FormArgs(request), DispenseSource::WEB, result);
+        if (outcome.status == CommandStatus::BAD_REQUEST)
+        {
+          request->send(400, "text/plain", outcome.message);
+          return;
+        }
+        if (outcome.status != CommandStatus::OK)
+        {
+          String response = String(MAIN_PAGE_HEADER) + 
+                          COMMON_HEADER +
+                          R"(
+                          <h1>Dispenser Busy</h1>
+                          <div class="status-message status-error">
+                              <p>Too many treats are already waiting to be dispensed, try again in a bit.</p>
+                          </div>
+                          <meta http-equiv="refresh" content="2;url=/">
+                          )" + 
+                          COMMON_FOOTER;
+          request->send(503, "text/html", response);
+          return;
+        }
+
         String response = String(MAIN_PAGE_HEADER) + 
                         COMMON_HEADER +
                         R"(
-                        <h1>Treat Dispensed</h1>
+                        <h1>Treat Requested</h1>
                         <div class="status-message status-success">
-                            <p>A treat has been dispensed!</p>
+                            <p>Treat request #)" + String(outcome.id) + R"( is on its way!</p>
                         </div>
                         <meta http-equiv="refresh" content="2;url=/">
                         )" + 
                         COMMON_FOOTER;
         request->send(200, "text/html", response); });
 
-  server.on("/settings", HTTP_POST, [](AsyncWebServerRequest *request)
-            {
-              // Process updating the distance target
-              if (request->hasParam("distanceThreshold", true))
-              {
-                //we expect a dist in meters, but internally use cm
-                distanceThreshold = request->getParam("distanceThreshold", true)->value().toInt() * 100;
-              }
-
-              // Process MQTT settings
-              if (request->hasParam("mqttServer", true))
-              {
-                mqttConf.server = request->getParam("mqttServer", true)->value();
-              }
+  // Live updates. Each browser gets the full status when it connects, and only what changed after that.
+  telemetryEvents.onConnect([](AsyncEventSourceClient *client)
+                            {
+    char json[1024];
+    if (buildStatusJson(json, sizeof(json)) > 0) // no point sending half of it, the script only takes whole JSON
+    {
+      client->send(json, "status", millis());
+    } });
+  server.addHandler(&telemetryEvents);
 
-              if (request->hasParam("mqttPort", true))
-              {
-                mqttConf.port = request->getParam("mqttPort", true)->value().toInt();
-              }
+  // Compact status for the dashboard script to poll, a few hundred bytes instead of the whole page
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+        char json[1024];
+        if (buildStatusJson(json, sizeof(json)) == 0)
+        {
+          request->send(500, "text/plain", "Status too large for its buffer");
+          return;
+        }
+        request->send(200, "application/json", json); });
 
-              if (request->hasParam("mqttUsername", true))
-              {
-                mqttConf.username = request->getParam("mqttUsername", true)->value();
-              }
+  // Sensor traces (see sensorTrace.h). Start, stop, then download and feed it to `program replay` on a PC.
+  server.on("/api/trace/start", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+        char json[64];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        CommandResult outcome = runCommand("traceStart", FormArgs(request), DispenseSource::WEB, result);
+        if (outcome.status != CommandStatus::OK)
+        {
+          request->send(409, "text/plain", outcome.message);
+          return;
+        }
+        result.endObject();
+        request->send(200, "application/json", json); });
 
-              if (request->hasParam("mqttPassword", true))
-              {
-                mqttConf.password = request->getParam("mqttPassword", true)->value();
-              }
+  server.on("/api/trace/stop", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+        char json[64];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        runCommand("traceStop", FormArgs(request), DispenseSource::WEB, result);
+        result.endObject();
+        request->send(200, "application/json", json); });
+
+  server.on("/api/trace", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+        if (traceWriting)
+        {
+          request->send(409, "text/plain", "Stop the trace first");
+          return;
+        }
+        if (!SPIFFS.exists(TRACE_FILE))
+        {
+          request->send(404, "text/plain", "No trace recorded yet");
+          return;
+        }
+        request->send(SPIFFS, TRACE_FILE, "application/octet-stream", true); });
 
-              if (request->hasParam("mqttTopicPrefix", true))
-              {
-                mqttConf.topicPrefix = request->getParam("mqttTopicPrefix", true)->value();
-              }
+#if PERF_ENABLED
+  // Hot path latency histograms, POST /api/perf/reset to start counting again
+  server.on("/api/perf", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+        char json[384];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        runCommand("getPerf", FormArgs(request), DispenseSource::WEB, result);
+        result.endObject();
+        request->send(200, "application/json", json); });
+
+  server.on("/api/perf/reset", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+        char json[64];
+        JsonWriter result(json, sizeof(json));
+        result.beginObject();
+        runCommand("resetPerf", FormArgs(request), DispenseSource::WEB, result);
+        result.endObject();
+        request->send(200, "application/json", json); });
+#endif
+
+  server.on("/dispenseStatus", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+        DispenseCompletion completion;
+        if (!request->hasParam("id"))
+        {
+          request->send(400, "text/plain", "Missing parameters");
+          return;
+        }
+        if (!findDispenseCompletion(request->getParam("id")->value().toInt(), completion))
+        {
+          // either still waiting its turn, or so old it fell out of the recent list
+          request->send(200, "application/json", "{\"status\":\"pending\"}");
+          return;
+        }
+        char json[160];
+        buildDispenseCompletionJson(completion, json, sizeof(json));
+        request->send(200, "application/json", json); });
 
-              if (request->hasParam("mqttEnabled", true))
-              {
-                // the param comes back with the value of "on" if its enabled, and just doesn't exist as a param if its off... so this is an easy way to do it without actually checking the value.
-                Serial.println("Enabling MQTT");
-                mqttConf.mqttEnabled = true;
-              }
-              else
+  server.on("/settings", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              static const char *const checkboxes[] = {"mqttEnabled", "mqttPerFieldTopics"};
+              FormArgs args(request, checkboxes, 2);
+              char json[64];
+              JsonWriter result(json, sizeof(json));
+              result.beginObject();
+              CommandResult outcome = runCommand("setConfig", args, DispenseSource::WEB, result);
+
+              if (outcome.status != CommandStatus::OK)
               {
-                Serial.println("Disabling MQTT");
-                mqttConf.mqttEnabled = false;
+                String response = String(MAIN_PAGE_HEADER) +
+                                  COMMON_HEADER +
+                                  R"(
+                <h1>Settings Not Saved</h1>
+                <div class="status-message status-error">
+                    <p>)" + String(outcome.message) + R"(</p>
+                </div>
+                <meta http-equiv="refresh" content="4;url=/">
+                )" +
+                                  COMMON_FOOTER;
+                request->send(400, "text/html", response);
+                return;
               }
-              saveConfig();
-
-              mqttClient.disconnect();
 
               String response = String(MAIN_PAGE_HEADER) +
                                 COMMON_HEADER +
@@ -920,14 +3025,303 @@ void setupWebServerRoutes(AsyncWebServer &server)
             {
     if (networkState == NetworkState::CONNECTED || networkState == NetworkState::TRIAL_MODE)
     {
-      request->send(200, "text/html", build_main_page_body(mqttClient.connected(), hallEffectCount, hallEffectRunDistanceMultiplier, distanceThreshold, totalDistance, totalTreatsDispensed, outOfTreats_hopper, mqttConf.server, mqttConf.port, mqttConf.username, mqttConf.password, mqttConf.topicPrefix, mqttConf.mqttEnabled));
+      // Stream the page out of flash a chunk at a time, only the handful of dynamic fields get formatted (see templateStreamer.h)
+      MainPageFields fields;
+      fields.mqttConnected = mqttStatus.read().connected;
+      TelemetrySnapshot snapshot = telemetry.read();
+      fields.progressMeters = snapshot.progressDistance / 100;
+      ConfigStore::Ref conf = configStore.current();
+      fields.thresholdMeters = conf->distanceThreshold / 100;
+      fields.totalDistanceMeters = snapshot.totalDistance / 100;
+      fields.treats = snapshot.totalTreats;
+      fields.outOfTreats = snapshot.hopperEmpty;
+      fields.speed = snapshot.speed;
+      fields.peakSpeed = snapshot.peakSpeed;
+      fields.mqttEnabled = conf->mqttEnabled;
+      fields.mqttPerFieldTopics = conf->mqttPerFieldTopics;
+      fields.mqttPort = conf->mqttPort;
+      strlcpy(fields.mqttServer, conf->mqttServer, sizeof(fields.mqttServer));
+      strlcpy(fields.mqttUser, conf->mqttUser, sizeof(fields.mqttUser));
+      strlcpy(fields.mqttPass, conf->mqttPass, sizeof(fields.mqttPass));
+      strlcpy(fields.mqttPrefix, conf->mqttPrefix, sizeof(fields.mqttPrefix));
+
+      TemplateStreamer<MainPageFields> page(MAIN_PAGE, fields);
+      request->send(request->beginChunkedResponse("text/html", [page](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t
+                                                  { return page.fill(buffer, maxLen); }));
     }
     else
     {
-      String response = String(AP_CONFIG_PAGE_HEADER) + 
-                      COMMON_HEADER + 
-                      AP_CONFIG_PAGE + 
-                      COMMON_FOOTER;
-      request->send(200, "text/html", response);
+      sendWebAsset(request, *findWebAsset("/static/setup.html"));
     } });
+
+  // Stylesheet, scripts and the setup page, gzipped at build time
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    const WebAsset *asset = &WEB_ASSETS[i];
+    server.on(asset->path, HTTP_GET, [asset](AsyncWebServerRequest *request)
+              { sendWebAsset(request, *asset); });
+  }
+}
+
+// Returns the length, or 0 if it didn't fit - what's in `buffer` then is cut off and not valid JSON
+size_t buildStatusJson(char *buffer, size_t size)
+{
+  JsonWriter json(buffer, size);
+  json.beginObject();
+  writeStatusFields(json);
+  json.endObject();
+  if (json.overflowed())
+  {
+    Serial.printf("[web] status JSON is more than %u bytes\n", (unsigned)size);
+    return 0;
+  }
+  return json.length();
+}
+
+// Everything in /api/status, also what the getState command answers with
+void writeStatusFields(JsonWriter &json)
+{
+  TelemetrySnapshot snapshot = telemetry.read();
+  MqttStatusSnapshot mqtt = mqttStatus.read();
+  ConfigStore::Ref conf = configStore.current();
+  json.field("progressMeters", snapshot.progressDistance / 100)
+      .field("thresholdMeters", conf->distanceThreshold / 100)
+      .field("totalDistanceMeters", snapshot.totalDistance / 100)
+      .field("treats", snapshot.totalTreats)
+      .field("outOfTreats", snapshot.outOfTreats)
+      .field("hopperEmpty", snapshot.hopperEmpty)
+      .field("dispensing", snapshot.dispensing)
+      .field("speed", snapshot.speed)
+      .field("peakSpeed", snapshot.peakSpeed)
+      .field("cadence", snapshot.cadence, 1)
+      .field("mqttEnabled", conf->mqttEnabled)
+      .field("mqttConnected", mqtt.connected)
+      .field("mqttTaskCpuPercent", mqttTaskLoad.percent(), 2)
+      .beginObject("outbox")
+      .field("queued", mqtt.queued)
+      .field("inFlight", mqtt.inFlight)
+      .field("delivered", mqtt.delivered)
+      .field("dropped", mqtt.dropped)
+      .field("resends", mqtt.resends)
+      .endObject()
+      .beginObject("dispenser")
+      .field("learned", snapshot.dispenseProfile.learned)
+      .field("expectedMs", snapshot.dispenseProfile.expectedMs)
+      .field("deviationMs", snapshot.dispenseProfile.deviationMs)
+      .field("cycles", snapshot.dispenseStats.cycles)
+      .field("averageCycleMs", snapshot.dispenseStats.averageCycleMs)
+      .field("jamPulses", snapshot.dispenseStats.jamPulses)
+      .field("jamsCleared", snapshot.dispenseStats.jamsCleared)
+      .field("lateTreats", snapshot.dispenseStats.lateTreats)
+      .endObject()
+      .beginObject("trace")
+      .field("recording", traceRecorder.recording())
+      .field("bytes", (uint32_t)traceBytes)
+      .field("lost", traceRecorder.lost())
+      .endObject()
+      .field("freeHeap", ESP.getFreeHeap())
+      .field("minFreeHeap", ESP.getMinFreeHeap())
+      .field("uptime", (uint32_t)(millis() / 1000))
+      .beginObject("boot")
+      .field("wifiStartMs", bootTimeline.wifiStartMs)
+      .field("connectedMs", bootTimeline.connectedMs)
+      .field("httpReadyMs", bootTimeline.httpReadyMs)
+      .field("fastConnect", bootTimeline.fastConnect)
+      .endObject();
+}
+
+#if PERF_ENABLED
+// What /api/perf, the getPerf command and <prefix>/perf show
+void writePerfFields(JsonWriter &json)
+{
+  writeLatencyFields(json, "edgeToCount", edgeToCountLatency);
+  writeLatencyFields(json, "beamToStop", beamToStopLatency);
+  writeLatencyFields(json, "beamToLoopStop", beamToLoopStopLatency);
+}
+
+void writeLatencyFields(JsonWriter &json, const char *key, const LatencyHistogram &histogram)
+{
+  LatencyHistogram::Snapshot snapshot;
+  histogram.snapshot(snapshot);
+  json.beginObject(key)
+      .field("count", snapshot.count)
+      .field("p50Us", snapshot.percentile(500))
+      .field("p99Us", snapshot.percentile(990))
+      .field("maxUs", snapshot.maxUs)
+      .endObject();
+}
+#endif
+
+void readTelemetryState(TelemetryState &state)
+{
+  TelemetrySnapshot snapshot = telemetry.read();
+  state.progressMeters = snapshot.progressDistance / 100;
+  state.totalDistanceMeters = snapshot.totalDistance / 100;
+  state.treats = snapshot.totalTreats;
+  state.speed = snapshot.speed;
+  state.peakSpeed = snapshot.peakSpeed;
+  state.outOfTreats = snapshot.outOfTreats;
+  state.hopperEmpty = snapshot.hopperEmpty;
+  state.dispensing = snapshot.dispensing;
+  state.mqttConnected = mqttStatus.read().connected;
+}
+
+// Only the fields that differ from what was sent last time. Returns 0 if nothing changed.
+size_t buildTelemetryDeltaJson(const TelemetryState &previous, const TelemetryState &current, char *buffer, size_t size)
+{
+  JsonWriter json(buffer, size);
+  json.beginObject();
+  bool changed = false;
+  if (current.progressMeters != previous.progressMeters)
+  {
+    json.field("progressMeters", current.progressMeters);
+    changed = true;
+  }
+  if (current.totalDistanceMeters != previous.totalDistanceMeters)
+  {
+    json.field("totalDistanceMeters", current.totalDistanceMeters);
+    changed = true;
+  }
+  if (current.treats != previous.treats)
+  {
+    json.field("treats", current.treats);
+    changed = true;
+  }
+  if (current.speed != previous.speed || current.peakSpeed != previous.peakSpeed)
+  {
+    json.field("speed", current.speed).field("peakSpeed", current.peakSpeed);
+    changed = true;
+  }
+  if (current.outOfTreats != previous.outOfTreats)
+  {
+    json.field("outOfTreats", current.outOfTreats);
+    changed = true;
+  }
+  if (current.hopperEmpty != previous.hopperEmpty)
+  {
+    json.field("hopperEmpty", current.hopperEmpty);
+    changed = true;
+  }
+  if (current.dispensing != previous.dispensing)
+  {
+    json.field("dispensing", current.dispensing);
+    changed = true;
+  }
+  if (current.mqttConnected != previous.mqttConnected)
+  {
+    json.field("mqttConnected", current.mqttConnected);
+    changed = true;
+  }
+  json.endObject();
+  return changed ? json.length() : 0;
+}
+
+// Payload of <prefix>/state. The keys match the old per-field topic names.
+size_t buildMqttStateJson(const TelemetrySnapshot &snapshot, char *buffer, size_t size)
+{
+  JsonWriter json(buffer, size);
+  json.beginObject()
+      .field("totalDistance", snapshot.totalDistance / 100)
+      .field("totalTreatsDispensed", snapshot.totalTreats)
+      .field("isOutOfTreats", snapshot.outOfTreats)
+      .field("hopperEmpty", snapshot.hopperEmpty)
+      .field("speed", snapshot.speed / 100.0f, 2)
+      .field("peakSpeed", snapshot.peakSpeed / 100.0f, 2)
+      .field("sessionCadence", snapshot.cadence, 1)
+      .field("progressDistance", snapshot.progressDistance / 100)
+      .endObject();
+  return json.length();
+}
+
+// Payload of <prefix>/events
+size_t buildOutboxEventJson(const OutboxEvent &event, char *buffer, size_t size)
+{
+  // If the clock wasn't set yet when it happened, but it was this boot and the clock is set now, we can still work it out
+  uint32_t time = event.time;
+  uint32_t now = unixTimeNow();
+  if (time == 0 && event.bootId == bootId && now != 0)
+  {
+    time = now - (millis() - event.uptimeMs) / 1000;
+  }
+
+  // boot and seq have to stay first, mqttCallback picks them out of the echo
+  JsonWriter json(buffer, size);
+  json.beginObject()
+      .field("boot", event.bootId)
+      .field("seq", event.sequence)
+      .field("uptimeMs", event.uptimeMs);
+  if (time != 0)
+  {
+    json.field("time", time);
+  }
+  switch (event.type)
+  {
+  case OutboxEventType::DISPENSE:
+    json.field("type", "dispense")
+        .field("id", event.values[0])
+        .field("source", dispenseSourceName((DispenseSource)((event.values[1] >> 16) & 0xFF)))
+        .field("status", dispenseStatusName((DispenseStatus)(event.values[1] >> 24)))
+        .field("requested", event.values[1] & 0xFF)
+        .field("dispensed", (event.values[1] >> 8) & 0xFF)
+        .field("mergedInto", event.values[2]);
+    break;
+  case OutboxEventType::OUT_OF_TREATS:
+    json.field("type", "outOfTreats")
+        .field("outOfTreats", event.values[0] != 0)
+        .field("hopperEmpty", event.values[1] != 0);
+    break;
+  case OutboxEventType::SESSION:
+    json.field("type", "session")
+        .field("durationMs", event.values[0])
+        .field("distanceCm", event.values[1])
+        .field("peakSpeed", event.values[2] / 100.0f, 2);
+    break;
+  }
+  json.endObject();
+  return json.length();
+}
+
+size_t buildDispenseCompletionJson(const DispenseCompletion &completion, char *buffer, size_t size)
+{
+  JsonWriter json(buffer, size);
+  json.beginObject()
+      .field("id", completion.id)
+      .field("source", dispenseSourceName(completion.source))
+      .field("status", dispenseStatusName(completion.status))
+      .field("requested", (uint32_t)completion.requested)
+      .field("dispensed", (uint32_t)completion.dispensed)
+      .field("mergedInto", completion.mergedInto)
+      .endObject();
+  return json.length();
+}
+
+const WebAsset *findWebAsset(const char *path)
+{
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    if (strcmp(WEB_ASSETS[i].path, path) == 0)
+    {
+      return &WEB_ASSETS[i];
+    }
+  }
+  return NULL;
+}
+
+// Assets are already gzipped in flash, so they go out as is. If the browser already has this version, it gets a 304 and no body at all.
+void sendWebAsset(AsyncWebServerRequest *request, const WebAsset &asset)
+{
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", asset.cacheControl);
+    request->send(response);
+    return;
+  }
+
+  AsyncWebServerResponse *response = request->beginResponse(200, asset.contentType, asset.data, asset.length);
+  response->addHeader("Content-Encoding", "gzip");
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", asset.cacheControl);
+  request->send(response);
 }
@@ -0,0 +1,246 @@
+// mqttOutbox.h
+#ifndef MQTTOUTBOX_H
+#define MQTTOUTBOX_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Store and forward for the events we report over MQTT (dispenses, running out of treats, finished sessions), so a
+//   broker that's down for a while doesn't mean they're just gone.
+//
+// Events wait in a small RAM queue, and move out to flash (OutboxSpill, SPIFFS in main.cpp) when that fills up, or
+//   straight away while the broker can't be reached so they survive a reboot too. Flash holds the oldest events, RAM the
+//   newest, and they go out oldest first.
+//
+// PubSubClient can only publish at QoS 0, so the acknowledgement is the broker sending the event back to us: we
+//   subscribe to our own events topic, and an event counts as delivered once it comes back. Up to MAX_IN_FLIGHT events
+//   are sent before waiting on that, and if nothing comes back within the ack timeout the whole window is sent again.
+//   That's at-least-once delivery like QoS 1 - a consumer can use (boot, seq) to spot the odd duplicate.
+//
+// Only ever used from the mqtt task. No ESP32 dependencies, the flash side goes through the OutboxSpill callbacks.
+
+enum class OutboxEventType : uint8_t
+{
+  DISPENSE,      // values: request id, requested | dispensed << 8 | source << 16 | status << 24, merged into
+  OUT_OF_TREATS, // values: out of treats (0 / 1), hopper empty (0 / 1)
+  SESSION        // values: duration ms, distance cm, peak speed cm/s
+};
+
+struct OutboxEvent
+{
+  uint32_t bootId;   // random number picked on boot, so (bootId, sequence) is unique across reboots
+  uint32_t sequence; // counts up from 1 every boot
+  uint32_t uptimeMs; // millis() when it happened
+  uint32_t time;     // unix time when it happened, 0 if the clock wasn't set yet
+  OutboxEventType type;
+  uint8_t reserved[3];
+  uint32_t values[3]; // see OutboxEventType
+};
+
+struct OutboxSpill
+{
+  bool (*append)(const OutboxEvent *events, uint32_t count); // add to the back
+  bool (*read)(uint32_t index, OutboxEvent &event);          // 0 is the oldest
+  void (*drop)(uint32_t count);                              // forget the oldest `count`
+  uint32_t (*count)();
+  uint32_t capacity; // events, 0 = no flash, RAM only
+};
+
+class MqttOutbox
+{
+public:
+  static const uint32_t RAM_EVENTS = 32;
+  static const uint32_t MAX_IN_FLIGHT = 8;
+
+  void begin(const OutboxSpill &spill, uint32_t ackTimeoutMs)
+  {
+    spill_ = spill;
+    ackTimeoutMs_ = ackTimeoutMs;
+  }
+
+  // Adds an event at the back. When RAM and flash are both full the oldest event is dropped to make room.
+  void push(const OutboxEvent &event)
+  {
+    if (ramCount_ == RAM_EVENTS)
+    {
+      spillRam(RAM_EVENTS / 2);
+    }
+    if (ramCount_ == RAM_EVENTS)
+    {
+      removeOldest(1); // flash is full or broken
+      dropped_++;
+    }
+    ram_[(ramStart_ + ramCount_) % RAM_EVENTS] = event;
+    ramCount_++;
+  }
+
+  // Moves everything from RAM to flash, so it survives a reboot. For while the broker can't be reached.
+  void persist()
+  {
+    spillRam(ramCount_);
+  }
+
+  // The next event to publish, if there is one and the in-flight window has room for it
+  bool nextToSend(OutboxEvent &event)
+  {
+    if (sent_ >= size() || sent_ >= MAX_IN_FLIGHT)
+    {
+      return false;
+    }
+    if (!at(sent_, event))
+    {
+      // unreadable flash record, nothing we can do with it
+      if (sent_ == 0)
+      {
+        removeOldest(1);
+        dropped_++;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  void markSent(uint32_t nowMs)
+  {
+    if (sent_ == 0)
+    {
+      lastProgressMs_ = nowMs;
+    }
+    sent_++;
+  }
+
+  // An event came back from the broker. Everything goes over one connection in order, so that means the broker also
+  //   has every event we sent before it. False if it wasn't one of ours (or was a duplicate).
+  bool acknowledge(uint32_t bootId, uint32_t sequence, uint32_t nowMs)
+  {
+    for (uint32_t i = 0; i < sent_; i++)
+    {
+      OutboxEvent event;
+      if (at(i, event) && event.bootId == bootId && event.sequence == sequence)
+      {
+        removeOldest(i + 1);
+        delivered_ += i + 1;
+        lastProgressMs_ = nowMs;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Call regularly while connected. Nothing has come back in a while, so assume the window got lost and resend it.
+  void checkTimeout(uint32_t nowMs)
+  {
+    if (sent_ > 0 && nowMs - lastProgressMs_ >= ackTimeoutMs_)
+    {
+      sent_ = 0;
+      resends_++;
+    }
+  }
+
+  // Anything in flight when the connection dropped needs sending again
+  void connectionLost() { sent_ = 0; }
+
+  uint32_t size() const { return spillCount() + ramCount_; }
+  uint32_t ramCount() const { return ramCount_; }
+  uint32_t spillCount() const { return spill_.count != NULL ? spill_.count() : 0; }
+  uint32_t inFlight() const { return sent_; }
+  uint32_t delivered() const { return delivered_; }
+  uint32_t dropped() const { return dropped_; }
+  uint32_t resends() const { return resends_; }
+
+private:
+  bool at(uint32_t index, OutboxEvent &event) const
+  {
+    uint32_t spilled = spillCount();
+    if (index < spilled)
+    {
+      return spill_.read(index, event);
+    }
+    index -= spilled;
+    if (index >= ramCount_)
+    {
+      return false;
+    }
+    event = ram_[(ramStart_ + index) % RAM_EVENTS];
+    return true;
+  }
+
+  // Moves the oldest `count` RAM events to the back of the flash queue. Order is kept, since anything already in flash
+  //   is older than everything in RAM.
+  void spillRam(uint32_t count)
+  {
+    if (spill_.capacity == 0 || count == 0)
+    {
+      return;
+    }
+    if (count > ramCount_)
+    {
+      count = ramCount_;
+    }
+
+    // make room in flash by letting go of the oldest there
+    uint32_t spilled = spillCount();
+    if (count > spill_.capacity)
+    {
+      count = spill_.capacity;
+    }
+    if (spilled + count > spill_.capacity)
+    {
+      uint32_t overflow = spilled + count - spill_.capacity;
+      spill_.drop(overflow);
+      dropped_ += overflow;
+      sent_ = sent_ > overflow ? sent_ - overflow : 0;
+    }
+
+    // the RAM ring might wrap, so this can take two writes
+    while (count > 0)
+    {
+      uint32_t run = RAM_EVENTS - ramStart_;
+      if (run > count)
+      {
+        run = count;
+      }
+      if (!spill_.append(&ram_[ramStart_], run))
+      {
+        return;
+      }
+      ramStart_ = (ramStart_ + run) % RAM_EVENTS;
+      ramCount_ -= run;
+      count -= run;
+    }
+  }
+
+  void removeOldest(uint32_t count)
+  {
+    sent_ = sent_ > count ? sent_ - count : 0;
+
+    uint32_t spilled = spillCount();
+    uint32_t fromSpill = count < spilled ? count : spilled;
+    if (fromSpill > 0)
+    {
+      spill_.drop(fromSpill);
+      count -= fromSpill;
+    }
+    if (count > ramCount_)
+    {
+      count = ramCount_;
+    }
+    ramStart_ = (ramStart_ + count) % RAM_EVENTS;
+    ramCount_ -= count;
+  }
+
+  OutboxSpill spill_ = {};
+  uint32_t ackTimeoutMs_ = 10000;
+
+  OutboxEvent ram_[RAM_EVENTS];
+  uint32_t ramStart_ = 0;
+  uint32_t ramCount_ = 0;
+
+  uint32_t sent_ = 0; // the oldest `sent_` events are in flight
+  uint32_t lastProgressMs_ = 0;
+
+  uint32_t delivered_ = 0;
+  uint32_t dropped_ = 0;
+  uint32_t resends_ = 0;
+};
+
+#endif // MQTTOUTBOX_H
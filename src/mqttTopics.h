@@ -0,0 +1,61 @@
+// mqttTopics.h
+#ifndef MQTTTOPICS_H
+#define MQTTTOPICS_H
+#include <stdio.h>
+#include <stddef.h>
+
+// Every topic we publish or subscribe to, built once from the topic prefix whenever the settings change (rather than
+//   gluing Strings together on every publish), and matched against with a plain strcmp in the callback.
+struct MqttTopics
+{
+  static const size_t TOPIC_SIZE = 128; // AppConfig::mqttPrefix (95) plus the longest suffix
+
+  char state[TOPIC_SIZE];          // retained JSON with all the usage stats
+  char dispenseResult[TOPIC_SIZE]; // JSON, one per finished dispense request
+  char manualDispense[TOPIC_SIZE]; // we subscribe to this, payload is the number of treats
+  char events[TOPIC_SIZE];         // JSON, the outbox (see mqttOutbox.h). We subscribe to it too, for the acks.
+  char availability[TOPIC_SIZE];   // retained "online", or "offline" (our last will if we drop off without saying)
+  char commands[TOPIC_SIZE];       // <prefix>/cmd/+ - we subscribe to this, see runCommand() in main.cpp
+  char commandBase[TOPIC_SIZE];    // <prefix>/cmd/ - what's left of the topic after this is the command name
+  char reply[TOPIC_SIZE];          // JSON answers to the commands
+  char perf[TOPIC_SIZE];           // retained JSON, hot path latencies (see latencyHistogram.h)
+
+  // The old one value per topic layout, only published if mqttPerFieldTopics is turned on
+  char totalDistance[TOPIC_SIZE];
+  char totalTreatsDispensed[TOPIC_SIZE];
+  char isOutOfTreats[TOPIC_SIZE];
+  char speed[TOPIC_SIZE];
+  char peakSpeed[TOPIC_SIZE];
+  char sessionCadence[TOPIC_SIZE];
+
+  // False if the prefix was too long for one of them (they're cut short in that case)
+  bool build(const char *prefix)
+  {
+    bool ok = true;
+    ok &= join(state, prefix, "/state");
+    ok &= join(dispenseResult, prefix, "/dispenseResult");
+    ok &= join(manualDispense, prefix, "/manualDispense");
+    ok &= join(events, prefix, "/events");
+    ok &= join(availability, prefix, "/availability");
+    ok &= join(commands, prefix, "/cmd/+");
+    ok &= join(commandBase, prefix, "/cmd/");
+    ok &= join(reply, prefix, "/reply");
+    ok &= join(perf, prefix, "/perf");
+    ok &= join(totalDistance, prefix, "/totalDistance");
+    ok &= join(totalTreatsDispensed, prefix, "/totalTreatsDispensed");
+    ok &= join(isOutOfTreats, prefix, "/isOutOfTreats");
+    ok &= join(speed, prefix, "/speed");
+    ok &= join(peakSpeed, prefix, "/peakSpeed");
+    ok &= join(sessionCadence, prefix, "/sessionCadence");
+    return ok;
+  }
+
+private:
+  static bool join(char (&topic)[TOPIC_SIZE], const char *prefix, const char *suffix)
+  {
+    int length = snprintf(topic, TOPIC_SIZE, "%s%s", prefix, suffix);
+    return length >= 0 && (size_t)length < TOPIC_SIZE;
+  }
+};
+
+#endif // MQTTTOPICS_H
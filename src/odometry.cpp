@@ -0,0 +1,66 @@
+#include <atomic>
+#include "hal.h"
+#include "odometry.h"
+
+#ifdef ARDUINO
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
+
+static const int16_t ODOMETRY_PCNT_HIGH_LIMIT = 32767;
+
+// Only the overflow ISR writes this, and a 32 bit atomic can't be read half updated from the other core. 2^32 wraps of
+//   32767 edges is further than any cat will ever run.
+static std::atomic<uint32_t> overflowCount{0};
+static uint64_t lastReportedEdges = 0;
+
+// The counter resets to zero when it reaches its high limit, so count that towards our software total
+static void IRAM_ATTR handleOdometryOverflowISR()
+{
+  overflowCount.store(overflowCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void odometryBegin(int hallPin, uint16_t glitchFilterCycles)
+{
+  halPinInput(hallPin);
+  if (glitchFilterCycles > 1023)
+  {
+    glitchFilterCycles = 1023; // the filter register is only 10 bits wide
+  }
+  // the sensor pulls the pin low when a magnet passes, the counter counts those falling edges
+  halPulseCounterBegin(hallPin, ODOMETRY_PCNT_HIGH_LIMIT, glitchFilterCycles, handleOdometryOverflowISR);
+}
+
+uint64_t odometryTotalEdges()
+{
+  uint32_t overflowBefore;
+  uint32_t overflowAfter;
+  int16_t count;
+
+  // If the overflow ISR fires between reading the two halves, read them again
+  do
+  {
+    overflowBefore = overflowCount.load(std::memory_order_acquire);
+    count = halPulseCounterRead();
+    overflowAfter = overflowCount.load(std::memory_order_acquire);
+  } while (overflowBefore != overflowAfter);
+
+  return (uint64_t)overflowAfter * ODOMETRY_PCNT_HIGH_LIMIT + (uint16_t)count;
+}
+
+uint32_t odometryTakeNewEdges()
+{
+  uint64_t total = odometryTotalEdges();
+
+  // The counter can wrap to zero a moment before its overflow ISR has run. In that window the total looks like it went
+  //   backwards, so just report nothing new this time - the edges show up on the next call once the ISR catches up.
+  if (total <= lastReportedEdges)
+  {
+    return 0;
+  }
+
+  uint32_t newEdges = (uint32_t)(total - lastReportedEdges);
+  lastReportedEdges = total;
+  return newEdges;
+}
@@ -0,0 +1,23 @@
+// odometry.h
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+#include <stdint.h>
+
+// Wheel odometry. Hall effect edges are counted in hardware by the ESP32 pulse counter (PCNT) peripheral, so
+//   rotations are never missed no matter how late mainTask gets scheduled or how fast the cat is running.
+//   The hardware counter is only 16 bits wide, so every time it reaches its high limit it resets to zero and an
+//   overflow interrupt folds the limit into a 64 bit software total.
+//
+// The counter itself is behind hal.h, so the native simulation runs this same code against its model of the PCNT.
+
+// Configure the pulse counter on the hall sensor pin. Pulses shorter than glitchFilterCycles APB clock cycles
+//   (80MHz, max 1023 ~= 12.8us) are ignored by the hardware glitch filter.
+void odometryBegin(int hallPin, uint16_t glitchFilterCycles);
+
+// Total number of hall edges counted since odometryBegin()
+uint64_t odometryTotalEdges();
+
+// Number of hall edges counted since the previous call. Only call this from one task (mainTask)!
+uint32_t odometryTakeNewEdges();
+
+#endif // ODOMETRY_H
@@ -0,0 +1,77 @@
+// rtcCounters.h
+#ifndef RTCCOUNTERS_H
+#define RTCCOUNTERS_H
+#include <stdint.h>
+#include <stddef.h>
+#include "statsJournal.h"
+
+// Live copy of the counters in RTC memory (RTC_NOINIT_ATTR in main.cpp), which keeps its contents through every kind
+//   of reset except the power actually going away - crashes, watchdog, ESP.restart() after an update, and brownouts
+//   where the supply sagged but didn't drop out completely. mainTask updates it whenever a counter changes, so after
+//   one of those resets we pick up exactly where we were, including the progress towards the next treat.
+//
+// Two slots are written alternately with a generation number and a crc, so a reset in the middle of an update leaves
+//   the other slot intact. After a real power cut the memory is random junk, which fails the magic / crc check, and
+//   we fall back to the stats journal.
+
+struct RtcCounters
+{
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t totalDistance;
+  uint32_t totalTreats;
+  uint32_t hallEffectCount;
+  uint32_t crc;
+};
+
+class RtcCounterMirror
+{
+public:
+  static const uint32_t MAGIC = 0xCA7B0001; // bump if RtcCounters changes, so a new firmware ignores the old layout
+
+  explicit RtcCounterMirror(RtcCounters *slots) : slots_(slots) {}
+
+  // Newest valid slot, if there is one. Call once on boot before the first write().
+  bool restore(RtcCounters &out)
+  {
+    bool found = false;
+    for (int i = 0; i < 2; i++)
+    {
+      if (isValid(slots_[i]) && (!found || slots_[i].generation > out.generation))
+      {
+        out = slots_[i];
+        found = true;
+      }
+    }
+    generation_ = found ? out.generation : 0;
+    return found;
+  }
+
+  void write(uint32_t totalDistance, uint32_t totalTreats, uint32_t hallEffectCount)
+  {
+    generation_++;
+    RtcCounters &slot = slots_[generation_ % 2];
+    slot.magic = MAGIC;
+    slot.generation = generation_;
+    slot.totalDistance = totalDistance;
+    slot.totalTreats = totalTreats;
+    slot.hallEffectCount = hallEffectCount;
+    slot.crc = checksum(slot); // a reset before this line leaves the slot failing its crc, and the other one gets used
+  }
+
+private:
+  static uint32_t checksum(const RtcCounters &slot)
+  {
+    return StatsJournal::crc32(&slot, offsetof(RtcCounters, crc));
+  }
+
+  static bool isValid(const RtcCounters &slot)
+  {
+    return slot.magic == MAGIC && slot.crc == checksum(slot);
+  }
+
+  RtcCounters *slots_;
+  uint32_t generation_ = 0;
+};
+
+#endif // RTCCOUNTERS_H
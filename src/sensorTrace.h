@@ -0,0 +1,231 @@
+// sensorTrace.h
+#ifndef SENSORTRACE_H
+#define SENSORTRACE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "wheelController.h"
+
+// Recording of everything the wheel controller (wheelController.h) was told and everything it did, so a problem that
+//   only shows up with a real cat on the wheel - a missed rotation, the hopper flagged empty when it isn't, a dispense
+//   that took 30 seconds - can be taken off the device and replayed through the same code on a PC, as often as we like
+//   (`program replay`, see sim/traceReplay.cpp).
+//
+// A trace is a TraceHeader followed by 8 byte TraceRecords, each one microseconds since the previous record plus an
+//   event and a 24 bit value. Inputs are timestamped where they happened (the hall and photodiode ISRs), outputs when
+//   mainTask made them. On the wheel the records go through a ring to a task that writes them to SPIFFS (main.cpp),
+//   the simulation just keeps them in memory.
+
+enum class TraceEvent : uint8_t
+{
+  // inputs, what replay feeds back in
+  HALL_EDGE,     // hall ISR fired
+  EDGE_COUNT,    // value: new edges from the pulse counter on this loop
+  DISPENSE_BEAM, // dispense photodiode ISR fired
+  HOPPER_BEAM,   // hopper photodiode ISR fired
+  REQUEST,       // value: source | count << 8, taken off the dispense queue. DISTANCE ones are the controller's own doing.
+  RESET_ERRORS,
+  RESET_STATS,
+  THRESHOLD, // value: cm per treat
+
+  // outputs, what replay compares against
+  SERVO, // value: microseconds
+  LEDS,  // value: on (1) / off (0)
+  STATE, // value: DispenseState
+  FLAGS, // value: out of treats | hopper empty << 1
+  TREAT, // value: total treats (low 24 bits)
+
+  // bookkeeping
+  IDLE, // nothing happened, the gap was just too long for one record
+  LOST  // value: records that didn't make it into the trace because the writer fell behind
+};
+
+struct TraceHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  int64_t startUs;    // halMicros() when recording started, record times count on from here
+  uint32_t cmPerEdge; // the settings the controller was running with
+  uint32_t magnetCount;
+  uint32_t sessionGapMs;
+  uint32_t minEdgeIntervalUs;
+  uint32_t distanceThreshold;
+  uint32_t coalesceMs;
+  uint32_t minIntervalMs;
+  uint32_t maxPerRequest;
+  uint32_t totalDistance; // and where it was at
+  uint32_t totalTreats;
+  uint32_t hallEffectCount;
+  uint32_t flags; // out of treats | hopper empty << 1
+  DispenseProfileState profile; // the motor speed profile it had learned (see dispenseProfile.h)
+};
+
+struct TraceRecord
+{
+  int32_t deltaUs; // since the previous record. Can be a little negative, an ISR timestamp is older than the loop that records it.
+  uint32_t word;   // event << 24 | value
+
+  TraceEvent event() const { return (TraceEvent)(word >> 24); }
+  uint32_t value() const { return word & 0xFFFFFF; }
+};
+
+struct TraceSink
+{
+  bool (*put)(const TraceRecord &record); // false if there's no room
+};
+
+class TraceRecorder
+{
+public:
+  static const uint32_t MAGIC = 0x52545743; // "CWTR"
+  static const uint16_t VERSION = 2;
+
+  // The settings and counters as they are right now, for the start of a trace
+  static void fillHeader(TraceHeader &header, const WheelController &wheel, uint32_t magnetCount, uint32_t sessionGapMs, uint32_t minEdgeIntervalUs,
+                         uint32_t coalesceMs, uint32_t minIntervalMs, uint32_t maxPerRequest, int64_t nowUs)
+  {
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.headerSize = sizeof(TraceHeader);
+    header.startUs = nowUs;
+    header.cmPerEdge = wheel.cmPerEdge();
+    header.magnetCount = magnetCount;
+    header.sessionGapMs = sessionGapMs;
+    header.minEdgeIntervalUs = minEdgeIntervalUs;
+    header.distanceThreshold = wheel.distanceThreshold();
+    header.coalesceMs = coalesceMs;
+    header.minIntervalMs = minIntervalMs;
+    header.maxPerRequest = maxPerRequest;
+    header.totalDistance = wheel.totalDistance();
+    header.totalTreats = wheel.totalTreats();
+    header.hallEffectCount = wheel.hallEffectCount();
+    header.flags = flagsOf(wheel);
+    header.profile = wheel.dispenser().profile().state();
+  }
+
+  static uint32_t flagsOf(const WheelController &wheel)
+  {
+    return (wheel.outOfTreats() ? 1 : 0) | (wheel.hopperEmpty() ? 2 : 0);
+  }
+
+  // Only ever from the one task that also calls record() / observe()
+  void start(const TraceSink &sink, const TraceHeader &header, const WheelController &wheel)
+  {
+    sink_ = sink;
+    lastUs_ = header.startUs;
+    lost_ = 0;
+    unreported_ = 0;
+    state_ = wheel.dispenser().state();
+    flags_ = header.flags;
+    treats_ = header.totalTreats;
+    recording_.store(true, std::memory_order_release);
+  }
+
+  void stop() { recording_.store(false, std::memory_order_release); }
+
+  // Fine to call from anywhere
+  bool recording() const { return recording_.load(std::memory_order_acquire); }
+  uint32_t lost() const { return lost_; }
+
+  void record(int64_t timeUs, TraceEvent event, uint32_t value)
+  {
+    if (!recording_.load(std::memory_order_relaxed))
+    {
+      return;
+    }
+    if (unreported_ > 0)
+    {
+      if (!put(timeUs, TraceEvent::LOST, unreported_))
+      {
+        lost_++;
+        unreported_++;
+        return;
+      }
+      unreported_ = 0;
+    }
+    if (!put(timeUs, event, value))
+    {
+      lost_++;
+      unreported_++;
+    }
+  }
+
+  // After every controller update - records the dispenser state, the error flags and the treat count when they move
+  void observe(const WheelController &wheel, int64_t nowUs)
+  {
+    if (!recording_.load(std::memory_order_relaxed))
+    {
+      return;
+    }
+    if (wheel.dispenser().state() != state_)
+    {
+      state_ = wheel.dispenser().state();
+      record(nowUs, TraceEvent::STATE, (uint32_t)state_);
+    }
+    uint32_t flags = flagsOf(wheel);
+    if (flags != flags_)
+    {
+      flags_ = flags;
+      record(nowUs, TraceEvent::FLAGS, flags);
+    }
+    if (wheel.totalTreats() != treats_)
+    {
+      treats_ = wheel.totalTreats();
+      record(nowUs, TraceEvent::TREAT, treats_ & 0xFFFFFF);
+    }
+  }
+
+private:
+  bool put(int64_t timeUs, TraceEvent event, uint32_t value)
+  {
+    // a gap longer than one record can hold (~35 minutes of a quiet wheel) gets IDLE records in front
+    int64_t delta = timeUs - lastUs_;
+    while (delta > INT32_MAX)
+    {
+      TraceRecord idle = {INT32_MAX, (uint32_t)TraceEvent::IDLE << 24};
+      if (!sink_.put(idle))
+      {
+        return false;
+      }
+      lastUs_ += INT32_MAX;
+      delta -= INT32_MAX;
+    }
+    TraceRecord record = {(int32_t)delta, ((uint32_t)event << 24) | (value & 0xFFFFFF)};
+    if (!sink_.put(record))
+    {
+      return false;
+    }
+    lastUs_ = timeUs;
+    return true;
+  }
+
+  TraceSink sink_ = {};
+  std::atomic<bool> recording_{false};
+  int64_t lastUs_ = 0;
+  uint32_t lost_ = 0;
+  uint32_t unreported_ = 0; // lost since the last LOST record
+  DispenseState state_ = DispenseState::IDLE;
+  uint32_t flags_ = 0;
+  uint32_t treats_ = 0;
+};
+
+// Turns records back into absolute times. IDLE records come back too, there's nothing to do with them but skip them.
+class TraceDecoder
+{
+public:
+  explicit TraceDecoder(const TraceHeader &header) : timeUs_(header.startUs) {}
+
+  int64_t next(const TraceRecord &record)
+  {
+    timeUs_ += record.deltaUs;
+    return timeUs_;
+  }
+
+private:
+  int64_t timeUs_;
+};
+
+#endif // SENSORTRACE_H
@@ -0,0 +1,90 @@
+// seqLock.h
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+// Single writer, many reader sequence lock. The writer never waits on anyone, which is the point - mainTask publishes
+//   through this from core 0 and nothing on core 1 can ever hold it up. Readers always come away with a copy that was
+//   written in one go (never half of an old update and half of a new one), and just try again in the rare case that
+//   they raced the writer.
+//
+// The data is kept as 32 bit atomic words rather than a plain struct, so the racing reads are well defined C++ rather
+//   than a data race the compiler is allowed to get creative with. T has to be a plain struct (trivially copyable).
+template <typename T>
+class SeqLock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a plain struct");
+
+public:
+  SeqLock() : sequence_(0)
+  {
+    for (size_t i = 0; i < WORDS; i++)
+    {
+      words_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Only ever call this from one task at a time
+  void write(const T &value)
+  {
+    uint32_t words[WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed); // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++)
+    {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // One attempt. False if the writer was busy, `out` is left alone in that case.
+  bool tryRead(T &out) const
+  {
+    uint32_t before = sequence_.load(std::memory_order_acquire);
+    if (before & 1)
+    {
+      return false;
+    }
+
+    uint32_t words[WORDS];
+    for (size_t i = 0; i < WORDS; i++)
+    {
+      words[i] = words_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence_.load(std::memory_order_relaxed) != before)
+    {
+      return false;
+    }
+
+    memcpy(&out, words, sizeof(T));
+    return true;
+  }
+
+  // Keeps trying until it gets a clean copy. The writer only takes a few hundred nanoseconds, so this hardly ever loops.
+  T read() const
+  {
+    T value;
+    while (!tryRead(value))
+    {
+    }
+    return value;
+  }
+
+  // Goes up by 2 with every write, so readers can tell whether anything has been published since they last looked
+  uint32_t version() const { return sequence_.load(std::memory_order_acquire); }
+
+private:
+  static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+  std::atomic<uint32_t> sequence_;
+  std::atomic<uint32_t> words_[WORDS];
+};
+
+#endif // SEQLOCK_H
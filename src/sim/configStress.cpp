@@ -0,0 +1,179 @@
+// Hammers ConfigStore (see appConfig.h) from several threads at once, the way the web server, the MQTT command handler
+//   and mainTask share it on the wheel:
+//   .pio/build/native/program config-stress [writers] [updates per writer] [readers]
+//
+// Every writer bumps distanceThreshold by one per update, through update() like a settings change does, and every so
+//   often tries an edit validateAppConfig() has to turn down. Each published config also carries its threshold written
+//   out in mqttServer and mqttPort, so a reader can tell a config that was put together from two updates. At the end
+//   the threshold, the version and changeCount() all have to have moved by exactly writers x updates - anything less
+//   is an update that lost the compare-and-swap race and went missing. Before all that, a saved config with a legacy
+//   distance of 0 has to come back out of repairAppConfig() with only that setting changed. Exits with 1 if anything
+//   is off.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "appConfig.h"
+#include "sim.h"
+
+static const uint32_t START_THRESHOLD = 100;
+static const uint32_t REJECT_EVERY = 97; // updates between edits that have to be rejected
+static uint32_t startVersion = 0;         // the version that went with START_THRESHOLD
+
+static void setFromThreshold(AppConfig &config, uint32_t threshold)
+{
+  config.distanceThreshold = threshold;
+  config.mqttPort = 1 + threshold % 60000;
+  snprintf(config.mqttServer, sizeof(config.mqttServer), "host-%u", threshold);
+}
+
+// What's wrong with a config someone got from current(), or NULL
+static const char *checkConsistent(const AppConfig &config)
+{
+  char server[sizeof(config.mqttServer)];
+  snprintf(server, sizeof(server), "host-%u", config.distanceThreshold);
+  if (strcmp(server, config.mqttServer) != 0 || config.mqttPort != 1 + config.distanceThreshold % 60000)
+  {
+    return "fields from different updates";
+  }
+  if (config.distanceThreshold - START_THRESHOLD != config.version - startVersion)
+  {
+    return "threshold and version moved apart";
+  }
+  return NULL;
+}
+
+int runConfigStress(int argc, char **argv)
+{
+  int writers = argc > 1 ? atoi(argv[1]) : 4;
+  int updates = argc > 2 ? atoi(argv[2]) : 20000;
+  int readers = argc > 3 ? atoi(argv[3]) : 2;
+  if (writers < 1 || updates < 1 || readers < 0)
+  {
+    printf("usage: config-stress [writers] [updates per writer] [readers]\n");
+    return 2;
+  }
+
+  std::atomic<uint32_t> failures{0};
+  AppConfig legacy;
+  setAppConfigDefaults(legacy);
+  legacy.distanceThreshold = 0;
+  legacy.mqttEnabled = true;
+  strcpy(legacy.mqttServer, "broker.lan");
+  strcpy(legacy.mqttPass, "secret");
+  AppConfig repaired = legacy;
+  int fixes = repairAppConfig(repaired);
+  legacy.distanceThreshold = repaired.distanceThreshold;
+  if (fixes != 1 || validateAppConfig(repaired) != NULL || memcmp(&legacy, &repaired, sizeof(legacy)) != 0)
+  {
+    printf("FAIL: repairing a legacy distance of 0 changed %d settings or didn't fix it\n", fixes);
+    failures++;
+  }
+
+  ConfigStore store;
+  store.update([](AppConfig &config)
+               { setFromThreshold(config, START_THRESHOLD); });
+  AppConfig first = *store.current();
+  startVersion = first.version;
+  uint32_t firstChanges = store.changeCount();
+
+  std::atomic<bool> writing{true};
+  std::atomic<uint32_t> rejected{0};
+  std::atomic<uint64_t> retries{0};
+  std::atomic<uint64_t> reads{0};
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < writers; w++)
+  {
+    threads.emplace_back([&]()
+                         {
+      for (int i = 0; i < updates; i++)
+      {
+        int runs = 0;
+        AppConfig before = {}, after = {};
+        const char *error = store.update([&](AppConfig &config)
+                                         {
+          if (runs++ == 0)
+          {
+            std::this_thread::yield(); // widen the window between copying the config and swapping it in
+          }
+          setFromThreshold(config, config.distanceThreshold + 1); }, &before, &after);
+        retries.fetch_add(runs - 1, std::memory_order_relaxed);
+        if (error != NULL || after.version != before.version + 1 || after.distanceThreshold != before.distanceThreshold + 1)
+        {
+          printf("FAIL: update went wrong (%s)\n", error != NULL ? error : "before / after don't follow on");
+          failures++;
+        }
+
+        if (i % REJECT_EVERY == 0)
+        {
+          if (store.update([](AppConfig &config)
+                           { config.distanceThreshold = 0; }) == NULL)
+          {
+            printf("FAIL: a threshold of 0 was published\n");
+            failures++;
+          }
+          rejected++;
+        }
+      } });
+  }
+  for (int r = 0; r < readers; r++)
+  {
+    threads.emplace_back([&]()
+                         {
+      uint32_t lastVersion = 0;
+      uint64_t count = 0;
+      while (writing.load(std::memory_order_relaxed))
+      {
+        ConfigStore::Ref config = store.current();
+        const char *problem = checkConsistent(*config);
+        if (problem == NULL && config->version < lastVersion)
+        {
+          problem = "version went backwards";
+        }
+        if (problem != NULL)
+        {
+          printf("FAIL: reader saw version %u with %s\n", config->version, problem);
+          failures++;
+          break;
+        }
+        lastVersion = config->version;
+        count++;
+        std::this_thread::yield();
+      }
+      reads.fetch_add(count, std::memory_order_relaxed); });
+  }
+
+  for (int w = 0; w < writers; w++)
+  {
+    threads[w].join();
+  }
+  writing = false;
+  for (size_t t = writers; t < threads.size(); t++)
+  {
+    threads[t].join();
+  }
+
+  uint32_t expected = (uint32_t)writers * updates;
+  ConfigStore::Ref last = store.current();
+  const char *problem = checkConsistent(*last);
+  if (problem != NULL)
+  {
+    printf("FAIL: final config has %s\n", problem);
+    failures++;
+  }
+  if (last->distanceThreshold - first.distanceThreshold != expected || last->version - first.version != expected ||
+      store.changeCount() - firstChanges != expected)
+  {
+    printf("FAIL: %u updates went in, but the threshold moved %u, the version %u and changeCount %u\n", expected,
+           last->distanceThreshold - first.distanceThreshold, last->version - first.version, store.changeCount() - firstChanges);
+    failures++;
+  }
+
+  printf("%d writers x %d updates, %d readers: %llu retries after losing the race, %u rejected edits, %llu reads\n", writers,
+         updates, readers, (unsigned long long)retries.load(), rejected.load(), (unsigned long long)reads.load());
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+// Compares the two ways of rendering the main status page (webServerStyle.h):
+//   .pio/build/native/program page-bench [runs]
+//
+// "built" is how build_main_page_body() used to do it: the whole page put together in one heap string, piece by piece,
+//   before the first byte can go out. "streamed" is TemplateStreamer (templateStreamer.h) handing it out in the chunks
+//   AsyncWebServer asks for, with the streamer itself copied into the response like main.cpp does. Both render the
+//   same template with the same fields, so the difference is only in how.
+//
+// Heap use is counted by a counting allocator on everything each path allocates itself - the web server's own buffers
+//   are the same either way and left out. Times are on the host and only mean anything next to each other.
+//   Exits with 1 if the two pages differ or streaming doesn't use less heap (the times are only reported, a busy CI
+//   machine would make them flaky).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "webServerStyle.h"
+#include "templateStreamer.h"
+#include "sim.h"
+
+static const size_t CHUNK_SIZE = 1436; // what AsyncWebServer asks for on a typical TCP segment
+
+static bool counting = false;
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+
+template <typename T>
+struct CountingAllocator
+{
+  typedef T value_type;
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U> &) {}
+
+  T *allocate(size_t count)
+  {
+    if (counting)
+    {
+      heapInUse += count * sizeof(T);
+      heapPeak = heapInUse > heapPeak ? heapInUse : heapPeak;
+    }
+    return std::allocator<T>().allocate(count);
+  }
+
+  void deallocate(T *pointer, size_t count)
+  {
+    if (counting)
+    {
+      heapInUse -= heapInUse >= count * sizeof(T) ? count * sizeof(T) : heapInUse;
+    }
+    std::allocator<T>().deallocate(pointer, count);
+  }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U> &) const { return true; }
+  template <typename U>
+  bool operator!=(const CountingAllocator<U> &) const { return false; }
+};
+
+typedef std::basic_string<char, std::char_traits<char>, CountingAllocator<char>> CountedString;
+typedef TemplateStreamer<MainPageFields> PageStreamer;
+
+static void startCounting()
+{
+  heapInUse = 0;
+  heapPeak = 0;
+  counting = true;
+}
+
+static int64_t elapsedNs(std::chrono::steady_clock::time_point since)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static CountedString buildPage(const MainPageFields &fields)
+{
+  CountedString page;
+  const char *pos = MAIN_PAGE;
+  while (*pos != '\0')
+  {
+    const char *open = strstr(pos, "{{");
+    const char *close = open != NULL ? strstr(open + 2, "}}") : NULL;
+    if (close == NULL)
+    {
+      page += pos;
+      break;
+    }
+    page += CountedString(pos, open - pos);
+    char field[PageStreamer::FIELD_BUFFER_SIZE];
+    size_t length = fields.format(open + 2, close - (open + 2), field, sizeof(field));
+    page += CountedString(field, length < sizeof(field) ? length : sizeof(field) - 1);
+    pos = close + 2;
+  }
+  return page;
+}
+
+int runPageBench(int argc, char **argv)
+{
+  int runs = argc > 1 ? atoi(argv[1]) : 2000;
+  if (runs < 1)
+  {
+    printf("usage: page-bench [runs]\n");
+    return 2;
+  }
+
+  MainPageFields fields = {};
+  fields.mqttConnected = true;
+  fields.progressMeters = 37;
+  fields.thresholdMeters = 100;
+  fields.totalDistanceMeters = 123456;
+  fields.treats = 4321;
+  fields.speed = 412;
+  fields.peakSpeed = 523;
+  fields.mqttEnabled = true;
+  fields.mqttPort = 1883;
+  strcpy(fields.mqttServer, "10.4.0.4");
+  strcpy(fields.mqttUser, "cat_wheel");
+  strcpy(fields.mqttPass, "p\"ss<word>&");
+  strcpy(fields.mqttPrefix, "/iot/device/catwheel/");
+
+  CountedString built;
+  size_t builtPeak = 0;
+  int64_t builtFirstNs = 0;
+  for (int run = 0; run < runs; run++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    startCounting();
+    built = buildPage(fields);
+    builtFirstNs += elapsedNs(start); // nothing can be sent until the whole page is there
+    counting = false;
+    builtPeak = heapPeak;
+  }
+
+  CountedString streamed;
+  size_t streamedPeak = 0;
+  int64_t streamedFirstNs = 0;
+  int64_t streamedAllNs = 0;
+  uint8_t chunk[CHUNK_SIZE];
+  for (int run = 0; run < runs; run++)
+  {
+    streamed.clear();
+    streamed.reserve(built.size()); // the bench keeps what was sent, that's not part of the page's cost
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    startCounting();
+    CountingAllocator<PageStreamer> allocator;
+    PageStreamer *page = new (allocator.allocate(1)) PageStreamer(MAIN_PAGE, fields);
+    size_t length = page->fill(chunk, sizeof(chunk));
+    streamedFirstNs += elapsedNs(start);
+    counting = false;
+    while (length > 0)
+    {
+      streamed.append((const char *)chunk, length);
+      counting = true;
+      length = page->fill(chunk, sizeof(chunk));
+      counting = false;
+    }
+    counting = true;
+    page->~PageStreamer();
+    allocator.deallocate(page, 1);
+    counting = false;
+    streamedAllNs += elapsedNs(start);
+    streamedPeak = heapPeak;
+  }
+
+  int failures = 0;
+  if (streamed != built)
+  {
+    printf("FAIL: the streamed page (%zu bytes) isn't the same as the built one (%zu bytes)\n", streamed.size(), built.size());
+    failures++;
+  }
+  if (streamedPeak >= builtPeak)
+  {
+    printf("FAIL: streaming took %zu bytes of heap, building the page %zu\n", streamedPeak, builtPeak);
+    failures++;
+  }
+
+  printf("page:     %zu bytes, %d runs, %zu byte chunks\n", built.size(), runs, CHUNK_SIZE);
+  printf("built:    peak heap %zu bytes, first byte after %.1f us\n", builtPeak, builtFirstNs / 1000.0 / runs);
+  printf("streamed: peak heap %zu bytes, first byte after %.1f us, whole page %.1f us\n", streamedPeak, streamedFirstNs / 1000.0 / runs,
+         streamedAllNs / 1000.0 / runs);
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+// Checks SpscRing (spscRing.h), the ring the hall effect and photodiode ISRs hand their edges to mainTask through:
+//   .pio/build/native/program ring-stress [items]
+//
+// First on one thread, with a ring small enough to go round it many times: it holds N - 1 items, a push on a full ring
+//   is refused and counted in dropped(), and what comes out is what went in, in order, however many times the indexes
+//   have wrapped past N. Then a producer and a consumer thread pass `items` numbers through a small ring as fast as
+//   they can, the producer trying again whenever the ring is full - every number has to come out exactly once and in
+//   order, and dropped() has to match the pushes that were refused. Exits with 1 if anything is off.
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include "spscRing.h"
+#include "sim.h"
+
+static const size_t SMALL_RING = 8;
+static const size_t THREAD_RING = 64;
+static const int WRAP_ROUNDS = 100;
+
+static int checkOneThread()
+{
+  int failures = 0;
+  SpscRing<uint32_t, SMALL_RING> ring;
+  uint32_t item = 0;
+
+  uint32_t pushed = 0;
+  while (ring.push(pushed))
+  {
+    pushed++;
+  }
+  if (pushed != SMALL_RING - 1 || ring.size() != SMALL_RING - 1 || ring.dropped() != 1)
+  {
+    printf("FAIL: a ring of %zu took %u items before refusing one (size %zu, %u dropped)\n", SMALL_RING, pushed, ring.size(),
+           ring.dropped());
+    failures++;
+  }
+  if (ring.push(pushed) || ring.dropped() != 2)
+  {
+    printf("FAIL: a full ring took another push, or didn't count it (%u dropped)\n", ring.dropped());
+    failures++;
+  }
+
+  // Drain a few and top it up again, over and over, so head and tail wrap past N at every possible offset
+  uint32_t expected = 0;
+  for (int round = 0; round < WRAP_ROUNDS && failures == 0; round++)
+  {
+    size_t take = 1 + round % (SMALL_RING - 1);
+    for (size_t i = 0; i < take; i++)
+    {
+      if (!ring.pop(item) || item != expected)
+      {
+        printf("FAIL: round %d popped %u, expected %u\n", round, item, expected);
+        failures++;
+        break;
+      }
+      expected++;
+    }
+    for (size_t i = 0; i < take; i++)
+    {
+      if (!ring.push(pushed))
+      {
+        printf("FAIL: round %d couldn't push after popping %zu\n", round, take);
+        failures++;
+        break;
+      }
+      pushed++;
+    }
+  }
+  while (ring.pop(item))
+  {
+    if (item != expected)
+    {
+      printf("FAIL: drained %u, expected %u\n", item, expected);
+      failures++;
+      break;
+    }
+    expected++;
+  }
+  if (expected != pushed || !ring.empty() || ring.pop(item) || ring.dropped() != 2)
+  {
+    printf("FAIL: %u pushed but %u came out (%zu left, %u dropped)\n", pushed, expected, ring.size(), ring.dropped());
+    failures++;
+  }
+  return failures;
+}
+
+int runRingStress(int argc, char **argv)
+{
+  long items = argc > 1 ? atol(argv[1]) : 2000000;
+  if (items < 1)
+  {
+    printf("usage: ring-stress [items]\n");
+    return 2;
+  }
+
+  int failures = checkOneThread();
+
+  SpscRing<uint32_t, THREAD_RING> ring;
+  std::atomic<uint32_t> refused{0};
+  std::atomic<bool> consumerFailed{false};
+  uint32_t received = 0;
+
+  std::thread producer([&]()
+                       {
+    for (uint32_t i = 0; i < (uint32_t)items && !consumerFailed.load(std::memory_order_relaxed); i++)
+    {
+      while (!ring.push(i))
+      {
+        refused.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::yield(); // an ISR would have lost it, here the consumer gets a chance to catch up
+      }
+    } });
+  std::thread consumer([&]()
+                       {
+    uint32_t item;
+    while (received < (uint32_t)items)
+    {
+      if (!ring.pop(item))
+      {
+        std::this_thread::yield();
+        continue;
+      }
+      if (item != received)
+      {
+        printf("FAIL: consumer got %u, expected %u\n", item, received);
+        consumerFailed = true;
+        return;
+      }
+      received++;
+    } });
+  producer.join();
+  consumer.join();
+
+  if (consumerFailed || received != (uint32_t)items || !ring.empty())
+  {
+    printf("FAIL: %ld pushed, %u came out in order, %zu left over\n", items, received, ring.size());
+    failures++;
+  }
+  if (ring.dropped() != refused.load())
+  {
+    printf("FAIL: %u pushes were refused but dropped() says %u\n", refused.load(), ring.dropped());
+    failures++;
+  }
+
+  printf("ring of %zu wrapped %d rounds on one thread; %ld items through a ring of %zu across two threads, %u pushes refused while full\n",
+         SMALL_RING, WRAP_ROUNDS, items, THREAD_RING, refused.load());
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+// Hammers SeqLock<TelemetrySnapshot> (seqLock.h, telemetrySnapshot.h) the way mainTask and the web / mqtt tasks share
+//   it on the wheel:
+//   .pio/build/native/program seqlock-stress [writes] [readers]
+//
+// One writer thread publishes snapshots where every field is made from the same counter, and counts up as fast as it
+//   can. The readers read() all the while and check each copy against the snapshot its counter says it should be -
+//   any field from a different write is a torn read. A reader's counter also must never go backwards, and once the
+//   writer is done everyone has to see its last snapshot. Exits with 1 if anything is off.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "seqLock.h"
+#include "telemetrySnapshot.h"
+#include "sim.h"
+
+// Every field from `counter`, so any one of them gives away which write it came from
+static TelemetrySnapshot snapshotFor(uint32_t counter)
+{
+  TelemetrySnapshot snapshot;
+  memset(&snapshot, 0, sizeof(snapshot)); // the padding too, so two of them can be compared with memcmp
+  snapshot.totalDistance = counter;
+  snapshot.totalTreats = counter;
+  snapshot.progressDistance = counter;
+  snapshot.speed = counter;
+  snapshot.peakSpeed = counter;
+  snapshot.cadence = (float)(counter & 0xffff); // exact in a float
+  snapshot.outOfTreats = counter & 1;
+  snapshot.hopperEmpty = counter & 2;
+  snapshot.dispensing = counter & 4;
+  snapshot.dispenseProfile.version = (uint16_t)counter;
+  snapshot.dispenseProfile.earliestMs = (uint16_t)(counter >> 16);
+  snapshot.dispenseProfile.learned = counter;
+  snapshot.dispenseProfile.expectedMs = counter;
+  snapshot.dispenseProfile.deviationMs = counter;
+  snapshot.dispenseStats.cycles = counter;
+  snapshot.dispenseStats.treats = counter;
+  snapshot.dispenseStats.averageCycleMs = counter;
+  snapshot.dispenseStats.jamPulses = counter;
+  snapshot.dispenseStats.jamsCleared = counter;
+  snapshot.dispenseStats.lateTreats = counter;
+  return snapshot;
+}
+
+static bool consistent(const TelemetrySnapshot &snapshot)
+{
+  TelemetrySnapshot expected = snapshotFor(snapshot.totalDistance);
+  return memcmp(&snapshot, &expected, sizeof(snapshot)) == 0;
+}
+
+int runSeqlockStress(int argc, char **argv)
+{
+  long writes = argc > 1 ? atol(argv[1]) : 2000000;
+  int readers = argc > 2 ? atoi(argv[2]) : 3;
+  if (writes < 1 || readers < 1)
+  {
+    printf("usage: seqlock-stress [writes] [readers]\n");
+    return 2;
+  }
+
+  SeqLock<TelemetrySnapshot> telemetry;
+  telemetry.write(snapshotFor(0));
+
+  std::atomic<bool> writing{true};
+  std::atomic<uint32_t> failures{0};
+  std::atomic<uint64_t> reads{0};
+  std::atomic<uint64_t> retries{0};
+
+  std::vector<std::thread> threads;
+  threads.emplace_back([&]()
+                       {
+    for (uint32_t counter = 1; counter <= (uint32_t)writes; counter++)
+    {
+      telemetry.write(snapshotFor(counter));
+    } });
+  for (int r = 0; r < readers; r++)
+  {
+    threads.emplace_back([&]()
+                         {
+      uint32_t lastCounter = 0;
+      uint64_t count = 0, raced = 0;
+      while (writing.load(std::memory_order_relaxed))
+      {
+        // read() with the retries counted, to show the readers really did run into the writer
+        TelemetrySnapshot snapshot;
+        while (!telemetry.tryRead(snapshot))
+        {
+          raced++;
+        }
+        if (!consistent(snapshot) || snapshot.totalDistance < lastCounter)
+        {
+          printf("FAIL: reader got write %u (after %u) with fields from another write\n", snapshot.totalDistance, lastCounter);
+          failures++;
+          break;
+        }
+        lastCounter = snapshot.totalDistance;
+        count++;
+      }
+      reads.fetch_add(count, std::memory_order_relaxed);
+      retries.fetch_add(raced, std::memory_order_relaxed); });
+  }
+
+  threads[0].join();
+  writing = false;
+  for (size_t t = 1; t < threads.size(); t++)
+  {
+    threads[t].join();
+  }
+
+  TelemetrySnapshot last = telemetry.read();
+  if (!consistent(last) || last.totalDistance != (uint32_t)writes || telemetry.version() != 2 * ((uint32_t)writes + 1))
+  {
+    printf("FAIL: after %ld writes the last snapshot is write %u, version %u\n", writes, last.totalDistance, telemetry.version());
+    failures++;
+  }
+
+  printf("%ld writes of %zu bytes, %d readers: %llu reads, %llu retries after racing the writer\n", writes, sizeof(TelemetrySnapshot),
+         readers, (unsigned long long)reads.load(), (unsigned long long)retries.load());
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
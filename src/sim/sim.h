@@ -0,0 +1,16 @@
+// sim.h
+#ifndef SIM_H
+#define SIM_H
+
+// The native program simulates a wheel (simMain.cpp), replays a trace recorded on one (`program replay ...`,
+//   traceReplay.cpp), stress tests the config store from several threads (`program config-stress ...`,
+//   configStress.cpp), compares the two ways of rendering the status page (`program page-bench`, pageBench.cpp), or
+//   pushes a long run of items through the ISR ring from two threads (`program ring-stress ...`, ringStress.cpp), or
+//   reads the telemetry seqlock from several threads while it's written (`program seqlock-stress ...`, seqlockStress.cpp)
+int runReplay(int argc, char **argv);
+int runConfigStress(int argc, char **argv);
+int runPageBench(int argc, char **argv);
+int runRingStress(int argc, char **argv);
+int runSeqlockStress(int argc, char **argv);
+
+#endif // SIM_H
@@ -0,0 +1,1030 @@
+// Native simulation of the wheel, built by `pio run -e native` (see platformio.ini) and run as
+//   .pio/build/native/program [hours] [seed] [-q] [--trace <file>]
+//
+// Runs the same wheel controller, dispenser, odometry, stats journal and MQTT outbox code as the firmware, on the host
+//   hal (halPosix.cpp) in simulated time, against a made up cat, treat hopper and MQTT broker. A day of wheel time takes
+//   under a second, and the same seed always plays out exactly the same, so the numbers at the end can be compared from
+//   one build to the next. After the day is done it sweeps the hall sensor through rising edge rates to show where
+//   polling the pin once a loop starts losing edges and the pulse counter doesn't. Exits with 1 if any of the
+//   bookkeeping doesn't add up.
+//
+// --trace records the run the same way the wheel records a sensor trace (sensorTrace.h), for trying out the replay.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <set>
+#include <vector>
+#include "halPosix.h"
+#include "odometry.h"
+#include "wheelController.h"
+#include "statsJournal.h"
+#include "rtcCounters.h"
+#include "mqttOutbox.h"
+#include "commands.h"
+#include "appConfig.h"
+#include "sensorTrace.h"
+#include "sim.h"
+
+// Same wiring and settings as main.cpp
+static const int hopperLightBreakSensorLEDPin = 18;
+static const int dispenseLightBreakSensorLEDPin = 19;
+static const int motorPin = 21;
+static const int errorLEDPin = 13;
+static const int hallEffectSensorPin = 4;
+static const uint16_t HALL_GLITCH_FILTER_CYCLES = 1023;
+static const uint32_t CM_PER_EDGE = 22;
+static const uint32_t MAGNET_COUNT = 1;
+static const uint32_t DISPENSE_COALESCE_MS = 0;
+static const uint32_t DISPENSE_MIN_INTERVAL_MS = 1000;
+static const uint8_t DISPENSE_MAX_PER_REQUEST = 5;
+static const int64_t MAIN_TICK_US = 5000;
+static const int64_t MQTT_TICK_US = 1000000;
+static const int64_t STATS_CHECKPOINT_US = 5000000;
+static const uint32_t OUTBOX_ACK_TIMEOUT_MS = 10000;
+static const uint32_t OUTBOX_SPILL_EVENTS = 2048;
+static const int DISPENSE_QUEUE_LENGTH = 8;
+
+// The made up world
+static const int HOPPER_CAPACITY = 60;
+static const int64_t REFILL_AFTER_US = 2LL * 3600 * 1000000;          // someone notices the empty hopper after 2 hours
+static const int64_t OUTAGE_EVERY_US = 8LL * 3600 * 1000000;          // the broker goes away every 8 hours...
+static const int64_t OUTAGE_LENGTH_US = 20LL * 60 * 1000000;          // ...for 20 minutes
+static const int64_t REMOTE_DISPENSE_EVERY_US = 2LL * 3600 * 1000000; // home automation asks for treats every 2 hours
+static const uint32_t CONNECTION_DROP_PERCENT = 2; // chance the connection to the broker breaks on any one publish
+static const uint32_t BLIP_PERCENT = 2; // chance the network goes for a few seconds while events are waiting for their ack
+static const uint32_t MAGNET_PULSE_MM = 10;  // the hall sensor reads low while the magnet is within about 1cm of it
+static const uint32_t HALL_GLITCH_PERCENT = 10; // chance an edge comes with a few bounces (shorter than the glitch filter)
+static const uint32_t POWER_CUT_WRITE_PERCENT = 5;  // chance the power goes in the middle of writing a checkpoint
+static const uint32_t POWER_CUT_ERASE_PERCENT = 50; // chance it goes while the journal is erasing its next sector
+
+static bool verbose = true;
+static TraceRecorder trace;
+static std::vector<TraceRecord> traceRecords;
+
+static uint32_t randomBetween(uint32_t low, uint32_t high)
+{
+  return low + halRandom() % (high - low + 1);
+}
+
+static void printTime(FILE *out, int64_t us)
+{
+  int64_t ms = us / 1000;
+  fprintf(out, "[%02d:%02d:%02d.%03d] ", (int)(ms / 3600000), (int)(ms / 60000 % 60), (int)(ms / 1000 % 60), (int)(ms % 1000));
+}
+
+////////////////////////
+///   Wheel glue    ///
+//////////////////////
+// What main.cpp does with FreeRTOS queues, done with plain containers since everything here runs on one thread
+
+static WheelController wheel;
+static std::deque<DispenseRequest> dispenseQueue;
+static uint32_t nextDispenseRequestId = 1;
+static uint32_t completionsByStatus[4];
+static uint32_t treatsReported = 0; // dispensed, according to the completions
+
+static MqttOutbox outbox;
+static const uint32_t bootId = 0x51A1B007;
+static uint32_t nextOutboxSequence = 1;
+static uint32_t eventsPushed = 0;
+
+static void setSensorLeds(bool on)
+{
+  trace.record(halMicros(), TraceEvent::LEDS, on);
+  halDigitalWrite(hopperLightBreakSensorLEDPin, on);
+  halDigitalWrite(dispenseLightBreakSensorLEDPin, on);
+}
+
+static void setMotor(int microseconds)
+{
+  trace.record(halMicros(), TraceEvent::SERVO, microseconds);
+  halServoWrite(microseconds);
+}
+
+static void setErrorLed(bool on)
+{
+  halDigitalWrite(errorLEDPin, on);
+}
+
+static void logLine(const char *message)
+{
+  if (verbose)
+  {
+    printTime(stdout, halMicros());
+    puts(message);
+  }
+}
+
+static void reportCompletion(const DispenseCompletion &completion)
+{
+  completionsByStatus[(int)completion.status]++;
+  treatsReported += completion.dispensed;
+  if (verbose)
+  {
+    printTime(stdout, halMicros());
+    printf("[main] - dispense request %u from %s: %s (%u/%u)\n", completion.id, dispenseSourceName(completion.source),
+           dispenseStatusName(completion.status), completion.dispensed, completion.requested);
+  }
+}
+
+static uint32_t requestDispense(DispenseSource source, uint8_t count)
+{
+  DispenseRequest request = {nextDispenseRequestId++, source, count, halMillis()};
+  if ((int)dispenseQueue.size() >= DISPENSE_QUEUE_LENGTH)
+  {
+    DispenseCompletion completion = {request.id, source, DispenseStatus::REJECTED, count, 0, 0};
+    reportCompletion(completion);
+    return 0;
+  }
+  dispenseQueue.push_back(request);
+  return request.id;
+}
+
+static bool takeDispenseRequest(DispenseRequest &request)
+{
+  if (dispenseQueue.empty())
+  {
+    return false;
+  }
+  request = dispenseQueue.front();
+  dispenseQueue.pop_front();
+  trace.record(halMicros(), TraceEvent::REQUEST, (uint32_t)request.source | (request.count << 8));
+  return true;
+}
+
+static void recordEvent(OutboxEventType type, uint32_t value0, uint32_t value1, uint32_t value2)
+{
+  OutboxEvent event = {};
+  event.bootId = bootId;
+  event.sequence = nextOutboxSequence++;
+  event.uptimeMs = halMillis();
+  event.type = type;
+  event.values[0] = value0;
+  event.values[1] = value1;
+  event.values[2] = value2;
+  outbox.push(event);
+  eventsPushed++;
+}
+
+static bool putTraceRecord(const TraceRecord &record)
+{
+  traceRecords.push_back(record);
+  return true;
+}
+
+static void reportCompletionAndRecord(const DispenseCompletion &completion)
+{
+  reportCompletion(completion);
+  uint32_t packed = completion.requested | (completion.dispensed << 8) | ((uint32_t)completion.source << 16) | ((uint32_t)completion.status << 24);
+  recordEvent(OutboxEventType::DISPENSE, completion.id, packed, completion.mergedInto);
+}
+
+////////////////////////
+///  Flash in RAM   ///
+//////////////////////
+
+static std::vector<uint8_t> journalFlash(16 * StatsJournal::SECTOR_SIZE, 0xFF);
+
+// Power cuts: the next write / erase gets cut off this many bytes in (-1 for none). Everything before that point made
+//   it, the byte it happened in is left half done, and nothing after it - or in any later call - happens at all until
+//   the journal has been recovered again, like after a reboot.
+static int32_t journalCutWriteAt = -1;
+static int32_t journalCutEraseAt = -1;
+static bool journalPowerLost = false;
+
+static bool journalRead(uint32_t offset, void *buffer, size_t length)
+{
+  memcpy(buffer, &journalFlash[offset], length);
+  return true;
+}
+
+static bool journalWrite(uint32_t offset, const void *buffer, size_t length)
+{
+  // NOR flash can only clear bits
+  const uint8_t *bytes = (const uint8_t *)buffer;
+  for (size_t i = 0; i < length && !journalPowerLost; i++)
+  {
+    if ((int32_t)i == journalCutWriteAt)
+    {
+      journalFlash[offset + i] &= bytes[i] | (uint8_t)halRandom(); // only some of the bits got cleared
+      journalPowerLost = true;
+      break;
+    }
+    journalFlash[offset + i] &= bytes[i];
+  }
+  return !journalPowerLost;
+}
+
+static bool journalErase(uint32_t offset)
+{
+  if (journalPowerLost)
+  {
+    return false;
+  }
+  if (journalCutEraseAt >= 0)
+  {
+    memset(&journalFlash[offset], 0xFF, journalCutEraseAt);
+    journalFlash[offset + journalCutEraseAt] |= (uint8_t)halRandom();
+    journalPowerLost = true;
+    return false;
+  }
+  memset(&journalFlash[offset], 0xFF, StatsJournal::SECTOR_SIZE);
+  return true;
+}
+
+static std::vector<OutboxEvent> spill;
+static size_t spillFirst = 0;
+
+static bool spillAppend(const OutboxEvent *events, uint32_t count)
+{
+  spill.insert(spill.end(), events, events + count);
+  return true;
+}
+
+static bool spillRead(uint32_t index, OutboxEvent &event)
+{
+  if (spillFirst + index >= spill.size())
+  {
+    return false;
+  }
+  event = spill[spillFirst + index];
+  return true;
+}
+
+static void spillDrop(uint32_t count)
+{
+  spillFirst += count;
+  if (spillFirst >= spill.size())
+  {
+    spill.clear();
+    spillFirst = 0;
+  }
+}
+
+static uint32_t spillCount()
+{
+  return spill.size() - spillFirst;
+}
+
+////////////////////////
+///   The world     ///
+//////////////////////
+
+// A cat that runs for a bit, has a rest, and runs again
+struct Cat
+{
+  bool running = false;
+  int64_t changeAtUs = 0; // when it starts / stops running
+  int64_t nextEdgeUs = 0;
+  uint32_t speedCmPerSec = 0;
+  uint64_t edges = 0;
+
+  // Moves on to `nowUs`, returns the hall edges (and their times) on the way
+  void advance(int64_t nowUs, std::vector<int64_t> &edgeTimes)
+  {
+    while (true)
+    {
+      if (running && nextEdgeUs <= nowUs && nextEdgeUs < changeAtUs)
+      {
+        edgeTimes.push_back(nextEdgeUs);
+        edges++;
+        int64_t intervalUs = (int64_t)CM_PER_EDGE * 1000000 / speedCmPerSec;
+        nextEdgeUs += intervalUs * (int64_t)randomBetween(95, 105) / 100;
+        continue;
+      }
+      if (changeAtUs <= nowUs)
+      {
+        running = !running;
+        if (running)
+        {
+          speedCmPerSec = randomBetween(100, 500);
+          nextEdgeUs = changeAtUs;
+          changeAtUs += (int64_t)randomBetween(20, 180) * 1000000;
+        }
+        else
+        {
+          changeAtUs += (int64_t)randomBetween(2 * 60, 30 * 60) * 1000000;
+        }
+        continue;
+      }
+      return;
+    }
+  }
+
+  int64_t nextEventUs() const { return running && nextEdgeUs < changeAtUs ? nextEdgeUs : changeAtUs; }
+};
+
+// The hopper and dispense wheel. While the motor turns with the LEDs on, treats tumble past the hopper beam every so
+//   often and one drops through the dispense beam after a while, as long as there are any left.
+//
+// How far the wheel has turned is "travel", motor time at full speed (like dispenseProfile.h), so running slower takes
+//   longer to get a treat out. Most treats come out after about the same travel, some take longer (a gap in the hopper)
+//   and a few jam and only come loose after the motor backs up a bit. The motor takes a moment to stop, and if the next
+//   treat is sitting right behind the one that dropped it goes too - the faster the motor was going, the more likely.
+//   A treat tumbling through the beam sometimes breaks it twice, a few ms apart.
+struct Hopper
+{
+  int treats = HOPPER_CAPACITY;
+  int dropped = 0;
+  int doubles = 0;     // treats that slipped out behind another one, the dispenser never counts these
+  int lateDoubles = 0; // of those, the ones that broke the beam late enough for the dispenser to tell from a bounce
+  uint32_t jams = 0;
+  bool motorWasRunning = false;
+  int64_t lastUs = 0;
+  int64_t travelUs = 0;      // this dispense
+  int64_t treatAtTravelUs = -1;
+  int64_t nextTreatGapUs = 0; // travel from the treat that's coming to the one behind it
+  bool jammed = false;
+  int64_t reverseUs = 0;      // backed up so far while jammed
+  int64_t doubleAtUs = -1;    // when the treat behind the last one follows it out, if it does
+  int64_t bounceAtUs = -1;    // when the last treat through the beam breaks it again, if it does
+  int64_t beamAtUs = 0;       // the last treat that wasn't a double
+  bool lateSeen = false;      // a double behind it has broken the beam outside the bounce window
+  int64_t hopperBeamAtUs = -1;
+
+  static const int64_t COAST_US = 120000;    // stopping time at full speed
+  static const int64_t UNJAM_REVERSE_US = 150000;
+
+  bool motorRunning() const
+  {
+    return halSimServo() != TreatDispenser::MOTOR_STOP_US && halSimOutput(dispenseLightBreakSensorLEDPin);
+  }
+
+  // Fraction of full speed forwards, negative backwards
+  static double speedOf(int servoUs)
+  {
+    return (servoUs - TreatDispenser::MOTOR_STOP_US) / (double)(DispenseProfile::FULL_US - TreatDispenser::MOTOR_STOP_US);
+  }
+
+  void newTreat()
+  {
+    treatAtTravelUs = -1;
+    if (treats <= 0)
+    {
+      return;
+    }
+    treatAtTravelUs = (randomBetween(1, 100) <= 85 ? randomBetween(900, 1500) : randomBetween(1500, 4000)) * 1000LL;
+    nextTreatGapUs = randomBetween(1, 100) <= 20 ? randomBetween(10, 150) * 1000LL : randomBetween(400, 1500) * 1000LL;
+    jammed = randomBetween(1, 100) <= 3;
+    jams += jammed;
+    reverseUs = 0;
+  }
+
+  // Beam breaks due by `nowUs`
+  void advance(int64_t nowUs, bool &dispenseBeam, bool &hopperBeam)
+  {
+    dispenseBeam = false;
+    hopperBeam = false;
+    int64_t elapsedUs = nowUs - lastUs;
+    lastUs = nowUs;
+
+    if (doubleAtUs >= 0 && doubleAtUs <= nowUs)
+    {
+      dispenseBeam = true;
+      treats--;
+      dropped++;
+      doubles++;
+      doubleAtUs = -1;
+      afterBeam(nowUs);
+      bounce(nowUs);
+    }
+    if (bounceAtUs >= 0 && bounceAtUs <= nowUs)
+    {
+      dispenseBeam = true;
+      bounceAtUs = -1;
+      afterBeam(nowUs);
+    }
+
+    bool running = motorRunning();
+    if (running && !motorWasRunning)
+    {
+      travelUs = 0;
+      newTreat();
+      hopperBeamAtUs = treats > 1 ? nowUs + (int64_t)randomBetween(300, 1500) * 1000 : -1;
+    }
+    motorWasRunning = running;
+    if (!running)
+    {
+      treatAtTravelUs = -1; // stopped before anything came out
+      hopperBeamAtUs = -1;
+      return;
+    }
+
+    double speed = speedOf(halSimServo());
+    if (jammed)
+    {
+      if (speed < 0)
+      {
+        reverseUs += elapsedUs;
+        jammed = reverseUs < UNJAM_REVERSE_US;
+      }
+    }
+    else
+    {
+      travelUs += (int64_t)(speed * elapsedUs);
+    }
+
+    if (hopperBeamAtUs >= 0 && hopperBeamAtUs <= nowUs)
+    {
+      hopperBeam = true;
+      hopperBeamAtUs = treats > 1 ? nowUs + (int64_t)randomBetween(300, 1500) * 1000 : -1;
+    }
+    if (treatAtTravelUs >= 0 && travelUs >= treatAtTravelUs)
+    {
+      dispenseBeam = true;
+      treats--;
+      dropped++;
+      treatAtTravelUs = -1;
+      beamAtUs = nowUs;
+      lateSeen = false;
+      bounce(nowUs);
+      // the dispenser stops the motor on this beam, but it coasts on a little and might push the next one out
+      if (treats > 0 && (int64_t)(speed * COAST_US) >= nextTreatGapUs)
+      {
+        doubleAtUs = nowUs + nextTreatGapUs / 2 + 1;
+      }
+    }
+  }
+
+  // A break behind the last treat, by a double or a bounce. Only a double's can be late enough (the same millisecond
+  //   sums the dispenser does), and a double that bounces still only counts once.
+  void afterBeam(int64_t nowUs)
+  {
+    if (!lateSeen && nowUs / 1000 - beamAtUs / 1000 >= TreatDispenser::LATE_TREAT_MIN_MS)
+    {
+      lateSeen = true;
+      lateDoubles++;
+    }
+  }
+
+  void bounce(int64_t nowUs)
+  {
+    if (randomBetween(1, 100) <= 25)
+    {
+      bounceAtUs = nowUs + randomBetween(1, TreatDispenser::LATE_TREAT_MIN_MS / 2) * 1000LL;
+    }
+  }
+
+  int64_t nextEventUs() const
+  {
+    int64_t next = INT64_MAX;
+    double speed = speedOf(halSimServo());
+    if (treatAtTravelUs >= 0 && !jammed && speed > 0)
+    {
+      next = lastUs + (int64_t)((treatAtTravelUs - travelUs) / speed) + 1;
+    }
+    if (hopperBeamAtUs >= 0 && hopperBeamAtUs < next)
+    {
+      next = hopperBeamAtUs;
+    }
+    if (doubleAtUs >= 0 && doubleAtUs < next)
+    {
+      next = doubleAtUs;
+    }
+    if (bounceAtUs >= 0 && bounceAtUs < next)
+    {
+      next = bounceAtUs;
+    }
+    return next;
+  }
+};
+
+// The broker side of the outbox: sends every event we publish back to us, in order. Every so often the connection
+//   breaks, taking that event and any echoes still on their way with it.
+struct Broker
+{
+  struct Echo
+  {
+    int64_t atUs;
+    uint32_t bootId;
+    uint32_t sequence;
+  };
+  std::deque<Echo> echoes;
+  std::set<uint32_t> received;
+  std::set<uint32_t> acknowledged; // echoes the outbox took as delivered, those must never come round again
+  uint32_t published = 0;
+  uint32_t drops = 0;
+  uint32_t duplicates = 0;
+  uint32_t afterAck = 0;
+
+  // False if the connection broke
+  bool publish(const OutboxEvent &event, int64_t nowUs)
+  {
+    published++;
+    if (acknowledged.count(event.sequence) > 0)
+    {
+      afterAck++;
+    }
+    if (randomBetween(1, 100) <= CONNECTION_DROP_PERCENT)
+    {
+      drops++;
+      echoes.clear();
+      return false;
+    }
+    if (!received.insert(event.sequence).second)
+    {
+      duplicates++;
+    }
+    int64_t atUs = nowUs + (int64_t)randomBetween(30, 150) * 1000;
+    if (!echoes.empty() && echoes.back().atUs > atUs)
+    {
+      atUs = echoes.back().atUs; // one connection, so the echoes can't overtake each other
+    }
+    echoes.push_back({atUs, event.bootId, event.sequence});
+    return true;
+  }
+};
+
+// Edge trains at fixed, rising rates, from a slow walk to well past one edge per mainTask loop, counted two ways: by
+//   the pulse counter through odometry.cpp, and by reading the pin once a loop like the old firmware did. The pulse
+//   gets shorter as the wheel gets faster (MAGNET_PULSE_MM), so polling starts losing edges as soon as a pulse can fall
+//   between two loops - the pulse counter must not lose a single one at any rate. The edges are a few % apart either
+//   way like the cat's, so they don't stay lined up with the loop. Runs on from `startUs`, after the wheel is done,
+//   and returns the number of rates the pulse counter lost edges at.
+static const uint32_t SWEEP_INTERVALS_US[] = {1000000, 500000, 200000, 125000, 100000, 50000, 20000, 10000, 5000, 4000, 2000, 1000};
+static const int64_t SWEEP_RATE_US = 60LL * 1000000; // how long each rate runs for
+
+static int runEdgeSweep(int64_t startUs)
+{
+  int failures = 0;
+  printf("sweep:    edges/s  pulse us      edges  pulse counter lost  polling lost\n");
+  int64_t nowUs = startUs;
+  for (uint32_t intervalUs : SWEEP_INTERVALS_US)
+  {
+    int64_t pulseUs = (int64_t)MAGNET_PULSE_MM * 100 * intervalUs / (CM_PER_EDGE * 1000); // 10mm of 22cm
+    int64_t firstEdgeUs = nowUs + 1234;                                                 // not lined up with the loop
+    int64_t endUs = nowUs + SWEEP_RATE_US;
+    int64_t nextEdgeUs = firstEdgeUs;
+    int64_t lastEdgeUs = -1;
+    uint64_t edges = 0, polled = 0;
+    bool polledLow = false;
+    uint64_t countedBefore = odometryTotalEdges();
+    for (int64_t tickUs = nowUs + MAIN_TICK_US; tickUs <= endUs; tickUs += MAIN_TICK_US)
+    {
+      while (nextEdgeUs <= tickUs)
+      {
+        halSimPulse((uint32_t)(pulseUs * 1000));
+        edges++;
+        lastEdgeUs = nextEdgeUs;
+        nextEdgeUs += (int64_t)intervalUs * randomBetween(95, 105) / 100;
+      }
+      halSimSetMicros(tickUs); // runs the overflow interrupt, if the counter wrapped
+      bool pinLow = lastEdgeUs >= 0 && tickUs < lastEdgeUs + pulseUs;
+      polled += pinLow && !polledLow;
+      polledLow = pinLow;
+    }
+    uint64_t counted = odometryTotalEdges() - countedBefore;
+    printf("          %7u  %8lld  %9llu  %18llu  %12llu\n", 1000000 / intervalUs, (long long)pulseUs, (unsigned long long)edges,
+           (unsigned long long)(edges - counted), (unsigned long long)(edges - polled));
+    if (counted != edges)
+    {
+      printf("FAIL: at %u edges/s the pulse counter counted %llu of %llu\n", 1000000 / intervalUs, (unsigned long long)counted,
+             (unsigned long long)edges);
+      failures++;
+    }
+    nowUs = endUs;
+  }
+  return failures;
+}
+
+////////////////////////
+///      Run        ///
+//////////////////////
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && strcmp(argv[1], "replay") == 0)
+  {
+    return runReplay(argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "config-stress") == 0)
+  {
+    return runConfigStress(argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "page-bench") == 0)
+  {
+    return runPageBench(argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "ring-stress") == 0)
+  {
+    return runRingStress(argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "seqlock-stress") == 0)
+  {
+    return runSeqlockStress(argc - 1, argv + 1);
+  }
+
+  double hours = 24;
+  uint32_t seed = 1;
+  const char *tracePath = NULL;
+  int positional = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-q") == 0)
+    {
+      verbose = false;
+    }
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+    {
+      tracePath = argv[++i];
+    }
+    else if (positional++ == 0)
+    {
+      hours = atof(argv[i]);
+    }
+    else
+    {
+      seed = strtoul(argv[i], NULL, 10);
+    }
+  }
+  halSimSeedRandom(seed);
+  int64_t endUs = (int64_t)(hours * 3600 * 1000000);
+
+  odometryBegin(hallEffectSensorPin, HALL_GLITCH_FILTER_CYCLES);
+  halServoAttach(motorPin, 544, 2400);
+  halPinOutput(dispenseLightBreakSensorLEDPin);
+  halPinOutput(hopperLightBreakSensorLEDPin);
+  halPinOutput(errorLEDPin);
+  halServoWrite(TreatDispenser::MOTOR_STOP_US);
+
+  AppConfig config;
+  setAppConfigDefaults(config);
+
+  WheelControllerIO io = {{setSensorLeds, setMotor}, setErrorLed, requestDispense, takeDispenseRequest, reportCompletionAndRecord, recordEvent, logLine};
+  wheel.begin(io, CM_PER_EDGE);
+  wheel.wheelSpeed().begin(CM_PER_EDGE, MAGNET_COUNT, 10000, 2000);
+  wheel.scheduler().configure(DISPENSE_COALESCE_MS, DISPENSE_MIN_INTERVAL_MS, DISPENSE_MAX_PER_REQUEST);
+  wheel.setDistanceThreshold(config.distanceThreshold);
+
+  TraceHeader traceHeader;
+  if (tracePath != NULL)
+  {
+    TraceRecorder::fillHeader(traceHeader, wheel, MAGNET_COUNT, 10000, 2000, DISPENSE_COALESCE_MS, DISPENSE_MIN_INTERVAL_MS, DISPENSE_MAX_PER_REQUEST, 0);
+    TraceSink sink = {putTraceRecord};
+    trace.start(sink, traceHeader, wheel);
+  }
+
+  StatsJournal journal;
+  JournalFlash flash = {journalRead, journalWrite, journalErase, (uint32_t)journalFlash.size()};
+  StatsRecord latest;
+  journal.recover(flash, latest);
+  journal.append(0, 0);
+  uint32_t checkpointDistance = 0;
+  uint32_t checkpointTreats = 0;
+  uint32_t powerCuts = 0;
+  uint32_t badRecoveries = 0;
+  int64_t blipUntilUs = 0;
+  uint32_t outagesInFlight = 0; // the network went while events were out waiting for their ack
+
+  RtcCounters rtcSlots[2] = {};
+  RtcCounterMirror rtc(rtcSlots);
+  rtc.write(0, 0, 0);
+
+  OutboxSpill outboxSpill = {spillAppend, spillRead, spillDrop, spillCount, OUTBOX_SPILL_EVENTS};
+  outbox.begin(outboxSpill, OUTBOX_ACK_TIMEOUT_MS);
+
+  Cat cat;
+  cat.changeAtUs = (int64_t)randomBetween(10, 60) * 1000000;
+  Hopper hopper;
+  Broker broker;
+  std::vector<int64_t> edgeTimes;
+  int64_t nextTickUs = 0;
+  int64_t nextMqttUs = 0;
+  int64_t nextCheckpointUs = STATS_CHECKPOINT_US;
+  int64_t nextRemoteDispenseUs = REMOTE_DISPENSE_EVERY_US;
+  int64_t outOfTreatsSinceUs = -1;
+  uint64_t edgesCounted = 0;
+  uint64_t glitches = 0;
+  uint64_t glitchesCounted = 0;
+  uint64_t polledEdges = 0; // what the old firmware would have counted, reading the pin once a loop
+  bool polledLow = false;
+  int64_t pulseStartUs = -1;
+  int64_t pulseWidthUs = 0;
+  uint64_t edgesWhileRunning = 0;  // made while the dispense motor was running
+  uint32_t missedWhileRunning = 0; // loops in a dispense where the distance was behind the cat
+  uint64_t loops = 0;
+  uint32_t mirroredDistance = 0, mirroredTreats = 0, mirroredHallEffectCount = 0;
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  int64_t nowUs = 0;
+  while (nowUs < endUs)
+  {
+    // mainTask wakes every tick, or straight away on a beam break
+    nowUs = nextTickUs;
+    int64_t beamUs = hopper.nextEventUs();
+    if (beamUs < nowUs)
+    {
+      nowUs = beamUs;
+    }
+    halSimSetMicros(nowUs);
+    nextTickUs = nowUs + MAIN_TICK_US;
+    loops++;
+
+    bool dispenseBeam, hopperBeam;
+    hopper.advance(nowUs, dispenseBeam, hopperBeam);
+    uint32_t nowMs = halMillis();
+    if (dispenseBeam)
+    {
+      trace.record(nowUs, TraceEvent::DISPENSE_BEAM, 0);
+      wheel.onDispenseBeam(nowMs);
+    }
+    if (hopperBeam)
+    {
+      trace.record(nowUs, TraceEvent::HOPPER_BEAM, 0);
+      wheel.onHopperBeam(nowMs);
+    }
+
+    // someone eventually notices, refills the hopper and resets the error on the web page
+    if (wheel.outOfTreats() && outOfTreatsSinceUs < 0)
+    {
+      outOfTreatsSinceUs = nowUs;
+    }
+    if (outOfTreatsSinceUs >= 0 && nowUs - outOfTreatsSinceUs >= REFILL_AFTER_US)
+    {
+      logLine("[sim] hopper refilled, errors reset");
+      hopper.treats = HOPPER_CAPACITY;
+      trace.record(nowUs, TraceEvent::RESET_ERRORS, 0);
+      wheel.resetErrors();
+      outOfTreatsSinceUs = -1;
+    }
+
+    if (nowUs >= nextRemoteDispenseUs)
+    {
+      nextRemoteDispenseUs += REMOTE_DISPENSE_EVERY_US;
+      char payload[32];
+      snprintf(payload, sizeof(payload), "{\"count\":%u}", randomBetween(1, 3));
+      JsonArgs args(payload, strlen(payload));
+      char count[8];
+      if (args.valid() && args.get("count", count, sizeof(count)) > 0)
+      {
+        requestDispense(DispenseSource::MQTT, (uint8_t)atoi(count));
+      }
+    }
+
+    // The magnets go past the hall sensor, the pulse counter counts them, and mainTask picks up the count like on
+    //   the wheel (odometry.cpp)
+    edgeTimes.clear();
+    cat.advance(nowUs, edgeTimes);
+    edgesCounted += edgeTimes.size();
+    for (size_t i = 0; i < edgeTimes.size(); i++)
+    {
+      pulseStartUs = edgeTimes[i];
+      pulseWidthUs = (int64_t)MAGNET_PULSE_MM * 100000 / cat.speedCmPerSec;
+      halSimPulse(pulseWidthUs * 1000);
+      for (uint32_t bounces = randomBetween(1, 100) <= HALL_GLITCH_PERCENT ? randomBetween(1, 3) : 0; bounces > 0; bounces--)
+      {
+        glitches++;
+        glitchesCounted += halSimPulse(randomBetween(50, HALL_GLITCH_FILTER_CYCLES * 25 / 2 - 1));
+      }
+    }
+    uint32_t newHallEdges = odometryTakeNewEdges();
+    if (newHallEdges > 0)
+    {
+      trace.record(nowUs, TraceEvent::EDGE_COUNT, newHallEdges);
+      wheel.addEdges(newHallEdges);
+    }
+    // The old firmware sat in a loop for the whole dispense and missed all of these. Now the distance has to be right up
+    //   to date on every loop of it, unless a counter wrap is still waiting for its interrupt.
+    if (wheel.dispenser().state() == DispenseState::MOTOR_RUN)
+    {
+      edgesWhileRunning += edgeTimes.size();
+      if (odometryTotalEdges() == edgesCounted && wheel.totalDistance() != edgesCounted * CM_PER_EDGE)
+      {
+        missedWhileRunning++;
+      }
+    }
+    bool pinLow = pulseStartUs >= 0 && nowUs < pulseStartUs + pulseWidthUs;
+    polledEdges += pinLow && !polledLow;
+    polledLow = pinLow;
+    for (size_t i = 0; i < edgeTimes.size(); i++)
+    {
+      trace.record(edgeTimes[i], TraceEvent::HALL_EDGE, 0);
+      wheel.addEdgeTime(edgeTimes[i]);
+    }
+
+    wheel.update(nowMs, nowUs);
+    trace.observe(wheel, nowUs);
+
+    if (wheel.hallEffectCount() != mirroredHallEffectCount || wheel.totalDistance() != mirroredDistance || wheel.totalTreats() != mirroredTreats)
+    {
+      mirroredHallEffectCount = wheel.hallEffectCount();
+      mirroredDistance = wheel.totalDistance();
+      mirroredTreats = wheel.totalTreats();
+      rtc.write(mirroredDistance, mirroredTreats, mirroredHallEffectCount);
+    }
+
+    // saveStatisticsTask
+    if (nowUs >= nextCheckpointUs)
+    {
+      nextCheckpointUs += STATS_CHECKPOINT_US;
+      if (wheel.totalDistance() != checkpointDistance || wheel.totalTreats() != checkpointTreats)
+      {
+        // Every so often the power goes part way through. The erase only happens when this checkpoint starts a new
+        //   sector, otherwise that cut just doesn't go off.
+        if (randomBetween(1, 100) <= POWER_CUT_WRITE_PERCENT)
+        {
+          journalCutWriteAt = randomBetween(0, StatsJournal::RECORD_SIZE - 1);
+        }
+        if (randomBetween(1, 100) <= POWER_CUT_ERASE_PERCENT)
+        {
+          journalCutEraseAt = randomBetween(0, StatsJournal::SECTOR_SIZE - 1);
+        }
+        uint32_t committedSequence = journal.sequence();
+        bool written = journal.append(wheel.totalDistance(), wheel.totalTreats());
+        journalCutWriteAt = -1;
+        journalCutEraseAt = -1;
+
+        // Back from the power cut: the journal has to come up with the last checkpoint that made it, then carry on. That
+        //   can be the one it was writing, if the cut came in the last byte after its bits were already cleared.
+        if (journalPowerLost)
+        {
+          journalPowerLost = false;
+          powerCuts++;
+          StatsRecord recovered = {};
+          journal = StatsJournal();
+          bool ok = journal.recover(flash, recovered);
+          bool previous = recovered.sequence == committedSequence && recovered.totalDistance == checkpointDistance &&
+                          recovered.totalTreats == checkpointTreats;
+          bool inFlight = recovered.sequence == committedSequence + 1 && recovered.totalDistance == wheel.totalDistance() &&
+                          recovered.totalTreats == wheel.totalTreats();
+          if (!ok || !(previous || inFlight))
+          {
+            printf("FAIL: after a power cut the journal came back with #%u %u cm / %u treats, expected #%u %u / %u\n", recovered.sequence,
+                   recovered.totalDistance, recovered.totalTreats, committedSequence, checkpointDistance, checkpointTreats);
+            badRecoveries++;
+          }
+          written = journal.append(wheel.totalDistance(), wheel.totalTreats());
+        }
+        if (written)
+        {
+          checkpointDistance = wheel.totalDistance();
+          checkpointTreats = wheel.totalTreats();
+        }
+      }
+    }
+
+    // mqttServerTask
+    if (nowUs >= nextMqttUs)
+    {
+      nextMqttUs += MQTT_TICK_US;
+      bool wasConnected = halNetworkConnected();
+      if (wasConnected && outbox.inFlight() > 0 && randomBetween(1, 100) <= BLIP_PERCENT)
+      {
+        blipUntilUs = nowUs + (int64_t)randomBetween(1, 10) * 1000000;
+      }
+      halSimSetNetwork(nowUs % OUTAGE_EVERY_US < OUTAGE_EVERY_US - OUTAGE_LENGTH_US && nowUs >= blipUntilUs);
+      if (wasConnected && !halNetworkConnected() && outbox.inFlight() > 0)
+      {
+        outagesInFlight++;
+      }
+      if (!halNetworkConnected())
+      {
+        broker.echoes.clear(); // the connection is gone, and whatever was on it
+        outbox.connectionLost();
+        outbox.persist();
+      }
+      else
+      {
+        while (!broker.echoes.empty() && broker.echoes.front().atUs <= nowUs)
+        {
+          if (outbox.acknowledge(broker.echoes.front().bootId, broker.echoes.front().sequence, nowMs))
+          {
+            broker.acknowledged.insert(broker.echoes.front().sequence);
+          }
+          broker.echoes.pop_front();
+        }
+        outbox.checkTimeout(nowMs);
+        OutboxEvent event;
+        while (outbox.nextToSend(event))
+        {
+          if (!broker.publish(event, nowUs))
+          {
+            outbox.connectionLost(); // reconnects on the next tick
+            break;
+          }
+          outbox.markSent(nowMs);
+        }
+      }
+    }
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  // If the counter wrapped in the very last loop its interrupt hasn't run yet, give it the chance
+  halSimSetMicros(nowUs + 1);
+  wheel.addEdges(odometryTakeNewEdges());
+
+  if (tracePath != NULL)
+  {
+    FILE *file = fopen(tracePath, "wb");
+    if (file == NULL || fwrite(&traceHeader, sizeof(traceHeader), 1, file) != 1 ||
+        fwrite(traceRecords.data(), sizeof(TraceRecord), traceRecords.size(), file) != traceRecords.size())
+    {
+      printf("couldn't write the trace to %s\n", tracePath);
+    }
+    if (file != NULL)
+    {
+      fclose(file);
+    }
+  }
+
+  // Does it all add up?
+  int failures = 0;
+  if (odometryTotalEdges() != edgesCounted || glitchesCounted > 0)
+  {
+    printf("FAIL: pulse counter has %llu edges (%llu of them glitches), but the cat ran past %llu\n", (unsigned long long)odometryTotalEdges(),
+           (unsigned long long)glitchesCounted, (unsigned long long)edgesCounted);
+    failures++;
+  }
+  if (wheel.totalDistance() != edgesCounted * CM_PER_EDGE)
+  {
+    printf("FAIL: distance %u cm, but the cat ran %llu cm\n", wheel.totalDistance(), (unsigned long long)(edgesCounted * CM_PER_EDGE));
+    failures++;
+  }
+  if (wheel.totalTreats() + hopper.doubles != (uint32_t)hopper.dropped)
+  {
+    printf("FAIL: counted %u treats and %d doubles, but %d were dropped\n", wheel.totalTreats(), hopper.doubles, hopper.dropped);
+    failures++;
+  }
+  const DispenseProfile &profile = wheel.dispenser().profile();
+  if (profile.stats().lateTreats != (uint32_t)hopper.lateDoubles)
+  {
+    printf("FAIL: dispenser saw %u late treats, but %d slipped out after the bounce window\n", profile.stats().lateTreats,
+           hopper.lateDoubles);
+    failures++;
+  }
+  if (badRecoveries > 0)
+  {
+    printf("FAIL: %u of %u power cuts lost the last checkpoint\n", badRecoveries, powerCuts);
+    failures++;
+  }
+  StatsJournal recovered;
+  if (!recovered.recover(flash, latest) || latest.totalDistance != checkpointDistance || latest.totalTreats != checkpointTreats)
+  {
+    printf("FAIL: journal came back with %u cm / %u treats, expected %u / %u\n", latest.totalDistance, latest.totalTreats, checkpointDistance, checkpointTreats);
+    failures++;
+  }
+  RtcCounters restored = {};
+  RtcCounterMirror afterReset(rtcSlots);
+  if (!afterReset.restore(restored) || restored.totalDistance != wheel.totalDistance() || restored.totalTreats != wheel.totalTreats() ||
+      restored.hallEffectCount != wheel.hallEffectCount())
+  {
+    printf("FAIL: RTC counters don't match the live ones\n");
+    failures++;
+  }
+  if (missedWhileRunning > 0)
+  {
+    printf("FAIL: distance fell behind on %u loops while the dispense motor ran (%llu edges in that time)\n", missedWhileRunning,
+           (unsigned long long)edgesWhileRunning);
+    failures++;
+  }
+  if (outbox.delivered() + outbox.dropped() + outbox.size() != eventsPushed)
+  {
+    printf("FAIL: outbox lost track of events (%u delivered + %u dropped + %u waiting != %u)\n", outbox.delivered(), outbox.dropped(), outbox.size(), eventsPushed);
+    failures++;
+  }
+  // Everything that isn't still waiting has to have reached the broker, and nothing it acked can have been sent again
+  if (outbox.dropped() > 0 || broker.received.size() + outbox.size() < eventsPushed)
+  {
+    printf("FAIL: %u events never reached the broker\n", eventsPushed - outbox.size() - (uint32_t)broker.received.size());
+    failures++;
+  }
+  if (broker.afterAck > 0)
+  {
+    printf("FAIL: %u events were sent again after they were acknowledged\n", broker.afterAck);
+    failures++;
+  }
+
+  printf("\nsimulated %.1f hours in %.2f s (%.0fx real time), %llu loops, seed %u\n", hours, wallSeconds, hours * 3600 / wallSeconds,
+         (unsigned long long)loops, seed);
+  printf("wheel:    %u m, %u treats, %u cm/s peak, %s\n", wheel.totalDistance() / 100, wheel.totalTreats(), wheel.wheelSpeed().peakCmPerSec(),
+         wheel.outOfTreats() ? "out of treats" : "treats left");
+  printf("odometry: %llu edges, %llu wraps, %llu glitches filtered - polling once a loop would have seen %llu (%llu lost)\n",
+         (unsigned long long)odometryTotalEdges(), (unsigned long long)(edgesCounted / 32767), (unsigned long long)glitches,
+         (unsigned long long)polledEdges, (unsigned long long)(edgesCounted - polledEdges));
+  printf("          %llu edges came while the dispense motor was running, all counted as they happened\n", (unsigned long long)edgesWhileRunning);
+  printf("dispense: %u done, %u failed, %u coalesced, %u rejected, %u treats reported\n", completionsByStatus[(int)DispenseStatus::DONE],
+         completionsByStatus[(int)DispenseStatus::FAILED], completionsByStatus[(int)DispenseStatus::COALESCED],
+         completionsByStatus[(int)DispenseStatus::REJECTED], treatsReported);
+  printf("profile:  learned %u, expecting %u ms (+-%u), %u cycles averaging %u ms, %u jams: %u reverse pulses, %u cleared, %u doubles (%d late)\n",
+         profile.state().learned, profile.state().expectedMs, profile.state().deviationMs, profile.stats().cycles, profile.stats().averageCycleMs,
+         hopper.jams, profile.stats().jamPulses, profile.stats().jamsCleared, hopper.doubles, hopper.lateDoubles);
+  printf("outbox:   %u events, %u delivered, %u dropped, %u waiting, %u resends, %u published (%u connection drops, %u outages with events in flight, "
+         "%u duplicates, %u after an ack)\n", eventsPushed, outbox.delivered(), outbox.dropped(), outbox.size(), outbox.resends(), broker.published,
+         broker.drops, outagesInFlight, broker.duplicates, broker.afterAck);
+  printf("journal:  checkpoint %u, %u cm, %u treats, survived %u power cuts\n", latest.sequence, latest.totalDistance, latest.totalTreats, powerCuts);
+
+  failures += runEdgeSweep(nowUs);
+
+  // Reset Stats from the web page, after the numbers above are out: nothing it shows should survive it
+  wheel.resetStats();
+  if (wheel.totalDistance() != 0 || wheel.totalTreats() != 0 || wheel.wheelSpeed().peakCmPerSec() != 0)
+  {
+    printf("FAIL: after resetting the stats there's still %u cm, %u treats and a %u cm/s peak\n", wheel.totalDistance(),
+           wheel.totalTreats(), wheel.wheelSpeed().peakCmPerSec());
+    failures++;
+  }
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,468 @@
+// Replays a sensor trace (see sensorTrace.h) through the wheel controller, as fast as it'll go:
+//   .pio/build/native/program replay <trace.bin> [--golden <file>] [--write-golden <file>] [-v]
+//
+// The inputs in the trace (hall edges, beam breaks, requests, resets) go back in at the times they happened, with
+//   mainTask's 5ms tick and the beams waking it straight away, same as on the wheel. What the controller does with them
+//   is recorded the same way the wheel recorded it, and both sides are boiled down to the same numbers: dispenses,
+//   treats, timeouts, hopper-empty trips, and how long the motor ran / a beam break took to stop it / a whole
+//   dispense took.
+//
+// Without --golden the replay has to come out with the same counts the wheel did, otherwise the logic has drifted from
+//   the firmware that recorded the trace. Once a change is meant to behave differently, --write-golden saves what it
+//   does now, and --golden checks later builds against that instead. Exits with 1 on a mismatch.
+//
+// It's open loop: the beams break when they broke on the wheel, whatever the replayed controller did with the motor.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include "halPosix.h"
+#include "sensorTrace.h"
+#include "sim.h"
+
+static const int64_t MAIN_TICK_US = 5000;
+static const int64_t SETTLE_US = 1000000; // keep going this long after the last record, so a dispense in progress can finish
+
+struct TraceEntry
+{
+  int64_t timeUs;
+  TraceEvent event;
+  uint32_t value;
+};
+
+struct TraceMetrics
+{
+  uint32_t dispenses = 0;
+  uint32_t treats = 0;
+  uint32_t timeouts = 0;
+  uint32_t hopperEmptyTrips = 0;
+  std::vector<int64_t> motorRunUs;   // motor on -> motor off
+  std::vector<int64_t> beamToStopUs; // dispense beam broken -> motor off
+  std::vector<int64_t> cycleUs;      // LEDs on -> back to IDLE
+};
+
+static bool isInput(TraceEvent event)
+{
+  return event <= TraceEvent::THRESHOLD;
+}
+
+// Goes through the outputs (and the dispense beams, for the latency) in time order
+static TraceMetrics measure(const std::vector<TraceEntry> &beams, const std::vector<TraceEntry> &outputs)
+{
+  TraceMetrics metrics;
+  uint32_t flags = 0;
+  int64_t motorOnUs = -1;
+  int64_t cycleStartUs = -1;
+  size_t beam = 0;
+  for (size_t i = 0; i < outputs.size(); i++)
+  {
+    const TraceEntry &entry = outputs[i];
+    switch (entry.event)
+    {
+    case TraceEvent::STATE:
+      if ((DispenseState)entry.value == DispenseState::LED_WARMUP)
+      {
+        metrics.dispenses++;
+        cycleStartUs = entry.timeUs;
+      }
+      else if ((DispenseState)entry.value == DispenseState::IDLE && cycleStartUs >= 0)
+      {
+        metrics.cycleUs.push_back(entry.timeUs - cycleStartUs);
+        cycleStartUs = -1;
+      }
+      break;
+
+    case TraceEvent::SERVO:
+      if ((int)entry.value != TreatDispenser::MOTOR_STOP_US && motorOnUs < 0)
+      {
+        motorOnUs = entry.timeUs;
+      }
+      else if ((int)entry.value == TreatDispenser::MOTOR_STOP_US && motorOnUs >= 0)
+      {
+        metrics.motorRunUs.push_back(entry.timeUs - motorOnUs);
+        // the first beam break while the motor was on is the one that stopped it
+        while (beam < beams.size() && beams[beam].timeUs < motorOnUs)
+        {
+          beam++;
+        }
+        if (beam < beams.size() && beams[beam].timeUs <= entry.timeUs)
+        {
+          metrics.beamToStopUs.push_back(entry.timeUs - beams[beam].timeUs);
+        }
+        motorOnUs = -1;
+      }
+      break;
+
+    case TraceEvent::FLAGS:
+      metrics.timeouts += (entry.value & 1) && !(flags & 1);
+      metrics.hopperEmptyTrips += (entry.value & 2) && !(flags & 2);
+      flags = entry.value;
+      break;
+
+    case TraceEvent::TREAT:
+      metrics.treats++;
+      break;
+
+    default:
+      break;
+    }
+  }
+  return metrics;
+}
+
+static int64_t percentile(std::vector<int64_t> values, int percent)
+{
+  if (values.empty())
+  {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * percent / 100];
+}
+
+// The numbers that get compared, as name / value pairs
+static std::vector<std::pair<std::string, long long>> summarize(const TraceMetrics &metrics)
+{
+  std::vector<std::pair<std::string, long long>> summary;
+  summary.push_back({"dispenses", metrics.dispenses});
+  summary.push_back({"treats", metrics.treats});
+  summary.push_back({"timeouts", metrics.timeouts});
+  summary.push_back({"hopperEmptyTrips", metrics.hopperEmptyTrips});
+  summary.push_back({"motorRunP50Us", percentile(metrics.motorRunUs, 50)});
+  summary.push_back({"motorRunP99Us", percentile(metrics.motorRunUs, 99)});
+  summary.push_back({"motorRunMaxUs", percentile(metrics.motorRunUs, 100)});
+  summary.push_back({"beamToStopP50Us", percentile(metrics.beamToStopUs, 50)});
+  summary.push_back({"beamToStopP99Us", percentile(metrics.beamToStopUs, 99)});
+  summary.push_back({"beamToStopMaxUs", percentile(metrics.beamToStopUs, 100)});
+  summary.push_back({"cycleP50Us", percentile(metrics.cycleUs, 50)});
+  summary.push_back({"cycleMaxUs", percentile(metrics.cycleUs, 100)});
+  return summary;
+}
+
+////////////////////////
+///  Replay glue    ///
+//////////////////////
+
+static TraceRecorder replayRecorder;
+static std::vector<TraceRecord> replayRecords;
+static std::deque<DispenseRequest> replayQueue;
+static uint32_t replayRequestId = 1;
+static bool replayVerbose = false;
+
+static bool putReplayRecord(const TraceRecord &record)
+{
+  replayRecords.push_back(record);
+  return true;
+}
+
+static void replaySensorLeds(bool on)
+{
+  replayRecorder.record(halMicros(), TraceEvent::LEDS, on);
+}
+
+static void replayMotor(int microseconds)
+{
+  replayRecorder.record(halMicros(), TraceEvent::SERVO, microseconds);
+}
+
+static void replayErrorLed(bool on)
+{
+}
+
+static uint32_t replayRequestDispense(DispenseSource source, uint8_t count)
+{
+  DispenseRequest request = {replayRequestId++, source, count, halMillis()};
+  replayQueue.push_back(request);
+  return request.id;
+}
+
+static bool replayNextRequest(DispenseRequest &request)
+{
+  if (replayQueue.empty())
+  {
+    return false;
+  }
+  request = replayQueue.front();
+  replayQueue.pop_front();
+  return true;
+}
+
+static void replayCompletion(const DispenseCompletion &completion)
+{
+}
+
+static void replayEvent(OutboxEventType type, uint32_t value0, uint32_t value1, uint32_t value2)
+{
+}
+
+static void replayLog(const char *message)
+{
+  if (replayVerbose)
+  {
+    printf("[%10.3f] %s\n", halMicros() / 1000000.0, message);
+  }
+}
+
+static bool readGolden(const char *path, std::vector<std::pair<std::string, long long>> &golden)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    return false;
+  }
+  char name[64];
+  long long value;
+  while (fscanf(file, "%63s %lld", name, &value) == 2)
+  {
+    golden.push_back({name, value});
+  }
+  fclose(file);
+  return true;
+}
+
+int runReplay(int argc, char **argv)
+{
+  const char *tracePath = NULL;
+  const char *goldenPath = NULL;
+  const char *writeGoldenPath = NULL;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+    {
+      goldenPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--write-golden") == 0 && i + 1 < argc)
+    {
+      writeGoldenPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "-v") == 0)
+    {
+      replayVerbose = true;
+    }
+    else
+    {
+      tracePath = argv[i];
+    }
+  }
+  if (tracePath == NULL)
+  {
+    fprintf(stderr, "usage: replay <trace.bin> [--golden <file>] [--write-golden <file>] [-v]\n");
+    return 2;
+  }
+
+  // Load and decode the whole thing, traces are at most a few hundred KB
+  FILE *file = fopen(tracePath, "rb");
+  TraceHeader header;
+  if (file == NULL || fread(&header, sizeof(header), 1, file) != 1 || header.magic != TraceRecorder::MAGIC || header.version != TraceRecorder::VERSION)
+  {
+    fprintf(stderr, "%s isn't a trace this build understands\n", tracePath);
+    return 2;
+  }
+  fseek(file, header.headerSize, SEEK_SET);
+  std::vector<TraceEntry> inputs, beams, recorded;
+  TraceDecoder decoder(header);
+  TraceRecord record;
+  uint32_t lost = 0;
+  int64_t lastUs = header.startUs;
+  while (fread(&record, sizeof(record), 1, file) == 1)
+  {
+    TraceEntry entry = {decoder.next(record), record.event(), record.value()};
+    lastUs = std::max(lastUs, entry.timeUs);
+    if (entry.event == TraceEvent::LOST)
+    {
+      lost += entry.value;
+    }
+    else if (isInput(entry.event))
+    {
+      // distance requests are the controller's own, it makes them again in the replay
+      if (entry.event != TraceEvent::REQUEST || (DispenseSource)(entry.value & 0xFF) != DispenseSource::DISTANCE)
+      {
+        inputs.push_back(entry);
+      }
+      if (entry.event == TraceEvent::DISPENSE_BEAM)
+      {
+        beams.push_back(entry);
+      }
+    }
+    else if (entry.event != TraceEvent::IDLE)
+    {
+      recorded.push_back(entry);
+    }
+  }
+  fclose(file);
+  if (lost > 0)
+  {
+    printf("warning: %u records were lost while recording, expect differences\n", lost);
+  }
+
+  // ISR timestamps were recorded a little after they happened, put everything back in time order
+  std::stable_sort(inputs.begin(), inputs.end(), [](const TraceEntry &a, const TraceEntry &b)
+                   { return a.timeUs < b.timeUs; });
+  std::stable_sort(beams.begin(), beams.end(), [](const TraceEntry &a, const TraceEntry &b)
+                   { return a.timeUs < b.timeUs; });
+
+  WheelController wheel;
+  WheelControllerIO io = {{replaySensorLeds, replayMotor}, replayErrorLed, replayRequestDispense, replayNextRequest, replayCompletion, replayEvent, replayLog};
+  wheel.begin(io, header.cmPerEdge);
+  wheel.wheelSpeed().begin(header.cmPerEdge, header.magnetCount, header.sessionGapMs, header.minEdgeIntervalUs);
+  wheel.scheduler().configure(header.coalesceMs, header.minIntervalMs, header.maxPerRequest);
+  wheel.setDistanceThreshold(header.distanceThreshold);
+  wheel.setCounters(header.totalDistance, header.totalTreats, header.hallEffectCount);
+  wheel.setOutOfTreats(header.flags & 1);
+  wheel.dispenser().profile().restore(header.profile);
+
+  halSimSetMicros(header.startUs);
+  TraceSink sink = {putReplayRecord};
+  replayRecorder.start(sink, header, wheel);
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  size_t next = 0;
+  int64_t nowUs = header.startUs;
+  int64_t nextTickUs = header.startUs + MAIN_TICK_US;
+  while (next < inputs.size() || nowUs < lastUs + SETTLE_US)
+  {
+    // mainTask wakes every tick, or straight away on a beam break
+    nowUs = nextTickUs;
+    for (size_t i = next; i < inputs.size() && inputs[i].timeUs < nowUs; i++)
+    {
+      if (inputs[i].event == TraceEvent::DISPENSE_BEAM || inputs[i].event == TraceEvent::HOPPER_BEAM)
+      {
+        nowUs = std::max(inputs[i].timeUs, nextTickUs - MAIN_TICK_US);
+        break;
+      }
+    }
+    nextTickUs = nowUs + MAIN_TICK_US;
+    halSimSetMicros(nowUs);
+    uint32_t nowMs = halMillis();
+
+    for (; next < inputs.size() && inputs[next].timeUs <= nowUs; next++)
+    {
+      const TraceEntry &input = inputs[next];
+      switch (input.event)
+      {
+      case TraceEvent::HALL_EDGE:
+        wheel.addEdgeTime(input.timeUs);
+        break;
+      case TraceEvent::EDGE_COUNT:
+        wheel.addEdges(input.value);
+        break;
+      case TraceEvent::DISPENSE_BEAM:
+        wheel.onDispenseBeam(nowMs);
+        break;
+      case TraceEvent::HOPPER_BEAM:
+        wheel.onHopperBeam(nowMs);
+        break;
+      case TraceEvent::REQUEST:
+        replayRequestDispense((DispenseSource)(input.value & 0xFF), (input.value >> 8) & 0xFF);
+        break;
+      case TraceEvent::RESET_ERRORS:
+        wheel.resetErrors();
+        break;
+      case TraceEvent::RESET_STATS:
+        wheel.resetStats();
+        break;
+      case TraceEvent::THRESHOLD:
+        wheel.setDistanceThreshold(input.value);
+        break;
+      default:
+        break;
+      }
+    }
+
+    wheel.update(nowMs, nowUs);
+    replayRecorder.observe(wheel, nowUs);
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  std::vector<TraceEntry> replayed;
+  TraceDecoder replayDecoder(header);
+  for (size_t i = 0; i < replayRecords.size(); i++)
+  {
+    TraceEntry entry = {replayDecoder.next(replayRecords[i]), replayRecords[i].event(), replayRecords[i].value()};
+    if (entry.event != TraceEvent::IDLE)
+    {
+      replayed.push_back(entry);
+    }
+  }
+
+  std::vector<std::pair<std::string, long long>> wheelSummary = summarize(measure(beams, recorded));
+  std::vector<std::pair<std::string, long long>> replaySummary = summarize(measure(beams, replayed));
+  double tracedSeconds = (lastUs - header.startUs) / 1000000.0;
+  printf("replayed %.1f s of trace (%zu inputs) in %.3f s, %.0fx real time\n\n", tracedSeconds, inputs.size(), wallSeconds,
+         wallSeconds > 0 ? tracedSeconds / wallSeconds : 0.0);
+  printf("%-20s %12s %12s\n", "", "wheel", "replay");
+  for (size_t i = 0; i < replaySummary.size(); i++)
+  {
+    printf("%-20s %12lld %12lld\n", replaySummary[i].first.c_str(), wheelSummary[i].second, replaySummary[i].second);
+  }
+  printf("%-20s %12s %12u\n", "totalDistance", "", wheel.totalDistance());
+  printf("%-20s %12s %12u\n", "totalTreats", "", wheel.totalTreats());
+
+  if (writeGoldenPath != NULL)
+  {
+    FILE *golden = fopen(writeGoldenPath, "w");
+    if (golden == NULL)
+    {
+      fprintf(stderr, "couldn't write %s\n", writeGoldenPath);
+      return 2;
+    }
+    for (size_t i = 0; i < replaySummary.size(); i++)
+    {
+      fprintf(golden, "%s %lld\n", replaySummary[i].first.c_str(), replaySummary[i].second);
+    }
+    fprintf(golden, "totalDistance %u\ntotalTreats %u\n", wheel.totalDistance(), wheel.totalTreats());
+    fclose(golden);
+  }
+
+  int failures = 0;
+  if (goldenPath != NULL)
+  {
+    std::vector<std::pair<std::string, long long>> golden;
+    if (!readGolden(goldenPath, golden))
+    {
+      fprintf(stderr, "couldn't read %s\n", goldenPath);
+      return 2;
+    }
+    replaySummary.push_back({"totalDistance", wheel.totalDistance()});
+    replaySummary.push_back({"totalTreats", wheel.totalTreats()});
+    for (size_t i = 0; i < golden.size(); i++)
+    {
+      bool found = false;
+      for (size_t j = 0; j < replaySummary.size(); j++)
+      {
+        if (replaySummary[j].first == golden[i].first)
+        {
+          found = true;
+          if (replaySummary[j].second != golden[i].second)
+          {
+            printf("FAIL: %s is %lld, golden says %lld\n", golden[i].first.c_str(), replaySummary[j].second, golden[i].second);
+            failures++;
+          }
+        }
+      }
+      if (!found)
+      {
+        printf("FAIL: %s is in the golden file but not measured any more\n", golden[i].first.c_str());
+        failures++;
+      }
+    }
+  }
+  else
+  {
+    // the counts have to match what the wheel did. Timings won't, the wheel had scheduling delays the replay doesn't.
+    for (size_t i = 0; i < 4; i++)
+    {
+      if (replaySummary[i].second != wheelSummary[i].second)
+      {
+        printf("FAIL: %s differs from the wheel\n", replaySummary[i].first.c_str());
+        failures++;
+      }
+    }
+  }
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
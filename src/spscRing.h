@@ -0,0 +1,62 @@
+// spscRing.h
+#ifndef SPSCRING_H
+#define SPSCRING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Lock-free single producer / single consumer ring buffer. One side (usually an ISR) pushes and one task pops, so
+//   neither side ever blocks or disables interrupts. This has no Arduino dependencies so it can be built on a PC too.
+//   N must be a power of two. One slot is always left empty to tell full and empty apart, so it holds N - 1 items.
+template <typename T, size_t N>
+class SpscRing
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  // Producer side. Returns false (and counts a drop) if the consumer has fallen behind and the ring is full.
+  inline __attribute__((always_inline)) bool push(const T &item)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t next = (head + 1) & (N - 1);
+    if (next == tail_.load(std::memory_order_acquire))
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items_[head] = item;
+    head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if there is nothing waiting.
+  bool pop(T &item)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    item = items_[tail];
+    tail_.store((tail + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const
+  {
+    return (head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)) & (N - 1);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // Items thrown away because the ring was full
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  T items_[N];
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+  std::atomic<uint32_t> dropped_{0};
+};
+
+#endif // SPSCRING_H
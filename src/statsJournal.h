@@ -0,0 +1,191 @@
+// statsJournal.h
+#ifndef STATSJOURNAL_H
+#define STATSJOURNAL_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Append-only journal for the lifetime statistics (total distance and treats), kept in its own flash partition.
+//
+// Instead of rewriting the same spot every time, each checkpoint is a new 16 byte record written after the last one:
+//   [sequence number][total distance][total treats][crc32 of the first 12 bytes]
+// When a 4KB sector fills up the next sector is erased and we carry on there, round and round the partition, so every
+//   sector gets erased equally often. With the 64KB partition that is one erase per sector per 4096 checkpoints - even
+//   checkpointing every 5 seconds of non-stop running, the flash will long outlive the cat.
+//
+// On boot, recover() reads every record and keeps the valid one with the highest sequence number. A write that got cut
+//   off by a power cut just fails its crc and gets skipped over, as does a sector that was only half erased, so we
+//   always come back with the last checkpoint that made it to flash in one piece.
+//
+// There are no ESP32 dependencies in here, all flash access goes through the JournalFlash callbacks (see main.cpp), so
+//   the recovery logic can be built and hammered with torn writes on a PC against a plain byte array.
+
+struct JournalFlash
+{
+  bool (*read)(uint32_t offset, void *buffer, size_t length);
+  bool (*write)(uint32_t offset, const void *buffer, size_t length);
+  bool (*eraseSector)(uint32_t offset);
+  uint32_t size; // bytes, a whole number of sectors
+};
+
+struct StatsRecord
+{
+  uint32_t sequence;
+  uint32_t totalDistance;
+  uint32_t totalTreats;
+  uint32_t crc;
+};
+
+class StatsJournal
+{
+public:
+  static const uint32_t SECTOR_SIZE = 4096;
+  static const uint32_t RECORD_SIZE = sizeof(StatsRecord);
+  static const uint32_t RECORDS_PER_SECTOR = SECTOR_SIZE / RECORD_SIZE;
+
+  // Scans the whole journal. Returns true (and fills in `latest`) if there was at least one good record.
+  bool recover(const JournalFlash &flash, StatsRecord &latest)
+  {
+    flash_ = flash;
+    sectorCount_ = flash_.size / SECTOR_SIZE;
+    haveRecord_ = false;
+    nextOffset_ = 0;
+    if (sectorCount_ < 2)
+    {
+      return false; // need at least one sector to write in while the other one holds the last good record
+    }
+
+    uint32_t newestOffset = 0;
+    for (uint32_t offset = 0; offset + RECORD_SIZE <= sectorCount_ * SECTOR_SIZE; offset += RECORD_SIZE)
+    {
+      StatsRecord record;
+      if (!flash_.read(offset, &record, sizeof(record)) || !isValid(record))
+      {
+        continue;
+      }
+      if (!haveRecord_ || record.sequence > latest_.sequence)
+      {
+        latest_ = record;
+        newestOffset = offset;
+        haveRecord_ = true;
+      }
+    }
+
+    if (haveRecord_)
+    {
+      latest = latest_;
+      nextOffset_ = newestOffset + RECORD_SIZE;
+    }
+    return haveRecord_;
+  }
+
+  // Write a new checkpoint. Returns false if the flash wouldn't take it.
+  bool append(uint32_t totalDistance, uint32_t totalTreats)
+  {
+    if (sectorCount_ < 2)
+    {
+      return false;
+    }
+
+    StatsRecord record;
+    record.sequence = haveRecord_ ? latest_.sequence + 1 : 1;
+    record.totalDistance = totalDistance;
+    record.totalTreats = totalTreats;
+    record.crc = crc32(&record, offsetof(StatsRecord, crc));
+
+    // A few tries, in case the slot we land on was left dirty by a torn write or a bad erase
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+      if (!findBlankSlot())
+      {
+        return false;
+      }
+      uint32_t offset = nextOffset_;
+      nextOffset_ += RECORD_SIZE;
+
+      StatsRecord check;
+      if (flash_.write(offset, &record, sizeof(record)) && flash_.read(offset, &check, sizeof(check)) && memcmp(&check, &record, sizeof(record)) == 0)
+      {
+        latest_ = record;
+        haveRecord_ = true;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool hasRecord() const { return haveRecord_; }
+  uint32_t sequence() const { return haveRecord_ ? latest_.sequence : 0; }
+
+  static uint32_t crc32(const void *data, size_t length)
+  {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+      crc ^= bytes[i];
+      for (int bit = 0; bit < 8; bit++)
+      {
+        crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+      }
+    }
+    return ~crc;
+  }
+
+private:
+  static bool isValid(const StatsRecord &record)
+  {
+    return record.sequence != 0xFFFFFFFF && record.sequence != 0 && record.crc == crc32(&record, offsetof(StatsRecord, crc));
+  }
+
+  // Moves nextOffset_ along to an erased slot, erasing the next sector when we run off the end of this one
+  bool findBlankSlot()
+  {
+    uint32_t journalSize = sectorCount_ * SECTOR_SIZE;
+    for (uint32_t checked = 0; checked <= RECORDS_PER_SECTOR; checked++)
+    {
+      if (nextOffset_ >= journalSize)
+      {
+        nextOffset_ = 0;
+      }
+      if (nextOffset_ % SECTOR_SIZE == 0)
+      {
+        // Starting a fresh sector. This wipes the oldest records - the newest one always lives in another sector.
+        if (!flash_.eraseSector(nextOffset_))
+        {
+          return false;
+        }
+        return true;
+      }
+
+      StatsRecord slot;
+      if (flash_.read(nextOffset_, &slot, sizeof(slot)) && isBlank(slot))
+      {
+        return true;
+      }
+      nextOffset_ += RECORD_SIZE;
+    }
+    return false;
+  }
+
+  static bool isBlank(const StatsRecord &slot)
+  {
+    const uint8_t *bytes = (const uint8_t *)&slot;
+    for (size_t i = 0; i < sizeof(slot); i++)
+    {
+      if (bytes[i] != 0xFF)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  JournalFlash flash_ = {};
+  uint32_t sectorCount_ = 0;
+  uint32_t nextOffset_ = 0;
+  StatsRecord latest_ = {};
+  bool haveRecord_ = false;
+};
+
+#endif // STATSJOURNAL_H
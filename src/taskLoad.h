@@ -0,0 +1,58 @@
+// taskLoad.h
+#ifndef TASKLOAD_H
+#define TASKLOAD_H
+#include <stdint.h>
+#include <atomic>
+
+// Rough CPU share of a single task, measured by the task itself: call asleep() just before every blocking wait and
+//   awake() just after it, and the time in between waits is added up over a window (a minute by default). If the task
+//   gets preempted while it is awake that time is counted too, so this reads a little high rather than low.
+//
+// percent() can be read from any task, it only changes at the end of each window.
+class TaskLoad
+{
+public:
+  explicit TaskLoad(int64_t windowUs = 60000000) : windowUs_(windowUs) {}
+
+  void awake(int64_t nowUs)
+  {
+    if (windowStartUs_ == 0)
+    {
+      windowStartUs_ = nowUs;
+    }
+    awakeSinceUs_ = nowUs;
+  }
+
+  void asleep(int64_t nowUs)
+  {
+    if (awakeSinceUs_ == 0)
+    {
+      return;
+    }
+    busyUs_ += nowUs - awakeSinceUs_;
+    awakeSinceUs_ = 0;
+
+    int64_t elapsedUs = nowUs - windowStartUs_;
+    if (elapsedUs >= windowUs_)
+    {
+      hundredthsOfPercent_.store((uint32_t)(busyUs_ * 10000 / elapsedUs), std::memory_order_relaxed);
+      windowsCompleted_.fetch_add(1, std::memory_order_relaxed);
+      busyUs_ = 0;
+      windowStartUs_ = nowUs;
+    }
+  }
+
+  // Share of the last full window, 0 - 100. Stays 0 until the first window is done.
+  float percent() const { return hundredthsOfPercent_.load(std::memory_order_relaxed) / 100.0f; }
+  uint32_t windowsCompleted() const { return windowsCompleted_.load(std::memory_order_relaxed); }
+
+private:
+  int64_t windowUs_;
+  int64_t windowStartUs_ = 0;
+  int64_t awakeSinceUs_ = 0;
+  int64_t busyUs_ = 0;
+  std::atomic<uint32_t> hundredthsOfPercent_{0};
+  std::atomic<uint32_t> windowsCompleted_{0};
+};
+
+#endif // TASKLOAD_H
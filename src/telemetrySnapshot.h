@@ -0,0 +1,26 @@
+// telemetrySnapshot.h
+#ifndef TELEMETRYSNAPSHOT_H
+#define TELEMETRYSNAPSHOT_H
+#include <stdint.h>
+#include "dispenseProfile.h"
+
+// Everything the other tasks show or publish about the wheel, handed over by mainTask as one consistent copy through
+//   a seqlock (see seqLock.h). Reading the live counters directly from core 1 could catch them half way through an
+//   update, ie a treat counted but the distance not yet moved on; this way mainTask never waits and readers never tear.
+//   In its own header so `program seqlock-stress` can hammer the real thing on a PC.
+struct TelemetrySnapshot
+{
+  uint32_t totalDistance;    // cm
+  uint32_t totalTreats;
+  uint32_t progressDistance; // cm run towards the next treat
+  uint32_t speed;            // cm/s
+  uint32_t peakSpeed;        // cm/s
+  float cadence;             // wheel revolutions per minute over the current / last run
+  bool outOfTreats;
+  bool hopperEmpty;
+  bool dispensing;
+  DispenseProfileState dispenseProfile; // learned motor speed profile, saveStatisticsTask keeps it in NVS
+  DispenseProfileStats dispenseStats;
+};
+
+#endif // TELEMETRYSNAPSHOT_H
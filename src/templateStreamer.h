@@ -0,0 +1,90 @@
+// templateStreamer.h
+#ifndef TEMPLATESTREAMER_H
+#define TEMPLATESTREAMER_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Streams a page template out in whatever sized chunks the web server asks for. Static text is copied straight out of
+//   flash, and each {{name}} placeholder is formatted into a small fixed buffer by Fields::format() as we reach it, so
+//   nothing bigger than one field is ever held in RAM. Fields is a plain snapshot struct that gets copied in with us.
+//
+// Used with AsyncWebServer chunked responses, where returning 0 ends the response.
+template <typename Fields>
+class TemplateStreamer
+{
+public:
+  static const size_t FIELD_BUFFER_SIZE = 160;
+
+  TemplateStreamer(const char *pageTemplate, const Fields &fields) : fields_(fields), pos_(pageTemplate) {}
+
+  size_t fill(uint8_t *buffer, size_t maxLen)
+  {
+    size_t written = 0;
+    while (written < maxLen)
+    {
+      // finish off a field that didn't fit in the last chunk
+      if (fieldPos_ < fieldLen_)
+      {
+        size_t n = copyInto(buffer + written, maxLen - written, field_ + fieldPos_, fieldLen_ - fieldPos_);
+        fieldPos_ += n;
+        written += n;
+        continue;
+      }
+
+      if (*pos_ == '\0')
+      {
+        break;
+      }
+
+      if (nextPlaceholder_ == NULL || nextPlaceholder_ < pos_)
+      {
+        nextPlaceholder_ = strstr(pos_, "{{");
+        if (nextPlaceholder_ == NULL)
+        {
+          nextPlaceholder_ = pos_ + strlen(pos_); // no more placeholders, point at the end so we don't search again
+        }
+      }
+
+      if (nextPlaceholder_ == pos_ && *pos_ == '{')
+      {
+        const char *close = strstr(pos_ + 2, "}}");
+        if (close != NULL)
+        {
+          fieldLen_ = fields_.format(pos_ + 2, close - (pos_ + 2), field_, sizeof(field_));
+          if (fieldLen_ >= sizeof(field_))
+          {
+            fieldLen_ = sizeof(field_) - 1; // snprintf tells us how long it wanted to be, not how much it wrote
+          }
+          fieldPos_ = 0;
+          pos_ = close + 2;
+          nextPlaceholder_ = NULL;
+          continue;
+        }
+        nextPlaceholder_ = pos_ + strlen(pos_); // unterminated placeholder, just send the rest as it is
+      }
+
+      size_t n = copyInto(buffer + written, maxLen - written, pos_, nextPlaceholder_ - pos_);
+      pos_ += n;
+      written += n;
+    }
+    return written;
+  }
+
+private:
+  static size_t copyInto(uint8_t *dest, size_t destLen, const char *src, size_t srcLen)
+  {
+    size_t n = srcLen < destLen ? srcLen : destLen;
+    memcpy(dest, src, n);
+    return n;
+  }
+
+  Fields fields_;
+  const char *pos_;
+  const char *nextPlaceholder_ = NULL;
+  char field_[FIELD_BUFFER_SIZE];
+  size_t fieldLen_ = 0;
+  size_t fieldPos_ = 0;
+};
+
+#endif // TEMPLATESTREAMER_H
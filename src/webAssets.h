@@ -0,0 +1,212 @@
+// Generated by tools/build_web_assets.py from the files in web/ - don't edit this, edit those and rebuild.
+#ifndef WEBASSETS_H
+#define WEBASSETS_H
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#define PROGMEM // the native build (page-bench) includes this too
+#endif
+
+struct WebAsset
+{
+  const char *path;
+  const char *contentType;
+  const uint8_t *data;
+  size_t length;
+  const char *etag;
+  const char *cacheControl;
+};
+
+// style.css: 3589 bytes, 2639 minified, 1054 gzipped
+#define WEB_ASSET_STYLE_CSS_HASH "f7246540b6cc2610"
+const uint8_t WEB_ASSET_STYLE_CSS[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x56, 0x4d, 0x8f, 0xa3, 0x38, 0x10, 0xfd, 0x2b, 0x51,
+    0x8f, 0x46, 0x33, 0xa3, 0x0d, 0x08, 0x08, 0xe9, 0xa4, 0x8d, 0xf6, 0xbc, 0xda, 0xf3, 0x7e, 0x68, 0xa5, 0xd1, 0x1e, 0x8c,
+    0x5d, 0x10, 0x6f, 0x83, 0x8d, 0x6c, 0xd3, 0x49, 0x06, 0xf1, 0xdf, 0xb7, 0x6c, 0x20, 0xa1, 0x09, 0x3d, 0xe2, 0x02, 0xb8,
+    0x5c, 0xf5, 0xea, 0x55, 0xbd, 0xb2, 0x73, 0xc5, 0xaf, 0x5d, 0xa1, 0xa4, 0x0d, 0x0a, 0x5a, 0x8b, 0xea, 0x4a, 0xbe, 0xfc,
+    0x01, 0xa5, 0x82, 0xcd, 0x5f, 0xbf, 0x7f, 0xd9, 0xfe, 0x49, 0x4f, 0xaa, 0xa6, 0xdb, 0xdf, 0x40, 0xc2, 0x1b, 0xdd, 0xfe,
+    0x0d, 0x9a, 0x53, 0x49, 0xb7, 0x86, 0x4a, 0x13, 0x18, 0xd0, 0xa2, 0xc8, 0x72, 0xca, 0x5e, 0x4b, 0xad, 0x5a, 0xc9, 0x03,
+    0xa6, 0x2a, 0xa5, 0xc9, 0xa7, 0x62, 0xef, 0x9e, 0x6c, 0xfc, 0xda, 0xed, 0x76, 0x59, 0x25, 0x24, 0x04, 0x27, 0x10, 0xe5,
+    0xc9, 0x92, 0x38, 0x7c, 0xce, 0x6a, 0xaa, 0x4b, 0x21, 0x49, 0x94, 0x35, 0x94, 0x73, 0x21, 0x4b, 0x12, 0xf5, 0x21, 0xc3,
+    0xf8, 0x14, 0xed, 0x74, 0x57, 0xd3, 0x4b, 0x70, 0x16, 0xdc, 0x9e, 0xc8, 0x73, 0x14, 0x35, 0x97, 0xc9, 0x7a, 0x87, 0xef,
+    0x1b, 0xda, 0x5a, 0x75, 0xdb, 0x95, 0xec, 0x71, 0xf5, 0x1e, 0x9f, 0x9c, 0x4f, 0xc2, 0x42, 0x96, 0x2b, 0xcd, 0x41, 0x07,
+    0x9a, 0x72, 0xd1, 0x1a, 0x12, 0x3b, 0x0f, 0xb9, 0xba, 0x04, 0xe6, 0x44, 0xb9, 0x3a, 0x93, 0x68, 0x93, 0xa2, 0x9b, 0x18,
+    0x77, 0x6e, 0x74, 0x99, 0xd3, 0xaf, 0xd1, 0xd6, 0x3f, 0x61, 0xfc, 0xad, 0x3f, 0xc5, 0xdd, 0x88, 0x39, 0x61, 0x3b, 0xd8,
+    0x47, 0x99, 0x85, 0x8b, 0x0d, 0x68, 0x25, 0x4a, 0x49, 0x18, 0x48, 0x0b, 0x7a, 0x84, 0x12, 0xe4, 0xca, 0x5a, 0x55, 0xfb,
+    0xf8, 0x7d, 0x58, 0x28, 0x5d, 0x07, 0x0e, 0x41, 0xd3, 0x2d, 0x96, 0x31, 0x74, 0x5f, 0xd1, 0x1c, 0xaa, 0x8e, 0x0b, 0xd3,
+    0x54, 0xf4, 0x4a, 0xf2, 0x4a, 0xb1, 0xd7, 0x85, 0x97, 0x23, 0x02, 0xf4, 0xe4, 0x9f, 0x07, 0x82, 0x30, 0xe9, 0x5e, 0xc8,
+    0xa6, 0xb5, 0xdf, 0xed, 0xb5, 0x81, 0x5f, 0x9f, 0x1c, 0x8a, 0xa7, 0x7f, 0xb7, 0xf3, 0x5f, 0x0d, 0x35, 0xe6, 0x8c, 0x69,
+    0x2e, 0x7e, 0xcb, 0xb6, 0xce, 0x41, 0xe3, 0x4f, 0x03, 0x15, 0x30, 0xdb, 0x0d, 0x24, 0xc6, 0x51, 0xf4, 0xf9, 0x46, 0xd9,
+    0x48, 0x87, 0x63, 0x88, 0xc4, 0xc8, 0x81, 0x51, 0x95, 0xe0, 0x9b, 0x4f, 0x9c, 0xf3, 0x05, 0x6f, 0xe9, 0x84, 0xca, 0x88,
+    0x1f, 0x40, 0xe2, 0xe7, 0x89, 0x45, 0xf1, 0xc3, 0xb9, 0x19, 0x6d, 0xf1, 0x4f, 0x9f, 0xb7, 0x98, 0x85, 0x7c, 0x87, 0xc3,
+    0xb4, 0x79, 0x2d, 0x10, 0x73, 0xf7, 0xd8, 0x1b, 0xbb, 0xf4, 0xe5, 0xc8, 0xf3, 0xb1, 0x37, 0xe6, 0xf5, 0x22, 0x52, 0x49,
+    0xb8, 0xc3, 0x4c, 0x10, 0x5b, 0x72, 0xc7, 0x3a, 0x47, 0xc5, 0x5a, 0x6d, 0x70, 0x73, 0xa3, 0x84, 0x2f, 0xc9, 0x02, 0xe4,
+    0x2c, 0x67, 0xab, 0xb1, 0x4b, 0x85, 0x15, 0x4a, 0x92, 0x25, 0x90, 0x4d, 0x14, 0xee, 0xcc, 0x54, 0x07, 0xab, 0x1a, 0xe2,
+    0x2a, 0x39, 0x64, 0x42, 0x4e, 0xea, 0x0d, 0xf4, 0x6a, 0x3e, 0xc3, 0xd2, 0x4a, 0x56, 0xc9, 0xcb, 0x31, 0xca, 0x5f, 0xfa,
+    0x30, 0xb7, 0x32, 0x68, 0xb4, 0x40, 0xbf, 0xd7, 0x0f, 0x73, 0x1f, 0xac, 0x4c, 0xcb, 0x18, 0x18, 0xb3, 0xe6, 0x0b, 0x18,
+    0x3b, 0xc4, 0x83, 0x15, 0x6a, 0xad, 0x5c, 0x0d, 0x08, 0x87, 0x94, 0xed, 0xd8, 0x60, 0x74, 0xa6, 0x5a, 0x22, 0x67, 0x2b,
+    0x56, 0xc5, 0xee, 0x85, 0xc5, 0x49, 0x1f, 0x4a, 0xb0, 0xd8, 0x2d, 0xaf, 0x41, 0x25, 0x8c, 0xed, 0x66, 0x49, 0x27, 0xeb,
+    0xcd, 0x00, 0x00, 0x2b, 0xb4, 0x3b, 0x55, 0x8e, 0x12, 0x4e, 0xbc, 0x2c, 0x1d, 0x17, 0x45, 0xa5, 0xce, 0xc1, 0x95, 0x38,
+    0x55, 0xde, 0xc3, 0x60, 0x51, 0xeb, 0x6e, 0xa5, 0xe1, 0xa6, 0x86, 0x5f, 0x84, 0x5a, 0xd4, 0xf3, 0xe7, 0x55, 0x4b, 0x4c,
+    0x36, 0x69, 0xa9, 0xa8, 0xe0, 0x92, 0xfd, 0xd7, 0x1a, 0x2b, 0x8a, 0x6b, 0xe0, 0xa6, 0x07, 0x4a, 0x94, 0x98, 0x86, 0x32,
+    0x08, 0x72, 0x44, 0x02, 0x20, 0x33, 0xaf, 0x5d, 0x8f, 0xc7, 0x8c, 0x0a, 0x7e, 0x8f, 0xf2, 0xc3, 0x82, 0x16, 0xc7, 0xe2,
+    0xa5, 0xa0, 0x33, 0x63, 0x59, 0xa8, 0xce, 0x05, 0x24, 0x71, 0xe6, 0xbb, 0x36, 0xf0, 0x81, 0xb0, 0x69, 0xcf, 0x9a, 0x36,
+    0x37, 0x2a, 0xc8, 0x49, 0x70, 0x8e, 0x71, 0xfd, 0xe0, 0xb8, 0xfd, 0x84, 0xaa, 0x12, 0x8d, 0x11, 0xe6, 0xee, 0xce, 0x58,
+    0x6a, 0x4d, 0xf7, 0x2e, 0x91, 0x47, 0xa8, 0x53, 0x7b, 0x56, 0x50, 0x58, 0x4f, 0x63, 0x1f, 0x6a, 0x63, 0x44, 0x37, 0x9f,
+    0x15, 0xb9, 0xaa, 0xf8, 0x64, 0xa7, 0x87, 0xf1, 0xea, 0x27, 0x26, 0x7e, 0x0e, 0x42, 0x48, 0xdd, 0xe7, 0x6c, 0x8e, 0x79,
+    0xa3, 0xc1, 0x51, 0x08, 0x17, 0x86, 0xd0, 0x30, 0x56, 0xb7, 0x68, 0x3d, 0xbf, 0x5a, 0x2a, 0xc5, 0xbb, 0x45, 0x23, 0xf9,
+    0x85, 0x82, 0x0a, 0x3d, 0x2d, 0xc0, 0xf3, 0x01, 0x92, 0x69, 0xe1, 0x0c, 0xf4, 0xb5, 0x5b, 0x34, 0x28, 0x48, 0xa6, 0xaf,
+    0x8d, 0xab, 0x66, 0x37, 0x13, 0x6a, 0xe2, 0x64, 0x3c, 0x8f, 0x99, 0x3d, 0x26, 0x75, 0x4b, 0x61, 0xbf, 0x9e, 0x82, 0x6a,
+    0x40, 0x06, 0x23, 0xa1, 0x9b, 0x79, 0x9c, 0x05, 0x82, 0x4a, 0x51, 0xd7, 0x88, 0xdd, 0xe3, 0x30, 0xbf, 0x1d, 0x23, 0xd1,
+    0x1d, 0xce, 0xa1, 0x38, 0xb2, 0x23, 0xef, 0xc3, 0xa1, 0x90, 0xb7, 0x12, 0xb9, 0xe1, 0xd4, 0x87, 0xae, 0x6c, 0xad, 0x09,
+    0x6a, 0x14, 0x2e, 0x2d, 0xe1, 0xde, 0xe2, 0xfb, 0xfb, 0x21, 0xe5, 0x0f, 0x96, 0x68, 0x45, 0x3e, 0x0f, 0xe1, 0x6f, 0xee,
+    0x3e, 0x1e, 0x05, 0x3c, 0x05, 0xce, 0xe9, 0x04, 0x2d, 0xde, 0xef, 0x0f, 0x49, 0x7a, 0xdb, 0x06, 0x5a, 0xab, 0xf5, 0xd6,
+    0xe5, 0x87, 0xfb, 0xa6, 0x43, 0x12, 0xb3, 0xd9, 0x26, 0xdf, 0xc7, 0x2b, 0x81, 0x62, 0x60, 0x45, 0x3c, 0xed, 0x89, 0xd8,
+    0x3e, 0x7d, 0xc6, 0x13, 0x19, 0xa9, 0x75, 0x06, 0x6d, 0x2d, 0xdf, 0xb7, 0x6a, 0x49, 0x1b, 0x9f, 0xa7, 0x3b, 0xb3, 0xfd,
+    0xea, 0x20, 0x0c, 0xdc, 0xa0, 0xca, 0xb2, 0x42, 0x69, 0x9c, 0x85, 0x65, 0xa7, 0xae, 0x51, 0xa3, 0x8c, 0x35, 0x54, 0xd4,
+    0x8a, 0x37, 0xb8, 0x29, 0x57, 0x48, 0x7f, 0x21, 0x18, 0x0e, 0xc3, 0xe9, 0xa4, 0x47, 0x8e, 0xc6, 0xf1, 0xb2, 0x73, 0x7c,
+    0xa1, 0x78, 0xac, 0x60, 0xb4, 0x1a, 0x39, 0xab, 0xb1, 0x1e, 0x15, 0x2c, 0x42, 0x6c, 0xfc, 0x90, 0xee, 0x14, 0x4a, 0x51,
+    0xd8, 0x2b, 0x5e, 0x27, 0x06, 0x5f, 0xd1, 0xe4, 0x08, 0x73, 0x30, 0x38, 0x66, 0x50, 0xe1, 0x37, 0x2c, 0x34, 0xc7, 0xc9,
+    0xd3, 0xda, 0xc7, 0xa9, 0x83, 0xe3, 0x30, 0xca, 0xbc, 0xd4, 0xa2, 0x6c, 0x50, 0x92, 0xab, 0xa2, 0x9f, 0x57, 0xd1, 0xca,
+    0x1d, 0x87, 0x31, 0x36, 0x9f, 0x54, 0x61, 0x6a, 0x16, 0x35, 0x77, 0x49, 0x4c, 0xe1, 0x49, 0x0e, 0x78, 0x49, 0x80, 0x35,
+    0x14, 0xe3, 0xd8, 0x7a, 0x7a, 0x9a, 0x30, 0x27, 0xf7, 0x43, 0xcc, 0xbf, 0x7a, 0x48, 0xa9, 0x9f, 0xa1, 0x1e, 0x4c, 0xfa,
+    0xee, 0xca, 0x13, 0xcc, 0x0f, 0xd2, 0x9f, 0xe2, 0xd9, 0x47, 0x9f, 0x87, 0x5b, 0x05, 0x61, 0x27, 0x60, 0xaf, 0xc0, 0x7f,
+    0x99, 0xb8, 0xf9, 0xf0, 0x08, 0x5a, 0x35, 0x9f, 0x72, 0xf1, 0xc1, 0xdc, 0xd5, 0x87, 0xf8, 0x37, 0xac, 0x30, 0xfc, 0xf3,
+    0xd5, 0x21, 0xfe, 0xd6, 0xff, 0x0f, 0x9c, 0x1f, 0x1c, 0x07, 0x4f, 0x0a, 0x00, 0x00,
+};
+
+// setup.js: 2500 bytes, 1722 minified, 639 gzipped
+#define WEB_ASSET_SETUP_JS_HASH "7e5307c39e276cb2"
+const uint8_t WEB_ASSET_SETUP_JS[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x9d, 0x55, 0x5d, 0x6f, 0xda, 0x30, 0x14, 0x7d, 0xcf, 0xaf,
+    0xb0, 0x50, 0x55, 0x07, 0xad, 0xa4, 0x74, 0xd2, 0x3e, 0x34, 0x08, 0x0f, 0x74, 0x48, 0xab, 0xd4, 0xb2, 0x97, 0xfe, 0x80,
+    0x5a, 0xf1, 0x0d, 0x78, 0x04, 0x3b, 0xb2, 0x0d, 0xac, 0x42, 0xfc, 0xf7, 0x5d, 0x3b, 0x1f, 0x18, 0x0a, 0x08, 0xed, 0x89,
+    0xc4, 0x3e, 0xe7, 0xde, 0x73, 0xce, 0xb5, 0x03, 0x57, 0xd9, 0x6a, 0x09, 0xd2, 0x26, 0x33, 0xb0, 0x93, 0x02, 0xdc, 0xe3,
+    0xf8, 0xfd, 0x89, 0xc7, 0xd4, 0x64, 0x4c, 0x8e, 0xad, 0xa4, 0xdd, 0x84, 0x71, 0x3e, 0x59, 0xe3, 0xfa, 0xb3, 0x30, 0x16,
+    0x24, 0xe8, 0x98, 0x66, 0x85, 0xc8, 0x16, 0xf4, 0x8e, 0xe4, 0x2b, 0x99, 0x59, 0xa1, 0x64, 0xdc, 0x25, 0xdb, 0x68, 0xcd,
+    0x34, 0x91, 0x60, 0x37, 0x4a, 0x2f, 0x1c, 0x92, 0xa4, 0x84, 0x9f, 0xab, 0x1d, 0xc0, 0x68, 0x77, 0xe0, 0x99, 0x85, 0x62,
+    0x5c, 0xc8, 0xd9, 0x25, 0x56, 0x0d, 0x69, 0x18, 0x75, 0x11, 0xf3, 0x53, 0xac, 0xaf, 0xe8, 0x65, 0x1c, 0x2d, 0xe8, 0x9b,
+    0x64, 0x05, 0x33, 0xc6, 0x3f, 0x69, 0x58, 0xaa, 0x35, 0xc4, 0x74, 0x2e, 0x38, 0x07, 0xe9, 0x70, 0x75, 0xa7, 0x8b, 0x98,
+    0xa0, 0x7d, 0x22, 0x24, 0xc6, 0xf2, 0xeb, 0xf5, 0xe5, 0x19, 0x85, 0x50, 0x3a, 0x88, 0x9a, 0x5c, 0xbc, 0xab, 0x69, 0x0d,
+    0x8c, 0x99, 0xb5, 0xb0, 0x2c, 0xad, 0xcb, 0x2a, 0x07, 0x9b, 0xcd, 0x63, 0x7a, 0xef, 0x42, 0xa6, 0xdd, 0x28, 0xb1, 0x73,
+    0x90, 0xb1, 0x06, 0x53, 0x2a, 0x69, 0x80, 0xa4, 0x23, 0xd2, 0x3c, 0x27, 0x7f, 0x8c, 0x8b, 0xb7, 0x81, 0x70, 0x66, 0x99,
+    0xdb, 0xde, 0x46, 0x22, 0x27, 0xfe, 0x2d, 0x71, 0x25, 0xa4, 0x4b, 0xee, 0xf6, 0x96, 0xd4, 0x1d, 0xc8, 0x90, 0x7c, 0xee,
+    0xbb, 0x36, 0x06, 0xec, 0xab, 0x58, 0x82, 0x5a, 0xd9, 0x18, 0x47, 0x84, 0xbc, 0x53, 0x7a, 0xc8, 0x27, 0xf2, 0xd0, 0xbd,
+    0x23, 0x0f, 0xfd, 0x7e, 0x1f, 0x6d, 0x69, 0xb0, 0x2b, 0x2d, 0x07, 0xd1, 0x2e, 0x32, 0x73, 0xb5, 0x69, 0xb1, 0xbe, 0x55,
+    0x63, 0x19, 0x61, 0x3b, 0x54, 0x94, 0x31, 0x67, 0x02, 0xb4, 0x56, 0xba, 0xd2, 0xf4, 0x31, 0x36, 0x3c, 0x3a, 0x57, 0x65,
+    0x36, 0xe4, 0x38, 0x44, 0x4f, 0x4b, 0x3b, 0x35, 0xa8, 0x27, 0x50, 0x5d, 0x67, 0x34, 0xf1, 0xe5, 0x5b, 0x93, 0x4d, 0x85,
+    0xe1, 0x3d, 0x32, 0x46, 0x18, 0x75, 0x86, 0x29, 0xa9, 0x02, 0x12, 0x2f, 0x23, 0xa6, 0x1e, 0xfe, 0x03, 0x8f, 0xa6, 0x7f,
+    0xf7, 0x42, 0x9d, 0x97, 0x76, 0x20, 0x1f, 0x4c, 0x75, 0xaf, 0xd1, 0xdd, 0x86, 0x5d, 0x80, 0x9c, 0xd9, 0x39, 0x49, 0xd3,
+    0x94, 0xf8, 0x80, 0xff, 0xc3, 0xd0, 0x54, 0xb5, 0x26, 0x48, 0xae, 0x56, 0x92, 0xb7, 0x56, 0xf6, 0xd1, 0xfb, 0x5e, 0xb9,
+    0xd2, 0x13, 0x86, 0x01, 0xd7, 0xe8, 0x2a, 0x62, 0x67, 0xd7, 0x36, 0x05, 0x9e, 0xb0, 0x60, 0x78, 0xf4, 0x33, 0x0d, 0xcc,
+    0x42, 0x7d, 0xfa, 0x63, 0x8a, 0x65, 0x83, 0xd0, 0x1d, 0xb8, 0x72, 0x38, 0x65, 0x4b, 0x70, 0x1a, 0x43, 0x5d, 0xb4, 0x32,
+    0x59, 0x2f, 0x25, 0x20, 0x33, 0xfd, 0x5e, 0xfa, 0xc4, 0x9c, 0x57, 0xfa, 0xbb, 0x74, 0x41, 0xec, 0x0d, 0xef, 0x8b, 0xed,
+    0xe3, 0x52, 0x88, 0xe9, 0xd5, 0xfb, 0xd4, 0xa7, 0x5e, 0x80, 0x25, 0xda, 0x18, 0xf1, 0xe8, 0x80, 0xae, 0xe3, 0x06, 0xd8,
+    0xe2, 0xa8, 0x93, 0xdb, 0x27, 0x23, 0xd2, 0xfb, 0x8a, 0x79, 0x1e, 0x60, 0xe1, 0x6f, 0x06, 0x05, 0xe6, 0x6d, 0x91, 0x00,
+    0x05, 0xde, 0x8a, 0x93, 0xac, 0xef, 0x47, 0xac, 0x99, 0x52, 0xfc, 0x12, 0xe1, 0xdb, 0x97, 0x23, 0x42, 0xce, 0x84, 0xa6,
+    0x87, 0x21, 0x85, 0x83, 0x7c, 0x8b, 0x4e, 0x4e, 0x52, 0xe6, 0xaa, 0x33, 0xba, 0xd9, 0x36, 0xd5, 0xb1, 0x20, 0xdf, 0x55,
+    0x73, 0x3c, 0x89, 0x37, 0x96, 0x59, 0xd3, 0x39, 0xdc, 0xf3, 0x8a, 0x6e, 0xb6, 0xad, 0x98, 0x5d, 0x58, 0xd0, 0xad, 0xee,
+    0x08, 0x1f, 0x2f, 0x4f, 0x14, 0xdd, 0xcf, 0x26, 0x64, 0xec, 0x57, 0x5b, 0x21, 0xd5, 0xcf, 0xdb, 0xa1, 0xb9, 0x2b, 0x3f,
+    0xe6, 0x67, 0x3f, 0xa7, 0xce, 0x2a, 0xfe, 0x27, 0xac, 0x59, 0xb1, 0x72, 0x87, 0x28, 0x4c, 0x60, 0x70, 0x9e, 0x55, 0xa2,
+    0x72, 0x64, 0xe5, 0xb8, 0x6f, 0xe2, 0xfa, 0x56, 0x86, 0x77, 0x87, 0x95, 0x78, 0x78, 0xf8, 0xe3, 0x5c, 0x14, 0x3c, 0x0e,
+    0xd4, 0xb6, 0xf7, 0xf7, 0xe0, 0xbb, 0xd5, 0xaf, 0x96, 0xff, 0x01, 0x63, 0xdd, 0xb3, 0x21, 0xba, 0x06, 0x00, 0x00,
+};
+
+// main.js: 2349 bytes, 1889 minified, 790 gzipped
+#define WEB_ASSET_MAIN_JS_HASH "a71f9bf9ae584323"
+const uint8_t WEB_ASSET_MAIN_JS[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x55, 0x6d, 0x4f, 0x1b, 0x31, 0x0c, 0xfe, 0xde, 0x5f,
+    0x61, 0xb1, 0x0f, 0xb9, 0xd3, 0xba, 0x2b, 0xa0, 0x4d, 0x93, 0x28, 0x05, 0xc1, 0x06, 0x1a, 0x13, 0x0c, 0xb4, 0xf6, 0x0f,
+    0x84, 0x8b, 0xdb, 0x1e, 0x4b, 0x2f, 0xb7, 0xc4, 0x47, 0xa9, 0xaa, 0xfe, 0xf7, 0x39, 0xf7, 0x7e, 0x0c, 0xaa, 0x4a, 0x6d,
+    0x62, 0xfb, 0x79, 0xec, 0x3c, 0x8e, 0xd3, 0x79, 0x9e, 0xc6, 0x94, 0x98, 0x14, 0xc8, 0x2c, 0x16, 0x1a, 0x1f, 0xa4, 0x73,
+    0x6b, 0x63, 0x55, 0x10, 0xc2, 0x76, 0x10, 0x9b, 0xd4, 0x11, 0x64, 0x95, 0xe9, 0x3a, 0x41, 0xad, 0x60, 0x02, 0xca, 0xc4,
+    0xf9, 0x0a, 0x53, 0x8a, 0x16, 0x48, 0x57, 0x1a, 0xfd, 0xf2, 0x72, 0x73, 0xa3, 0x02, 0xb1, 0xfa, 0x4b, 0x54, 0xe3, 0x45,
+    0x38, 0xae, 0xe0, 0x25, 0xef, 0x65, 0x4e, 0xc4, 0x49, 0x26, 0x80, 0xcf, 0x1e, 0x4a, 0xd2, 0x32, 0x7a, 0x3c, 0x48, 0xe6,
+    0x10, 0xf4, 0xf8, 0x23, 0xda, 0x64, 0x08, 0x93, 0xc9, 0x04, 0x44, 0xd6, 0x50, 0x71, 0x29, 0x6f, 0x05, 0x81, 0x20, 0x7c,
+    0x21, 0x31, 0x1e, 0x74, 0x53, 0x44, 0xde, 0xf6, 0xcd, 0xa4, 0xc4, 0x69, 0x7c, 0xc8, 0x8f, 0x44, 0x21, 0x87, 0xec, 0x00,
+    0xb5, 0xc3, 0x77, 0x89, 0x9a, 0x5c, 0xfb, 0xc9, 0xa6, 0x4b, 0xb3, 0xf6, 0x64, 0xfc, 0x99, 0xd7, 0xba, 0xf1, 0x29, 0xe7,
+    0x89, 0x5d, 0x5d, 0x14, 0xbb, 0x60, 0x85, 0xce, 0xc9, 0x05, 0xfa, 0x92, 0x2d, 0x52, 0x6e, 0x1b, 0x7f, 0xe3, 0x19, 0xbf,
+    0x01, 0xfe, 0x8d, 0x8e, 0x15, 0xa1, 0xe0, 0x0d, 0x98, 0xb8, 0xb0, 0x08, 0x1b, 0x93, 0x83, 0xcb, 0xab, 0xc5, 0x5a, 0xa6,
+    0x5e, 0x55, 0xb0, 0x25, 0x08, 0x68, 0x89, 0xa0, 0xf0, 0x39, 0x89, 0xf1, 0x5c, 0xf4, 0xd9, 0x1d, 0xd2, 0x8c, 0x0f, 0x10,
+    0x24, 0x6a, 0x08, 0xfe, 0x24, 0x6d, 0x4f, 0xb1, 0xec, 0xdb, 0x9e, 0x6e, 0x26, 0x2a, 0x2c, 0xdb, 0x53, 0x85, 0x7a, 0x6c,
+    0xb5, 0x7c, 0xa5, 0x8a, 0xdf, 0x95, 0x9a, 0x68, 0x24, 0x88, 0x73, 0x6b, 0xd9, 0x3e, 0x25, 0x49, 0xb9, 0x63, 0xef, 0x76,
+    0x37, 0x6e, 0x0b, 0x62, 0x8f, 0x42, 0x5b, 0xfa, 0x02, 0x57, 0xfc, 0x14, 0x35, 0xbd, 0xc2, 0x94, 0x9e, 0xf1, 0xa0, 0xae,
+    0x5f, 0x64, 0xd6, 0x2c, 0xf8, 0xb8, 0x4e, 0x0c, 0x2b, 0x5f, 0x54, 0x5b, 0xee, 0x90, 0xd0, 0x3a, 0xf8, 0x08, 0x62, 0x24,
+    0xf8, 0xbb, 0xf2, 0xd2, 0x92, 0x7d, 0x4b, 0xa3, 0x55, 0xeb, 0x86, 0x72, 0xe9, 0x15, 0x6a, 0x68, 0xc9, 0x90, 0xd4, 0xdf,
+    0x13, 0x06, 0xa5, 0x31, 0xb6, 0xdc, 0x3d, 0xf3, 0x7e, 0x06, 0x97, 0x21, 0x2a, 0x46, 0x56, 0x87, 0x89, 0x8a, 0x3d, 0x8c,
+    0xe0, 0xe8, 0xf0, 0x30, 0x64, 0x9e, 0xeb, 0xe4, 0x05, 0x55, 0x70, 0x1c, 0x16, 0xf0, 0xd5, 0xc8, 0xf1, 0x65, 0x47, 0xf9,
+    0x07, 0x7c, 0xa5, 0x35, 0xc2, 0x1b, 0xa6, 0xfb, 0x51, 0x61, 0xbf, 0x68, 0x8b, 0x92, 0x3a, 0x4a, 0x94, 0xfb, 0x6e, 0x84,
+    0x9f, 0xc3, 0x52, 0xcb, 0x36, 0xca, 0xdb, 0xb8, 0x65, 0x29, 0xc6, 0xc4, 0xa9, 0xce, 0x41, 0xcc, 0x6c, 0x8e, 0x02, 0x4e,
+    0x40, 0x5c, 0x4b, 0x1e, 0x8c, 0x76, 0x5c, 0x4d, 0x4e, 0xf7, 0xf3, 0x59, 0xc1, 0xb9, 0x6f, 0xd6, 0x3b, 0x61, 0xa2, 0xba,
+    0x28, 0x1d, 0x93, 0x6f, 0x6a, 0x67, 0x1b, 0x25, 0x9c, 0xd8, 0xfe, 0x98, 0xdd, 0xdd, 0x36, 0xcd, 0x8d, 0x96, 0x26, 0xcb,
+    0xd0, 0x5e, 0xad, 0x32, 0xda, 0xf8, 0x72, 0x4e, 0x1f, 0xd9, 0xb1, 0xd1, 0x38, 0x39, 0x88, 0x8d, 0x36, 0xf6, 0x04, 0x3e,
+    0x7c, 0x3d, 0x3e, 0x8a, 0x8f, 0x3f, 0x8f, 0x0f, 0xce, 0x7c, 0xa5, 0xa7, 0xa3, 0xc7, 0xb3, 0x4e, 0xb5, 0xaf, 0x46, 0xd0,
+    0xe2, 0xdc, 0xf7, 0xbb, 0xba, 0x57, 0x3e, 0xf9, 0x1c, 0x29, 0x5e, 0x06, 0x62, 0x24, 0xb3, 0x64, 0xe4, 0x6a, 0x29, 0xb6,
+    0x10, 0xcb, 0x78, 0x89, 0xcc, 0x92, 0x9a, 0x4f, 0x8e, 0x8c, 0x65, 0x01, 0x76, 0xe1, 0x80, 0x6f, 0x0b, 0xa6, 0x01, 0x13,
+    0x64, 0x2c, 0x00, 0xbf, 0x06, 0x67, 0x50, 0xaf, 0xa3, 0x27, 0xc7, 0x23, 0x1d, 0xb6, 0x21, 0xed, 0xed, 0x65, 0x5b, 0x2c,
+    0x7d, 0x0e, 0xb4, 0xd6, 0x58, 0x0f, 0xf2, 0xf2, 0x19, 0x8d, 0x51, 0x61, 0x08, 0xc4, 0x95, 0xff, 0x39, 0xe1, 0xac, 0xc5,
+    0x3e, 0x2c, 0x06, 0xd3, 0xcf, 0x47, 0x66, 0xb4, 0x9e, 0x25, 0x2b, 0x64, 0x0c, 0xa4, 0xb9, 0xd6, 0x9d, 0xe9, 0x28, 0xc6,
+    0xf9, 0x81, 0xfd, 0x49, 0xba, 0x28, 0x4e, 0x51, 0xbc, 0x8e, 0x6d, 0xfc, 0xa4, 0x44, 0x14, 0xcf, 0x61, 0x87, 0x85, 0xfb,
+    0x7e, 0xc3, 0xb3, 0x68, 0x9f, 0xa5, 0x0e, 0x7a, 0x4a, 0x0c, 0xe1, 0xcb, 0x21, 0xdf, 0xa8, 0x52, 0x2c, 0xcf, 0xb5, 0x4e,
+    0x52, 0x65, 0xd6, 0xd1, 0x95, 0x7f, 0x82, 0xa7, 0x26, 0xb7, 0x31, 0x76, 0x5e, 0x04, 0x6f, 0xf4, 0x2d, 0x4f, 0x71, 0x0d,
+    0x9d, 0x08, 0x16, 0xb1, 0x74, 0xf9, 0x36, 0x97, 0xab, 0x48, 0x2a, 0x55, 0x44, 0xdc, 0xf2, 0x8c, 0x20, 0x77, 0x96, 0xe7,
+    0xa0, 0xd6, 0xb8, 0x88, 0xf0, 0x72, 0x30, 0xaf, 0x46, 0x69, 0x9b, 0xca, 0x9a, 0x8a, 0x99, 0xe6, 0x7f, 0x0d, 0x7a, 0x0f,
+    0xc3, 0xcf, 0xe9, 0xfd, 0xaf, 0x28, 0x93, 0xd6, 0x61, 0x50, 0xfe, 0x5b, 0x28, 0x49, 0xb2, 0x50, 0x70, 0x5f, 0x09, 0x0a,
+    0x35, 0xc9, 0x7e, 0x05, 0x3d, 0xd6, 0xfb, 0xc7, 0x27, 0xbe, 0xfc, 0x11, 0x3f, 0xf4, 0xc9, 0x22, 0x0d, 0xb6, 0xbb, 0x61,
+    0xff, 0xa9, 0x1a, 0xc2, 0x3b, 0x69, 0xfb, 0x79, 0x4d, 0x5a, 0x35, 0xbc, 0xd7, 0xad, 0xce, 0xff, 0x4b, 0xbf, 0x89, 0xec,
+    0xf8, 0x07, 0x6d, 0x4d, 0x43, 0xfd, 0x61, 0x07, 0x00, 0x00,
+};
+
+// setup.html: 2062 bytes, 1617 minified, 735 gzipped
+#define WEB_ASSET_SETUP_HTML_HASH "09f75f308cb16ad5"
+const uint8_t WEB_ASSET_SETUP_HTML[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8d, 0x55, 0x6d, 0x6f, 0xd3, 0x30, 0x10, 0xfe, 0xbe, 0x5f,
+    0x71, 0xe4, 0xd3, 0x90, 0x68, 0xb2, 0x76, 0x6b, 0xcb, 0xa4, 0x26, 0x08, 0x36, 0x40, 0x93, 0xb6, 0x31, 0xa9, 0x43, 0x08,
+    0x21, 0x3e, 0x38, 0xf6, 0xb5, 0x31, 0x73, 0xec, 0x60, 0x3b, 0x2d, 0xfd, 0xf7, 0x9c, 0xf3, 0xd2, 0xad, 0xdd, 0x50, 0xf9,
+    0xd0, 0xfa, 0xe5, 0xee, 0xb9, 0xe7, 0x7c, 0x7e, 0x7c, 0x99, 0xbd, 0xba, 0xfc, 0x72, 0x71, 0xff, 0xfd, 0xee, 0x23, 0x14,
+    0xbe, 0x54, 0xd9, 0xd1, 0xac, 0x1f, 0x90, 0x09, 0x1a, 0x4a, 0xf4, 0x0c, 0x34, 0x2b, 0x31, 0x8d, 0x56, 0x12, 0xd7, 0x95,
+    0xb1, 0x3e, 0x02, 0x6e, 0xb4, 0x47, 0xed, 0xd3, 0x68, 0x2d, 0x85, 0x2f, 0x52, 0x81, 0x2b, 0xc9, 0x71, 0xd0, 0x2c, 0xde,
+    0x80, 0xd4, 0xd2, 0x4b, 0xa6, 0x06, 0x8e, 0x33, 0x85, 0xe9, 0x30, 0xa2, 0x20, 0x5e, 0x7a, 0x85, 0xd9, 0x85, 0xd1, 0x1a,
+    0xb9, 0x97, 0x7a, 0x19, 0xc7, 0xf1, 0x2c, 0x69, 0x37, 0x8f, 0x66, 0x4a, 0xea, 0x07, 0xb0, 0xa8, 0xd2, 0xc8, 0xf9, 0x8d,
+    0x42, 0x57, 0x20, 0x12, 0x45, 0x61, 0x71, 0x91, 0x46, 0x89, 0xf3, 0xcc, 0x4b, 0x9e, 0x34, 0x96, 0x98, 0x3b, 0xf7, 0x6e,
+    0x95, 0x2e, 0xa6, 0xa3, 0xb3, 0xc9, 0xf8, 0xec, 0x24, 0x9f, 0x70, 0x3e, 0x9a, 0x0c, 0x4f, 0x02, 0x41, 0xd2, 0x65, 0x9b,
+    0x1b, 0xb1, 0xa1, 0x41, 0xc8, 0x15, 0x70, 0xc5, 0x9c, 0x4b, 0xa3, 0x90, 0x2a, 0x93, 0x1a, 0x6d, 0x70, 0x2b, 0x86, 0xd9,
+    0x37, 0xf9, 0x49, 0x02, 0x65, 0xb2, 0x90, 0xcb, 0xda, 0x52, 0x6c, 0xa3, 0x09, 0x3c, 0x0c, 0xd0, 0xda, 0x7b, 0xa3, 0x41,
+    0x0a, 0xca, 0x83, 0x33, 0xfd, 0xc1, 0xeb, 0xa8, 0x8f, 0x91, 0x7b, 0x3d, 0x70, 0x35, 0xe7, 0xe8, 0x5c, 0x94, 0xcd, 0xc9,
+    0x08, 0xb7, 0xe8, 0xd7, 0xc6, 0x3e, 0xb8, 0x59, 0xd2, 0xc2, 0x3a, 0xce, 0x00, 0xd6, 0xad, 0xe9, 0x5a, 0x3a, 0xbf, 0x0d,
+    0xd0, 0xed, 0x0d, 0x14, 0x6d, 0x42, 0x21, 0x85, 0x40, 0x1d, 0x3d, 0x81, 0x28, 0xc3, 0x04, 0x55, 0x65, 0xeb, 0xde, 0xaf,
+    0x1b, 0x2e, 0x4d, 0x33, 0x58, 0x18, 0x0b, 0x5d, 0x10, 0xd7, 0x14, 0x8f, 0xa0, 0xcf, 0x39, 0x29, 0xbb, 0xde, 0xd2, 0x0d,
+    0x84, 0x2b, 0x81, 0xf1, 0x70, 0x4c, 0x2a, 0x26, 0x6f, 0x2f, 0x20, 0x02, 0xba, 0xd4, 0xc2, 0x10, 0x6e, 0x49, 0x95, 0xde,
+    0x2d, 0x57, 0x00, 0x0c, 0x96, 0xd6, 0xd4, 0x55, 0x30, 0x28, 0x96, 0xa3, 0x0a, 0xe4, 0x54, 0x13, 0x27, 0x45, 0x94, 0x75,
+    0xe7, 0x86, 0x5b, 0x12, 0x04, 0x1c, 0xcf, 0xe7, 0x57, 0x97, 0xaf, 0x67, 0x49, 0xe3, 0x45, 0xde, 0x52, 0x57, 0xb5, 0x07,
+    0xbf, 0xa9, 0x48, 0x2b, 0x1e, 0xff, 0x10, 0x4f, 0x53, 0xcc, 0x00, 0xec, 0x14, 0xd4, 0xce, 0x2d, 0xfe, 0xae, 0xa5, 0x45,
+    0xf1, 0x98, 0xe6, 0xff, 0x24, 0x50, 0xb1, 0x50, 0xfd, 0x3b, 0xfa, 0xa7, 0x0c, 0xc4, 0xcb, 0xac, 0x55, 0x67, 0x6d, 0x99,
+    0x1b, 0x44, 0xc7, 0xdc, 0xa2, 0x1f, 0x09, 0x49, 0xd5, 0x52, 0xb9, 0x97, 0x49, 0x5d, 0x5d, 0x96, 0xcc, 0x6e, 0xb2, 0x79,
+    0xa3, 0x3d, 0xb8, 0xba, 0x83, 0x63, 0x53, 0x85, 0x12, 0x32, 0x45, 0xa7, 0xed, 0xad, 0x47, 0xb3, 0x2a, 0xbb, 0x46, 0xb6,
+    0x42, 0xf0, 0x05, 0x3a, 0x84, 0x5c, 0x31, 0xd2, 0xb1, 0x37, 0x40, 0x45, 0x05, 0x92, 0x08, 0x13, 0xc2, 0x92, 0x60, 0x60,
+    0x61, 0x4d, 0x09, 0x1b, 0x53, 0x5b, 0xa0, 0xf8, 0x1e, 0x2d, 0x5d, 0x5e, 0xb5, 0x7b, 0x32, 0x49, 0xac, 0x44, 0xf2, 0xbe,
+    0x05, 0x1c, 0xaa, 0x27, 0x79, 0x77, 0x67, 0x0a, 0xb3, 0x4a, 0x31, 0x8e, 0x85, 0x51, 0x02, 0x29, 0xd0, 0xf0, 0x7c, 0x14,
+    0x0f, 0x27, 0x6f, 0xe3, 0x61, 0x3c, 0x3e, 0xd9, 0xab, 0xde, 0x92, 0x79, 0x5c, 0xb3, 0x4d, 0x94, 0x7d, 0x6e, 0x27, 0x87,
+    0x58, 0x7a, 0xff, 0x8e, 0x6a, 0xbb, 0xfc, 0x07, 0xdf, 0x70, 0x5f, 0x2d, 0x75, 0xae, 0x83, 0xb6, 0xe6, 0xcd, 0x08, 0x37,
+    0xcc, 0x3d, 0x1c, 0xd4, 0x49, 0x0b, 0xe9, 0x95, 0xd2, 0xad, 0x76, 0xf8, 0x46, 0xe3, 0x71, 0xdc, 0xff, 0xf6, 0x0f, 0x28,
+    0x34, 0xdd, 0xef, 0xe5, 0xed, 0x1c, 0xe6, 0x68, 0x57, 0x68, 0x0f, 0xb1, 0x05, 0xf7, 0x8e, 0xaa, 0x99, 0xee, 0xf0, 0xb8,
+    0xa0, 0x6e, 0xe6, 0x60, 0x5b, 0xb4, 0xa0, 0x9b, 0x56, 0x31, 0x7b, 0x01, 0x29, 0xcd, 0x52, 0xfa, 0x9d, 0x46, 0x51, 0x59,
+    0x19, 0xf4, 0x11, 0xc1, 0x8a, 0xa9, 0x9a, 0x5c, 0xba, 0xae, 0xd7, 0x04, 0x09, 0x3a, 0xdb, 0x7d, 0x95, 0x51, 0xe2, 0x2d,
+    0x35, 0xcb, 0x67, 0x4f, 0xf2, 0x00, 0xc9, 0x9a, 0x59, 0xdd, 0x74, 0x8c, 0x8e, 0xe4, 0x3e, 0x04, 0x81, 0x1b, 0x23, 0x10,
+    0x7e, 0x08, 0x2c, 0x0d, 0xac, 0x31, 0xff, 0x7a, 0x05, 0x6b, 0x49, 0x41, 0x29, 0x0e, 0xdf, 0x76, 0x5e, 0xda, 0x5a, 0xc8,
+    0x9f, 0x4f, 0x93, 0x71, 0xdc, 0xca, 0xca, 0x83, 0xb3, 0xfc, 0x49, 0xbb, 0x45, 0x5f, 0x57, 0xf1, 0xaf, 0xd0, 0x6d, 0xa7,
+    0x38, 0x3e, 0x3d, 0x99, 0xf2, 0xd3, 0x73, 0x1c, 0x4d, 0x27, 0x3c, 0x1f, 0x85, 0x16, 0xd3, 0x42, 0x1e, 0x5f, 0x53, 0xd2,
+    0xb5, 0xdd, 0xa4, 0xf9, 0x74, 0xfc, 0x05, 0x2f, 0xaa, 0xca, 0x3c, 0x51, 0x06, 0x00, 0x00,
+};
+
+const WebAsset WEB_ASSETS[] = {
+  {"/static/style.css", "text/css", WEB_ASSET_STYLE_CSS, sizeof(WEB_ASSET_STYLE_CSS), "\"f7246540b6cc2610\"", "public, max-age=31536000, immutable"},
+  {"/static/setup.js", "application/javascript", WEB_ASSET_SETUP_JS, sizeof(WEB_ASSET_SETUP_JS), "\"7e5307c39e276cb2\"", "public, max-age=31536000, immutable"},
+  {"/static/main.js", "application/javascript", WEB_ASSET_MAIN_JS, sizeof(WEB_ASSET_MAIN_JS), "\"a71f9bf9ae584323\"", "public, max-age=31536000, immutable"},
+  {"/static/setup.html", "text/html", WEB_ASSET_SETUP_HTML, sizeof(WEB_ASSET_SETUP_HTML), "\"09f75f308cb16ad5\"", "no-cache"},
+};
+const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);
+
+#endif // WEBASSETS_H
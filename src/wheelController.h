@@ -0,0 +1,232 @@
+// wheelController.h
+#ifndef WHEELCONTROLLER_H
+#define WHEELCONTROLLER_H
+#include <stdint.h>
+#include <stdio.h>
+#include "dispenser.h"
+#include "dispenseQueue.h"
+#include "wheelSpeed.h"
+#include "mqttOutbox.h"
+
+// Everything mainTask decides, one loop at a time: counting the wheel, when a treat has been earned, working through
+//   the dispense requests and noticing when we've run out of treats. mainTask (main.cpp) collects what happened since
+//   its last loop - photodiode notifications, new hall edges and their timestamps - hands it over and calls update().
+//   The native simulation (sim/) drives this exact same code in simulated time.
+//
+// No ESP32 dependencies, everything outside goes through the WheelControllerIO callbacks.
+
+struct WheelControllerIO
+{
+  DispenserIO dispenser;
+  void (*setErrorLed)(bool on);
+  uint32_t (*requestDispense)(DispenseSource source, uint8_t count); // queue a request, comes back through nextRequest
+  bool (*nextRequest)(DispenseRequest &request);                     // next queued request, if there is one
+  void (*reportCompletion)(const DispenseCompletion &completion);    // a request is finished with, however it went
+  void (*recordEvent)(OutboxEventType type, uint32_t value0, uint32_t value1, uint32_t value2);
+  void (*log)(const char *message);
+};
+
+class WheelController
+{
+public:
+  void begin(const WheelControllerIO &io, uint32_t cmPerEdge)
+  {
+    io_ = io;
+    cmPerEdge_ = cmPerEdge;
+    dispenser_.begin(io.dispenser);
+    reportedOutOfTreats_ = outOfTreats_;
+  }
+
+  TreatDispenser &dispenser() { return dispenser_; }
+  DispenseScheduler &scheduler() { return scheduler_; }
+  WheelSpeedTracker &wheelSpeed() { return wheelSpeed_; }
+  const TreatDispenser &dispenser() const { return dispenser_; }
+  const WheelSpeedTracker &wheelSpeed() const { return wheelSpeed_; }
+
+  // Restored totals, from the journal / RTC memory on boot
+  void setCounters(uint32_t totalDistance, uint32_t totalTreats, uint32_t hallEffectCount)
+  {
+    totalDistance_ = totalDistance;
+    totalTreats_ = totalTreats;
+    hallEffectCount_ = hallEffectCount;
+  }
+
+  // Picks up where a trace started, for replaying it
+  void setOutOfTreats(bool outOfTreats)
+  {
+    outOfTreats_ = outOfTreats;
+    reportedOutOfTreats_ = outOfTreats;
+  }
+
+  void setDistanceThreshold(uint32_t cm) { distanceThreshold_ = cm; }
+  void setDebugDistance(bool on) { debugDistance_ = on; }
+
+  // What happened since the last update(). Call these first, then update().
+  void onDispenseBeam(uint32_t nowMs) { dispenser_.onTreatDetected(nowMs); }
+  void onHopperBeam(uint32_t nowMs) { dispenser_.onHopperTreat(nowMs); }
+
+  void resetErrors()
+  {
+    outOfTreats_ = false;
+    dispenser_.clearHopperEmpty();
+    telemetryChanged_ = true;
+  }
+
+  void resetStats()
+  {
+    totalDistance_ = 0;
+    totalTreats_ = 0;
+    hallEffectCount_ = 0;
+    wheelSpeed_.resetPeak();
+    telemetryChanged_ = true;
+  }
+
+  void addEdges(uint32_t count)
+  {
+    if (count == 0)
+    {
+      return;
+    }
+    telemetryChanged_ = true;
+    hallEffectCount_ += count;
+    totalDistance_ += count * cmPerEdge_;
+    if (debugDistance_)
+    {
+      char line[64];
+      snprintf(line, sizeof(line), "distance: %lu, threshold: %lu", (unsigned long)progressDistance(), (unsigned long)distanceThreshold_);
+      io_.log(line);
+    }
+  }
+
+  void addEdgeTime(int64_t timestampUs) { wheelSpeed_.addEdge(timestampUs); }
+
+  // One mainTask loop. Returns true if anything the telemetry shows has changed.
+  bool update(uint32_t nowMs, int64_t nowUs)
+  {
+    if (!errorLedKnown_ || errorLed_ != outOfTreats_)
+    {
+      errorLed_ = outOfTreats_;
+      errorLedKnown_ = true;
+      io_.setErrorLed(errorLed_);
+    }
+
+    wheelSpeed_.update(nowUs);
+    WheelSessionSummary session;
+    if (wheelSpeed_.takeFinishedSession(session))
+    {
+      io_.recordEvent(OutboxEventType::SESSION, session.durationMs, session.distanceCm, session.peakCmPerSec);
+    }
+    if (wheelSpeed_.speedCmPerSec() != lastSpeed_)
+    {
+      telemetryChanged_ = true;
+      lastSpeed_ = wheelSpeed_.speedCmPerSec();
+    }
+
+    // Only start on the next treat's distance once this one's request is in. If the queue is full the count stays
+    //   where it is and it asks again next loop, which is after the loop below has drained the queue.
+    if (!outOfTreats_ && progressDistance() >= distanceThreshold_)
+    {
+      if (io_.requestDispense(DispenseSource::DISTANCE, 1) != 0)
+      {
+        hallEffectCount_ = 0;
+      }
+    }
+
+    // Move everything that was asked for into the scheduler. Duplicates and overflow get answered straight away.
+    DispenseRequest request;
+    while (io_.nextRequest(request))
+    {
+      DispenseCompletion completion;
+      if (scheduler_.submit(request, completion) != DispenseSubmit::QUEUED)
+      {
+        io_.reportCompletion(completion);
+      }
+    }
+
+    // The wheel keeps being counted while a treat is on its way out, so don't start another one until this one is done
+    if (!dispenser_.busy() && scheduler_.readyToStart(nowMs))
+    {
+      io_.log("[main] - dispensing treat");
+      dispenser_.start(nowMs);
+      scheduler_.markStarted(nowMs);
+      telemetryChanged_ = true;
+    }
+
+    DispenseResult result = dispenser_.update(nowMs);
+    if (result != DispenseResult::NONE)
+    {
+      telemetryChanged_ = true;
+      if (result == DispenseResult::DISPENSED)
+      {
+        totalTreats_++;
+      }
+      else
+      {
+        outOfTreats_ = true;
+        io_.log("[main] fully out of treats! - threshold of 30 seconds for dispensing a treat is exceeded");
+      }
+
+      DispenseCompletion completion;
+      if (scheduler_.finishTreat(result == DispenseResult::DISPENSED, completion))
+      {
+        io_.reportCompletion(completion);
+      }
+    }
+
+    bool hopperEmpty = dispenser_.hopperEmpty();
+    if (hopperEmpty != lastHopperEmpty_)
+    {
+      if (hopperEmpty)
+      {
+        io_.log("[main] hopper out of treats! - no treat seen in the hopper for 5 seconds of dispensing");
+      }
+      lastHopperEmpty_ = hopperEmpty;
+      telemetryChanged_ = true;
+    }
+    if (outOfTreats_ != reportedOutOfTreats_ || hopperEmpty != reportedHopperEmpty_)
+    {
+      reportedOutOfTreats_ = outOfTreats_;
+      reportedHopperEmpty_ = hopperEmpty;
+      io_.recordEvent(OutboxEventType::OUT_OF_TREATS, outOfTreats_, hopperEmpty, 0);
+    }
+
+    bool changed = telemetryChanged_;
+    telemetryChanged_ = false;
+    return changed;
+  }
+
+  uint32_t totalDistance() const { return totalDistance_; }
+  uint32_t totalTreats() const { return totalTreats_; }
+  uint32_t hallEffectCount() const { return hallEffectCount_; }
+  uint32_t progressDistance() const { return hallEffectCount_ * cmPerEdge_; } // cm run towards the next treat
+  bool outOfTreats() const { return outOfTreats_; }
+  bool hopperEmpty() const { return lastHopperEmpty_; }
+  bool dispensing() const { return dispenser_.busy(); }
+  uint32_t cmPerEdge() const { return cmPerEdge_; }
+  uint32_t distanceThreshold() const { return distanceThreshold_; }
+
+private:
+  WheelControllerIO io_ = {};
+  TreatDispenser dispenser_;
+  DispenseScheduler scheduler_;
+  WheelSpeedTracker wheelSpeed_;
+
+  uint32_t cmPerEdge_ = 1;
+  uint32_t distanceThreshold_ = 100 * 100;
+  bool debugDistance_ = false;
+
+  uint32_t totalDistance_ = 0;
+  uint32_t totalTreats_ = 0;
+  uint32_t hallEffectCount_ = 0; // edges towards the next treat
+  bool outOfTreats_ = false;
+
+  bool telemetryChanged_ = false;
+  bool errorLed_ = false;
+  bool errorLedKnown_ = false;
+  bool lastHopperEmpty_ = false;
+  bool reportedOutOfTreats_ = false;
+  bool reportedHopperEmpty_ = false;
+  uint32_t lastSpeed_ = 0;
+};
+
+#endif // WHEELCONTROLLER_H
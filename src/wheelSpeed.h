@@ -0,0 +1,186 @@
+// wheelSpeed.h
+#ifndef WHEELSPEED_H
+#define WHEELSPEED_H
+#include <stdint.h>
+
+// Turns hall edge timestamps into speed and cadence numbers. Everything is in microseconds from esp_timer, and there
+//   are no Arduino dependencies so the math can be checked on a PC.
+//
+// A "session" is a run of edges with no gap longer than sessionGapMs between them - ie one sprint / jog of the cat.
+
+// What a session came to, once it's over
+struct WheelSessionSummary
+{
+  uint32_t durationMs;
+  uint32_t distanceCm;
+  uint32_t peakCmPerSec;
+  float cadenceRpm;
+};
+
+class WheelSpeedTracker
+{
+public:
+  static const int SPEED_WINDOW_EDGES = 4; // speed is averaged over the last few edges so one magnet being a bit off doesn't make it jumpy
+
+  void begin(uint32_t cmPerEdge, uint32_t edgesPerRevolution, uint32_t sessionGapMs, uint32_t minEdgeIntervalUs)
+  {
+    cmPerEdge_ = cmPerEdge;
+    edgesPerRevolution_ = edgesPerRevolution > 0 ? edgesPerRevolution : 1;
+    sessionGapUs_ = (int64_t)sessionGapMs * 1000;
+    minEdgeIntervalUs_ = minEdgeIntervalUs;
+  }
+
+  void addEdge(int64_t timestampUs)
+  {
+    if (windowCount_ > 0)
+    {
+      int64_t sincePrevious = timestampUs - window_[(windowStart_ + windowCount_ - 1) % SPEED_WINDOW_EDGES];
+      if (sincePrevious < (int64_t)minEdgeIntervalUs_)
+      {
+        return; // the edge ISR has no glitch filter, so ignore anything faster than a wheel could physically spin
+      }
+      if (sincePrevious > sessionGapUs_)
+      {
+        endSession();
+      }
+    }
+
+    if (!sessionActive_)
+    {
+      sessionActive_ = true;
+      sessionStartUs_ = timestampUs;
+      sessionEdges_ = 0;
+      sessionPeakCmPerSec_ = 0;
+      windowCount_ = 0;
+    }
+    sessionEdges_++;
+    lastEdgeUs_ = timestampUs;
+
+    // keep the last SPEED_WINDOW_EDGES timestamps in a tiny circular window
+    if (windowCount_ < SPEED_WINDOW_EDGES)
+    {
+      window_[(windowStart_ + windowCount_) % SPEED_WINDOW_EDGES] = timestampUs;
+      windowCount_++;
+    }
+    else
+    {
+      window_[windowStart_] = timestampUs;
+      windowStart_ = (windowStart_ + 1) % SPEED_WINDOW_EDGES;
+    }
+
+    if (windowCount_ >= 2)
+    {
+      int64_t spanUs = timestampUs - window_[windowStart_];
+      if (spanUs > 0)
+      {
+        speedCmPerSec_ = (uint32_t)(((int64_t)(windowCount_ - 1) * cmPerEdge_ * 1000000) / spanUs);
+        if (speedCmPerSec_ > sessionPeakCmPerSec_)
+        {
+          sessionPeakCmPerSec_ = speedCmPerSec_;
+        }
+        if (speedCmPerSec_ > peakCmPerSec_)
+        {
+          peakCmPerSec_ = speedCmPerSec_;
+        }
+      }
+    }
+  }
+
+  // Call regularly (every loop is fine) so speed decays when the wheel stops, and sessions close after the gap.
+  void update(int64_t nowUs)
+  {
+    if (!sessionActive_)
+    {
+      return;
+    }
+
+    int64_t sinceLastEdge = nowUs - lastEdgeUs_;
+    if (sinceLastEdge > sessionGapUs_)
+    {
+      endSession();
+      return;
+    }
+
+    // we haven't seen the next magnet yet, so the wheel can't be going faster than one edge per sinceLastEdge
+    if (sinceLastEdge > 0)
+    {
+      uint32_t upperBound = (uint32_t)(((int64_t)cmPerEdge_ * 1000000) / sinceLastEdge);
+      if (upperBound < speedCmPerSec_)
+      {
+        speedCmPerSec_ = upperBound;
+      }
+    }
+  }
+
+  void resetPeak() { peakCmPerSec_ = 0; }
+
+  uint32_t speedCmPerSec() const { return speedCmPerSec_; }
+  uint32_t peakCmPerSec() const { return peakCmPerSec_; }
+  bool sessionActive() const { return sessionActive_; }
+  uint32_t sessionEdges() const { return sessionEdges_; }
+  uint32_t sessionPeakCmPerSec() const { return sessionPeakCmPerSec_; }
+  uint32_t sessionDurationMs() const { return (uint32_t)((lastEdgeUs_ - sessionStartUs_) / 1000); }
+
+  // True once after each session ends (with its numbers in `summary`). Sessions of a single edge don't count.
+  bool takeFinishedSession(WheelSessionSummary &summary)
+  {
+    if (!finishedSessionReady_)
+    {
+      return false;
+    }
+    summary = finishedSession_;
+    finishedSessionReady_ = false;
+    return true;
+  }
+
+  // Average wheel revolutions per minute over the current (or most recent) session
+  float sessionCadenceRpm() const
+  {
+    int64_t durationUs = lastEdgeUs_ - sessionStartUs_;
+    if (sessionEdges_ < 2 || durationUs <= 0)
+    {
+      return 0;
+    }
+    return ((float)(sessionEdges_ - 1) / edgesPerRevolution_) * 60000000.0f / (float)durationUs;
+  }
+
+private:
+  void endSession()
+  {
+    if (sessionEdges_ >= 2)
+    {
+      finishedSession_.durationMs = sessionDurationMs();
+      finishedSession_.distanceCm = (sessionEdges_ - 1) * cmPerEdge_;
+      finishedSession_.peakCmPerSec = sessionPeakCmPerSec_;
+      finishedSession_.cadenceRpm = sessionCadenceRpm();
+      finishedSessionReady_ = true;
+    }
+    sessionActive_ = false;
+    speedCmPerSec_ = 0;
+    windowCount_ = 0;
+    windowStart_ = 0;
+  }
+
+  uint32_t cmPerEdge_ = 0;
+  uint32_t edgesPerRevolution_ = 1;
+  int64_t sessionGapUs_ = 10000000;
+  uint32_t minEdgeIntervalUs_ = 0;
+
+  int64_t window_[SPEED_WINDOW_EDGES] = {};
+  int windowStart_ = 0;
+  int windowCount_ = 0;
+
+  uint32_t speedCmPerSec_ = 0;
+  uint32_t peakCmPerSec_ = 0;
+
+  bool sessionActive_ = false;
+  int64_t sessionStartUs_ = 0;
+  int64_t lastEdgeUs_ = 0;
+  uint32_t sessionEdges_ = 0;
+  uint32_t sessionPeakCmPerSec_ = 0;
+
+  WheelSessionSummary finishedSession_ = {};
+  bool finishedSessionReady_ = false;
+};
+
+#endif // WHEELSPEED_H
@@ -0,0 +1,144 @@
+# Build step for the web UI (runs before every build, see extra_scripts in platformio.ini).
+#
+# Takes the stylesheet, scripts and static pages in web/, minifies them, gzips them and writes them out as PROGMEM
+# byte arrays in src/webAssets.h. The firmware serves them with Content-Encoding: gzip, a content hash ETag and a long
+# Cache-Control, so browsers only download them once per firmware version.
+#
+# Can also be run by hand: python tools/build_web_assets.py
+
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO / SCons
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT = os.path.join(PROJECT_DIR, "src", "webAssets.h")
+
+LONG_CACHE = "public, max-age=31536000, immutable"  # safe because pages link to them with ?v=<hash>
+REVALIDATE = "no-cache"                             # html can be cached, but has to be checked against the ETag every time
+
+# (file in web/, url, content type, cache control). html is built last so it can link to the others by hash.
+ASSETS = [
+    ("style.css", "/static/style.css", "text/css", LONG_CACHE),
+    ("setup.js", "/static/setup.js", "application/javascript", LONG_CACHE),
+    ("main.js", "/static/main.js", "application/javascript", LONG_CACHE),
+    ("setup.html", "/static/setup.html", "text/html", REVALIDATE),
+]
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};:,>+])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_js(text):
+    # deliberately simple - keep the newlines so automatic semicolon insertion still works, just drop indentation,
+    # blank lines and whole-line comments
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line and not line.startswith("//"):
+            lines.append(line)
+    return "\n".join(lines)
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip())
+
+
+MINIFIERS = {".css": minify_css, ".js": minify_js, ".html": minify_html}
+
+
+def symbol_for(filename):
+    return "WEB_ASSET_" + re.sub(r"[^A-Za-z0-9]", "_", filename).upper()
+
+
+def c_array(data):
+    rows = []
+    for i in range(0, len(data), 20):
+        rows.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 20]) + ",")
+    return "\n".join(rows)
+
+
+def build():
+    hashes = {}
+    out = [
+        "// Generated by tools/build_web_assets.py from the files in web/ - don't edit this, edit those and rebuild.",
+        "#ifndef WEBASSETS_H",
+        "#define WEBASSETS_H",
+        "#ifdef ARDUINO",
+        "#include <Arduino.h>",
+        "#else",
+        "#include <stdint.h>",
+        "#include <stddef.h>",
+        "#define PROGMEM // the native build (page-bench) includes this too",
+        "#endif",
+        "",
+        "struct WebAsset",
+        "{",
+        "  const char *path;",
+        "  const char *contentType;",
+        "  const uint8_t *data;",
+        "  size_t length;",
+        "  const char *etag;",
+        "  const char *cacheControl;",
+        "};",
+        "",
+    ]
+    table = []
+    total_raw = 0
+    total_gz = 0
+
+    for filename, url, content_type, cache in ASSETS:
+        with open(os.path.join(WEB_DIR, filename), encoding="utf-8") as f:
+            text = f.read()
+
+        # let pages link to the other assets by content hash: {{hash:style.css}}
+        text = re.sub(r"\{\{hash:([^}]+)\}\}", lambda m: hashes[m.group(1)], text)
+        minified = MINIFIERS[os.path.splitext(filename)[1]](text).encode("utf-8")
+        compressed = gzip.compress(minified, compresslevel=9, mtime=0)  # mtime=0 so the output only changes when the content does
+
+        digest = hashlib.sha256(minified).hexdigest()[:16]
+        hashes[filename] = digest
+        symbol = symbol_for(filename)
+        total_raw += len(text.encode("utf-8"))
+        total_gz += len(compressed)
+
+        out.append("// %s: %d bytes, %d minified, %d gzipped" % (filename, len(text.encode("utf-8")), len(minified), len(compressed)))
+        out.append('#define %s_HASH "%s"' % (symbol, digest))
+        out.append("const uint8_t %s[] PROGMEM = {" % symbol)
+        out.append(c_array(compressed))
+        out.append("};")
+        out.append("")
+        table.append('  {"%s", "%s", %s, sizeof(%s), "\\"%s\\"", "%s"},' % (url, content_type, symbol, symbol, digest, cache))
+
+    out.append("const WebAsset WEB_ASSETS[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);")
+    out.append("")
+    out.append("#endif // WEBASSETS_H")
+    out.append("")
+    generated = "\n".join(out)
+
+    # only touch the header when something changed, otherwise every build would recompile main.cpp
+    existing = None
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, encoding="utf-8") as f:
+            existing = f.read()
+    if existing != generated:
+        with open(OUTPUT, "w", encoding="utf-8", newline="\n") as f:
+            f.write(generated)
+    print("web assets: %d bytes -> %d bytes gzipped" % (total_raw, total_gz))
+
+
+build()
@@ -0,0 +1,75 @@
+function togglePassword() {
+    const passwordField = document.getElementById('mqttPassword');
+    const toggleButton = event.target;
+
+    if (passwordField.type === 'password') {
+        passwordField.type = 'text';
+        toggleButton.textContent = 'Hide';
+    } else {
+        passwordField.type = 'password';
+        toggleButton.textContent = 'Show';
+    }
+}
+
+function confirmAction(message) {
+    return confirm(message);
+}
+
+function confirmRestart() {
+    return confirm('Are you sure you want to restart the device?');
+}
+
+// Keep the status section up to date from /api/status (a few hundred bytes) instead of reloading the whole page
+function setText(id, text) {
+    const element = document.getElementById(id);
+    if (element) {
+        element.textContent = text;
+    }
+}
+
+let currentStatus = {};
+
+function renderStatus(status) {
+    currentStatus = status;
+    setText('progress', status.progressMeters + '/' + status.thresholdMeters + ' Meters');
+    setText('totalDistance', status.totalDistanceMeters + ' Meters');
+    setText('speed', (status.speed / 100).toFixed(2) + ' m/s (peak ' + (status.peakSpeed / 100).toFixed(2) + ' m/s)');
+    setText('treats', status.treats);
+    setText('mqttStatus', status.mqttConnected ? 'True' : 'False');
+
+    const outOfTreats = document.getElementById('outOfTreats');
+    if (outOfTreats) {
+        outOfTreats.innerHTML = status.hopperEmpty ? '<b style="color: #721c24;">True</b>' : 'False';
+    }
+}
+
+function refreshStatus() {
+    fetch('/api/status', { cache: 'no-store' })
+        .then(response => response.json())
+        .then(renderStatus)
+        .catch(error => console.error('Error:', error));
+}
+
+// Prefer the live event stream. Only fall back to polling if the browser can't do it or the stream drops.
+let pollTimer = null;
+
+function startPolling() {
+    if (pollTimer === null) {
+        pollTimer = setInterval(refreshStatus, 5000);
+    }
+}
+
+if (window.EventSource) {
+    const events = new EventSource('/events');
+    events.addEventListener('status', event => {
+        clearInterval(pollTimer);
+        pollTimer = null;
+        renderStatus(JSON.parse(event.data));
+    });
+    events.addEventListener('delta', event => {
+        renderStatus(Object.assign({}, currentStatus, JSON.parse(event.data)));
+    });
+    events.onerror = startPolling;
+} else {
+    startPolling();
+}
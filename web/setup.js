@@ -0,0 +1,67 @@
+document.getElementById('scanBtn').addEventListener('click', function() {
+    var networkList = document.getElementById('networkList');
+    var loading = document.getElementById('loading');
+    var networksDiv = document.getElementById('networks');
+
+    networkList.classList.remove('hidden');
+    loading.classList.remove('hidden');
+    networksDiv.innerHTML = '';
+
+    // The device scans in the background and answers straight away with whatever it has, so keep asking until it's done
+    function loadNetworks(attempt) {
+        fetch('/scan')
+            .then(response => response.json())
+            .then(data => {
+                if (data.scanning && attempt < 20) {
+                    setTimeout(() => loadNetworks(attempt + 1), 1000);
+                    return;
+                }
+                showNetworks(data.networks);
+            })
+            .catch(error => {
+                loading.classList.add('hidden');
+                networksDiv.innerHTML = '<div class="network-item">Error scanning networks</div>';
+                console.error('Error:', error);
+            });
+    }
+
+    function showNetworks(data) {
+        loading.classList.add('hidden');
+
+        if (data.length === 0) {
+            networksDiv.innerHTML = '<div class="network-item">No networks found</div>';
+            return;
+        }
+
+        data.forEach(network => {
+            const networkItem = document.createElement('div');
+            networkItem.className = 'network-item';
+            if (network.encryption === 'Open') {
+                networkItem.classList.add('open-network');
+            }
+
+            // Determine RSSI color class
+            let rssiClass = 'weak';
+            if (network.rssi > -60) rssiClass = 'excellent';
+            else if (network.rssi > -68) rssiClass = 'good';
+            else if (network.rssi > -75) rssiClass = 'fair';
+
+            networkItem.innerHTML = `
+                <div class="network-info">${network.ssid}</div>
+                <div class="network-stats">
+                    <div class="rssi ${rssiClass}">${network.rssi} dBm</div>
+                    <div class="encryption">${network.encryption}</div>
+                </div>
+            `;
+
+            networkItem.addEventListener('click', function() {
+                document.getElementById('ssid').value = network.ssid;
+                document.getElementById('pass').focus();
+            });
+
+            networksDiv.appendChild(networkItem);
+        });
+    }
+
+    loadNetworks(0);
+});